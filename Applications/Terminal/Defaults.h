@@ -202,6 +202,7 @@ extern NSString *TerminalFontUseBoldKey;
 extern NSString *ScrollBackLinesKey;
 extern NSString *ScrollBackEnabledKey;
 extern NSString *ScrollBackUnlimitedKey;
+extern NSString *ScrollBackBytesKey;
 extern NSString *ScrollBottomOnInputKey;
 
 @interface Defaults (Display)
@@ -211,6 +212,8 @@ extern NSString *ScrollBottomOnInputKey;
 - (void)setScrollBackEnabled:(BOOL)yn;
 - (BOOL)scrollBackUnlimited;
 - (void)setScrollBackUnlimited:(BOOL)yn;
+- (NSUInteger)scrollBackBytes;
+- (void)setScrollBackBytes:(NSUInteger)bytes;
 - (BOOL)scrollBottomOnInput;
 - (void)setScrollBottomOnInput:(BOOL)yn;
 @end
@@ -736,11 +736,16 @@ NSString *TerminalFontUseBoldKey = @"TerminalFontUseBold";
 NSString *ScrollBackLinesKey = @"ScrollBackLines";
 NSString *ScrollBackEnabledKey = @"ScrollBackEnabled";
 NSString *ScrollBackUnlimitedKey = @"ScrollBackUnlimited";
+NSString *ScrollBackBytesKey = @"ScrollBackBytes";
 NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
 //---
 @implementation Defaults (Display)
 - (int)scrollBackLines
 {
+  if ([self scrollBackUnlimited] == YES)
+    {
+      return INT_MAX;
+    }
   if ([self objectForKey:ScrollBackLinesKey] == nil)
     {
       [self setInteger:256 forKey:ScrollBackLinesKey];
@@ -756,15 +761,10 @@ NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
     {
       if ([self scrollBackUnlimited] == YES)
         {
-          // TODO: now TerminalView allocates memory for to hold all lines
-          // at start (-init). If caluculations is based on INT_MAX TerminalView
-          // needs to allocate ~2GB of RAM. So TerminalView memory management
-          // must be rewritten to lazy allocating before "Unlimited" options
-          // can be used. For now it's hardocded to some reasonable value.
-          // scrollBackLines =
-          //   (INT_MAX-1)/([self defaultWindowWidth]*sizeof(screen_char_t));
-          // fprintf(stderr, "scrollBackLines=%i\n", scrollBackLines);
-          scrollBackLines = 1024;
+          // TerminalView stores scrollback lines compressed and allocates
+          // them lazily. In this mode buffer size is limited by
+          // ScrollBackBytes only.
+          scrollBackLines = INT_MAX;
         }
       else // scrollback limited
         {
@@ -804,6 +804,20 @@ NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
 {
   [self setBool:yn forKey:ScrollBackUnlimitedKey];
 }
+// Memory budget of scrollback buffer in bytes. 0 - no limit.
+- (NSUInteger)scrollBackBytes
+{
+  if ([self objectForKey:ScrollBackBytesKey] == nil)
+    {
+      [self setInteger:(8 * 1024 * 1024) forKey:ScrollBackBytesKey];
+    }
+  
+  return [self integerForKey:ScrollBackBytesKey];
+}
+- (void)setScrollBackBytes:(NSUInteger)bytes
+{
+  [self setInteger:bytes forKey:ScrollBackBytesKey];
+}
 - (BOOL)scrollBottomOnInput
 {
   if ([self objectForKey:ScrollBottomOnInputKey] == nil)
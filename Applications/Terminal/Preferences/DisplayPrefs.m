@@ -67,11 +67,15 @@
       [bufferEnabledBtn setState:NSOnState];
       
       if ([defs scrollBackUnlimited] == YES)
-        [bufferLengthMatrix selectCellWithTag:0];
+        {
+          // Limited by ScrollBackBytes
+          [bufferLengthMatrix selectCellWithTag:0];
+        }
       else
-        [bufferLengthMatrix selectCellWithTag:1];
-      
-      [bufferLengthField setIntegerValue:sbLines];
+        {
+          [bufferLengthMatrix selectCellWithTag:1];
+          [bufferLengthField setIntegerValue:sbLines];
+        }
     }
   
   [self setBufferEnabled:bufferEnabledBtn];
@@ -0,0 +1,60 @@
+/*
+  This file is a part of Terminal.app. Terminal.app is free software; you
+  can redistribute it and/or modify it under the terms of the GNU General
+  Public License as published by the Free Software Foundation; version 2
+  of the License. See COPYING or main.m for more information.
+*/
+
+/* Compact scrollback storage.
+
+   Lines are kept in a ring of compressed records: UTF-16 text with the
+   trailing blanks trimmed, followed by run-length encoded color/attribute
+   spans. A line is expanded back to screen_char_t cells only when it is
+   drawn or selected; the last expanded line is cached.
+
+   The ring grows lazily up to max_lines. If max_bytes is not 0, the oldest
+   lines are dropped when the buffer grows beyond that many bytes. */
+
+#ifndef ScrollBuffer_h
+#define ScrollBuffer_h
+
+#import <Foundation/NSString.h>
+#import <AppKit/NSEvent.h>
+
+#import "Terminal.h"
+
+typedef struct sb_line sb_line_t;
+
+typedef struct
+{
+  sb_line_t	**lines;	/* ring of compressed lines */
+  int		size;		/* allocated ring slots */
+  int		head;		/* slot the next line goes to */
+  int		depth;		/* lines stored */
+  int		max_lines;
+  size_t	bytes;		/* memory used by lines and ring */
+  size_t	max_bytes;	/* 0 - no limit */
+
+  /* last expanded line */
+  screen_char_t	*cache;
+  int		cache_size;
+  long long	cache_line;	/* absolute number, -1 - none */
+  int		cache_width;
+  long long	total;		/* absolute number of the next line */
+} scroll_buffer_t;
+
+void sb_init(scroll_buffer_t *sb, int max_lines, size_t max_bytes);
+void sb_free(scroll_buffer_t *sb);
+void sb_clear(scroll_buffer_t *sb);
+void sb_set_limits(scroll_buffer_t *sb, int max_lines, size_t max_bytes);
+
+/* Append line of `width` cells; NULL appends an empty line. */
+void sb_push(scroll_buffer_t *sb, const screen_char_t *line, int width);
+/* Remove `count` most recent lines. */
+void sb_pop(scroll_buffer_t *sb, int count);
+
+/* Line `y` expanded to `width` cells. -1 is the most recent line.
+   Returned buffer is valid until the next call. */
+screen_char_t *sb_line_at(scroll_buffer_t *sb, int y, int width);
+
+#endif
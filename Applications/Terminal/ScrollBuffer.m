@@ -0,0 +1,278 @@
+/*
+  This file is a part of Terminal.app. Terminal.app is free software; you
+  can redistribute it and/or modify it under the terms of the GNU General
+  Public License as published by the Free Software Foundation; version 2
+  of the License. See COPYING or main.m for more information.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "ScrollBuffer.h"
+
+/* Internal attribute bits (selected, dirty) are not stored. */
+#define ATTR_MASK 0x3f
+
+typedef struct
+{
+  unsigned short count;
+  unsigned char  color;
+  unsigned char  attr;
+} sb_run_t;
+
+struct sb_line
+{
+  unsigned short length;     /* characters stored in text[] */
+  unsigned short nruns;      /* sb_run_t records after text[] */
+  unichar        fill_ch;    /* trimmed trailing blanks */
+  unsigned char  fill_color;
+  unsigned char  fill_attr;
+  unichar        text[];
+};
+
+#define LINE_RUNS(l) ((sb_run_t *)&(l)->text[(l)->length])
+#define LINE_BYTES(l) (sizeof(sb_line_t) + (l)->length * sizeof(unichar) \
+                       + (l)->nruns * sizeof(sb_run_t))
+
+#define IS_BLANK(c) ((c).ch == 0 || (c).ch == ' ')
+
+static sb_line_t *compress_line(const screen_char_t *line, int width)
+{
+  sb_line_t	*l;
+  sb_run_t	*run;
+  screen_char_t	fill = {0, 0, 0};
+  int		length, nruns, i;
+
+  if (width > 0xffff) {
+    width = 0xffff;
+  }
+
+  length = line ? width : 0;
+  if (length > 0 && IS_BLANK(line[length - 1])) {
+    fill = line[length - 1];
+    fill.attr &= ATTR_MASK;
+    while (length > 0 && line[length - 1].ch == fill.ch
+           && line[length - 1].color == fill.color
+           && (line[length - 1].attr & ATTR_MASK) == fill.attr) {
+      length--;
+    }
+  }
+
+  nruns = 0;
+  for (i = 0; i < length; i++) {
+    if (i == 0 || line[i].color != line[i - 1].color
+        || (line[i].attr & ATTR_MASK) != (line[i - 1].attr & ATTR_MASK)) {
+      nruns++;
+    }
+  }
+
+  l = malloc(sizeof(sb_line_t) + length * sizeof(unichar)
+             + nruns * sizeof(sb_run_t));
+  if (!l) {
+    return NULL;
+  }
+  l->length = length;
+  l->nruns = nruns;
+  l->fill_ch = fill.ch;
+  l->fill_color = fill.color;
+  l->fill_attr = fill.attr;
+
+  run = LINE_RUNS(l) - 1;
+  for (i = 0; i < length; i++) {
+    l->text[i] = line[i].ch;
+    if (i == 0 || line[i].color != line[i - 1].color
+        || (line[i].attr & ATTR_MASK) != (line[i - 1].attr & ATTR_MASK)) {
+      run++;
+      run->count = 0;
+      run->color = line[i].color;
+      run->attr = line[i].attr & ATTR_MASK;
+    }
+    run->count++;
+  }
+
+  return l;
+}
+
+static void expand_line(sb_line_t *l, screen_char_t *dst, int width)
+{
+  sb_run_t	*run = LINE_RUNS(l);
+  int		x, n, r;
+
+  x = 0;
+  for (r = 0; r < l->nruns && x < width; r++, run++) {
+    for (n = 0; n < run->count && x < width; n++, x++) {
+      dst[x].ch = l->text[x];
+      dst[x].color = run->color;
+      dst[x].attr = run->attr;
+    }
+  }
+  for (; x < width; x++) {
+    dst[x].ch = l->fill_ch;
+    dst[x].color = l->fill_color;
+    dst[x].attr = l->fill_attr;
+  }
+}
+
+static void drop_oldest(scroll_buffer_t *sb)
+{
+  int slot = (sb->head - sb->depth + sb->size) % sb->size;
+
+  sb->bytes -= LINE_BYTES(sb->lines[slot]);
+  free(sb->lines[slot]);
+  sb->lines[slot] = NULL;
+  sb->depth--;
+}
+
+/* Reallocate ring to `size` slots placing lines from oldest at slot 0. */
+static BOOL resize_ring(scroll_buffer_t *sb, int size)
+{
+  sb_line_t	**lines = NULL;
+  int		i;
+
+  while (sb->depth > size) {
+    drop_oldest(sb);
+  }
+
+  if (size > 0) {
+    lines = calloc(size, sizeof(sb_line_t *));
+    if (!lines) {
+      return NO;
+    }
+    for (i = 0; i < sb->depth; i++) {
+      lines[i] = sb->lines[(sb->head - sb->depth + i + sb->size) % sb->size];
+    }
+  }
+  free(sb->lines);
+
+  sb->bytes -= sb->size * sizeof(sb_line_t *);
+  sb->bytes += size * sizeof(sb_line_t *);
+  sb->lines = lines;
+  sb->size = size;
+  sb->head = (size > 0) ? sb->depth % size : 0;
+
+  return YES;
+}
+
+static void enforce_limits(scroll_buffer_t *sb)
+{
+  while (sb->depth > sb->max_lines) {
+    drop_oldest(sb);
+  }
+  while (sb->max_bytes && sb->depth > 0 && sb->bytes > sb->max_bytes) {
+    drop_oldest(sb);
+  }
+}
+
+void sb_init(scroll_buffer_t *sb, int max_lines, size_t max_bytes)
+{
+  memset(sb, 0, sizeof(scroll_buffer_t));
+  sb->max_lines = (max_lines > 0) ? max_lines : 0;
+  sb->max_bytes = max_bytes;
+  sb->cache_line = -1;
+}
+
+void sb_free(scroll_buffer_t *sb)
+{
+  sb_clear(sb);
+  free(sb->lines);
+  free(sb->cache);
+  sb->lines = NULL;
+  sb->cache = NULL;
+  sb->size = sb->cache_size = 0;
+  sb->bytes = 0;
+}
+
+void sb_clear(scroll_buffer_t *sb)
+{
+  while (sb->depth > 0) {
+    drop_oldest(sb);
+  }
+  sb->head = 0;
+  sb->cache_line = -1;
+}
+
+void sb_set_limits(scroll_buffer_t *sb, int max_lines, size_t max_bytes)
+{
+  sb->max_lines = (max_lines > 0) ? max_lines : 0;
+  sb->max_bytes = max_bytes;
+
+  enforce_limits(sb);
+  if (sb->size > sb->max_lines) {
+    resize_ring(sb, sb->max_lines);
+  }
+}
+
+void sb_push(scroll_buffer_t *sb, const screen_char_t *line, int width)
+{
+  sb_line_t *l;
+
+  if (sb->max_lines <= 0) {
+    return;
+  }
+
+  if (sb->depth == sb->size) {
+    if (sb->size < sb->max_lines) {
+      int size = (sb->size > 0) ? sb->size * 2 : 64;
+      if (size > sb->max_lines || size < sb->size) {
+        size = sb->max_lines;
+      }
+      if (!resize_ring(sb, size) && sb->depth == 0) {
+        return;
+      }
+    }
+    if (sb->depth == sb->size) {
+      drop_oldest(sb);
+    }
+  }
+
+  if (!(l = compress_line(line, width))) {
+    return;
+  }
+  sb->lines[sb->head] = l;
+  sb->head = (sb->head + 1) % sb->size;
+  sb->depth++;
+  sb->bytes += LINE_BYTES(l);
+  sb->total++;
+
+  enforce_limits(sb);
+}
+
+void sb_pop(scroll_buffer_t *sb, int count)
+{
+  for (; count > 0 && sb->depth > 0; count--) {
+    sb->head = (sb->head - 1 + sb->size) % sb->size;
+    sb->bytes -= LINE_BYTES(sb->lines[sb->head]);
+    free(sb->lines[sb->head]);
+    sb->lines[sb->head] = NULL;
+    sb->depth--;
+    sb->total--;
+  }
+  sb->cache_line = -1;
+}
+
+screen_char_t *sb_line_at(scroll_buffer_t *sb, int y, int width)
+{
+  if (width > sb->cache_size) {
+    screen_char_t *cache = realloc(sb->cache, width * sizeof(screen_char_t));
+    if (!cache) {
+      return NULL;
+    }
+    sb->cache = cache;
+    sb->cache_size = width;
+    sb->cache_line = -1;
+  }
+
+  if (y < -sb->depth || y >= 0) {
+    memset(sb->cache, 0, width * sizeof(screen_char_t));
+    sb->cache_line = -1;
+  } else if (sb->cache_line == sb->total + y && sb->cache_width == width) {
+    return sb->cache;
+  } else {
+    expand_line(sb->lines[(sb->head + y + sb->size) % sb->size],
+                sb->cache, width);
+    sb->cache_line = sb->total + y;
+    sb->cache_width = width;
+  }
+
+  return sb->cache;
+}
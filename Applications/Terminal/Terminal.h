@@ -41,6 +41,8 @@ typedef struct
 -(void) ts_goto:(int)x :(int)y;
 -(void) ts_putChar:(screen_char_t)ch count:(int)c at:(int)x :(int)y;
 -(void) ts_putChar:(screen_char_t)ch count:(int)c offset:(int)ofs;
+/* Copy a span of c characters into row y starting at column x. */
+-(void) ts_putChars:(const screen_char_t *)chars count:(int)c at:(int)x :(int)y;
 
 /* The portions scrolled/shifted from remain unchanged. However, it's
 assumed that they will be cleared or overwritten before the redraw is
@@ -62,6 +64,7 @@ complete. (TODO check this) */
 @protocol TerminalParser
 - initWithTerminalScreen:(id<TerminalScreen>)ats width:(int)w height:(int)h;
 - (void)processByte:(unsigned char)c;
+- (void)processBytes:(const unsigned char *)bytes length:(int)len;
 - (void)setTerminalScreenWidth:(int)w
                         height:(int)h
                        cursorY:(int)cursor_y;
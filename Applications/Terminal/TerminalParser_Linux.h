@@ -67,6 +67,8 @@
 
   iconv_t iconv_state;
   iconv_t iconv_input_state;
+  BOOL    iconv_utf8;  /* input charset is UTF-8 */
+  BOOL    iconv_ascii; /* printable ASCII maps to itself through iconv */
   
   BOOL alternateAsMeta;
   BOOL sendDoubleEscape;
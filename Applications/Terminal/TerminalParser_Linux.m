@@ -22,6 +22,7 @@
 #include <AppKit/NSGraphics.h>
 
 #include <netinet/in.h>
+#include <strings.h>
 
 /* TODO */
 #include <AppKit/NSEvent.h>
@@ -1226,6 +1227,111 @@ static unsigned char color_table[] = { 0, 4, 2, 6, 1, 5, 3, 7,
 }
 
 
+/*
+  Bulk entry point. Runs of printable characters received in the ground
+  state are decoded here and handed to the screen as one span per row.
+  Control and escape bytes, partial multibyte input, insert mode and
+  multi-cell glyphs go through -processByte: as before.
+*/
+- (void)processBytes:(const unsigned char *)bytes length:(int)len
+{
+  const unsigned char *p = bytes, *end = bytes + len, *run_start;
+  BOOL multi_cell = [ts useMultiCellGlyphs];
+  screen_char_t span[width > 0 ? width : 1];
+  screen_char_t ch;
+  int span_x, n, seq_len;
+  unichar uch;
+  unsigned char c;
+  BOOL use_translate;
+
+  while (p < end)
+    {
+      if (vc_state != ESnormal || multi_cell || decim || toggle_meta
+          || utf_count || input_buf_len)
+        {
+          [self processByte:*p++];
+          continue;
+        }
+
+      use_translate = (!iconv_state || translate != translate_maps[0]);
+      ch.color = color;
+      ch.attr = (intensity)|(underline<<2)|(reverse<<3)|(blink<<4);
+      run_start = p;
+      span_x = x;
+      n = 0;
+
+      while (p < end)
+        {
+          c = *p;
+          /* same bytes -processByte: handles before looking at vc_state */
+          if (c < 0x20 || c == 127 || c == 128+27)
+            break;
+
+          if (utf && c > 0x7f)
+            break;
+
+          seq_len = 1;
+          if (use_translate)
+            {
+              uch = translate[c];
+            }
+          else if (c < 0x80 && iconv_ascii)
+            {
+              uch = c;
+            }
+          else if (iconv_utf8 && (c & 0xe0) == 0xc0 && c >= 0xc2)
+            {
+              if (end - p < 2 || (p[1] & 0xc0) != 0x80 || p[1] == 128+27)
+                break;
+              uch = ((c & 0x1f) << 6) | (p[1] & 0x3f);
+              seq_len = 2;
+            }
+          else if (iconv_utf8 && (c & 0xf0) == 0xe0)
+            {
+              if (end - p < 3
+                  || (p[1] & 0xc0) != 0x80 || p[1] == 128+27
+                  || (p[2] & 0xc0) != 0x80 || p[2] == 128+27)
+                break;
+              uch = ((c & 0x0f) << 12) | ((p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+              /* overlong forms and surrogates are left to iconv */
+              if (uch < 0x800 || (uch >= 0xd800 && uch <= 0xdfff))
+                break;
+              seq_len = 3;
+            }
+          else
+            break;
+
+          if (x >= width)
+            {
+              if (n)
+                [ts ts_putChars:span count:n at:span_x :y];
+              n = 0;
+              if (!decawm)
+                { /* nowhere to put it */
+                  p += seq_len;
+                  continue;
+                }
+              cr();
+              lf();
+              span_x = x;
+            }
+
+          ch.ch = uch;
+          span[n++] = ch;
+          x++;
+          p += seq_len;
+        }
+
+      if (n)
+        [ts ts_putChars:span count:n at:span_x :y];
+
+      if (p == run_start)
+        [self processByte:*p++];
+      else
+        [ts ts_goto:x :y];
+    }
+}
+
 /*
   Translates '\n' to '\r' when sending.
 */
@@ -1468,6 +1574,32 @@ static unsigned char color_table[] = { 0, 4, 2, 6, 1, 5, 3, 7,
         iconv_close(iconv_input_state);
       iconv_input_state = NULL;
     }
+
+  /* Remember what -processBytes:length: may decode without iconv */
+  iconv_utf8 = NO;
+  iconv_ascii = NO;
+  if (iconv_state)
+    {
+      char ascii[95], *inp = ascii, *outp;
+      unsigned int ucs[95];
+      size_t in_size = sizeof(ascii), out_size = sizeof(ucs);
+      int i;
+
+      iconv_utf8 = (!strcasecmp(iconv_charset, "UTF-8")
+                    || !strcasecmp(iconv_charset, "UTF8"));
+
+      for (i = 0; i < 95; i++)
+        ascii[i] = 0x20 + i;
+      outp = (char *)ucs;
+      if (iconv(iconv_state, &inp, &in_size, &outp, &out_size) != (size_t)-1
+          && out_size == 0)
+        {
+          for (i = 0; i < 95 && ntohl(ucs[i]) == 0x20 + i; i++)
+            ;
+          iconv_ascii = (i == 95);
+        }
+      iconv(iconv_state, NULL, NULL, NULL, NULL);
+    }
 }
 - (void)setDoubleEscape:(BOOL)doubleEscape
 {
@@ -18,6 +18,7 @@
 
 #import "Terminal.h"
 #import "TerminalParser_Linux.h"
+#import "ScrollBuffer.h"
 
 #import "Defaults.h"
 
@@ -31,6 +32,11 @@ struct selection_range
   int location,length;
 };
 
+struct dirty_row
+{
+  int x0, x1;
+};
+
 @interface TerminalView : NSView
 {
   Defaults     *defaults;
@@ -53,9 +59,18 @@ struct selection_range
   BOOL   use_multi_cell_glyphs;
   float  fx, fy, fx0, fy0;
 
-  struct {
-    int x0, y0, x1, y1;
-  } dirty;
+  /* Glyphs for printable ASCII characters (0x20-0x7e). Valid only if all
+     of them advance by `fx`, so they can be drawn in runs. */
+  NSGlyph font_glyphs[95];
+  NSGlyph boldFont_glyphs[95];
+  BOOL    font_glyph_runs;
+  BOOL    boldFont_glyph_runs;
+
+  /* Dirty column span [x0, x1) of every screen row, x0 == -1 means the
+     row is clean. Rows are marked while processing input and cleaned
+     when they are drawn. */
+  struct dirty_row *dirty;
+  BOOL dirty_changed;
 
 
   unsigned char	*write_buf;
@@ -68,7 +83,7 @@ struct selection_range
   NSScroller	*scroller;
   BOOL		scroll_bottom_on_input; /* preference */
   // Scrollback
-  screen_char_t	*sb_buffer;       /* scrollback buffer content storage */
+  scroll_buffer_t sb_buffer;       /* scrollback buffer content storage */
   int		max_sb_depth;     /* maximum scrollback size in lines */
   int		curr_sb_depth;    /* current scrollback size in lines */
   int		curr_sb_position; /* 0 = bottom; negative value = posision */
@@ -157,6 +172,7 @@ struct selection_range
 - (void)setBoldFont:(NSFont *)bFont;
 - (int)scrollBufferLength;
 - (void)setScrollBufferMaxLength:(int)lines;
+- (void)setScrollBufferMaxBytes:(NSUInteger)bytes;
 - (void)setScrollBottomOnInput:(BOOL)scrollBottom;
 - (void)setCursorStyle:(NSUInteger)style;
 
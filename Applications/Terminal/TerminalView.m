@@ -81,30 +81,63 @@ NSString *TerminalViewSizeDidChangeNotification=@"TerminalViewSizeDidChange";
 
 @implementation TerminalView (display)
 
-#define ADD_DIRTY(ax0, ay0, asx, asy) do {      \
-    if (dirty.x0 == -1) {                       \
-      dirty.x0 = (ax0);                         \
-      dirty.y0 = (ay0);                         \
-      dirty.x1 = (ax0) + (asx);                 \
-      dirty.y1 = (ay0) + (asy);                 \
-    } else {                                    \
-      if (dirty.x0 > (ax0)) {                   \
-        dirty.x0 = (ax0);                       \
-      }                                         \
-      if (dirty.y0 > (ay0)) {                   \
-        dirty.y0 = (ay0);                       \
-      }                                         \
-      if (dirty.x1 < (ax0) + (asx)) {           \
-        dirty.x1 = (ax0) + (asx);               \
-      }                                         \
-      if (dirty.y1 < (ay0) + (asy)) {           \
-        dirty.y1 = (ay0) + (asy);               \
-      }                                         \
-    }                                           \
+/* Extend dirty column span of rows [y0, y0 + h) by [x0, x0 + w). */
+static void add_dirty(struct dirty_row *rows, int sy,
+                      int x0, int y0, int w, int h)
+{
+  int y, y1 = y0 + h;
+
+  if (y0 < 0) {
+    y0 = 0;
+  }
+  if (y1 > sy) {
+    y1 = sy;
+  }
+  for (y = y0; y < y1; y++) {
+    if (rows[y].x0 == -1) {
+      rows[y].x0 = x0;
+      rows[y].x1 = x0 + w;
+    } else {
+      if (rows[y].x0 > x0) {
+        rows[y].x0 = x0;
+      }
+      if (rows[y].x1 < x0 + w) {
+        rows[y].x1 = x0 + w;
+      }
+    }
+  }
+}
+
+#define ADD_DIRTY(ax0, ay0, asx, asy) do {                      \
+    add_dirty(dirty, sy, (ax0), (ay0), (asx), (asy));           \
+    dirty_changed = YES;                                        \
   } while (0)
 
 #define SCREEN(x, y) (screen[(y) * sx + (x)])
 
+/* Scrollback lines are stored compressed (see ScrollBuffer.h) and expanded
+   on access. SB_LINE returns line `y` (-1 is the most recent one) ready for
+   drawing: selection and dirty bits are set from the current selection.
+   SB_CHAR takes a negative offset in the same coordinates as
+   selection.location. */
+#define SB_LINE(y) scrollback_line(&sb_buffer, (y), sx, selection)
+#define SB_CHAR(ofs) (sb_line_at(&sb_buffer, -((sx - 1 - (ofs)) / sx), sx)[(ofs) + ((sx - 1 - (ofs)) / sx) * sx])
+
+static screen_char_t *scrollback_line(scroll_buffer_t *sb, int y, int sx,
+                                      struct selection_range sel)
+{
+  screen_char_t *line = sb_line_at(sb, y, sx);
+  int i, ofs = y * sx;
+
+  for (i = 0; i < sx; i++, ofs++) {
+    line[i].attr = (line[i].attr & 0x3f) | 0x80;
+    if (ofs >= sel.location && ofs < sel.location + sel.length) {
+      line[i].attr |= 0x40;
+    }
+  }
+  return line;
+}
+
 static int total_draw = 0;
 
 //
@@ -326,10 +359,17 @@ static void set_foreground(NSGraphicsContext *gc,
   draw_cursor = draw_cursor || draw_all || (SCREEN(cursor_x, cursor_y).attr & 0x80) != 0;
 
   {
-    int ry;
+    int ry, rx0, rx1;
     screen_char_t *ch;
     float scr_y, scr_x, start_x;
 
+    /* glyph run being collected */
+    NSGlyph run_glyphs[sx];
+    NSSize  run_advances[sx];
+    NSGlyph *run_table, *table;
+    int     run_len, run_ix;
+    BOOL    bold_color;
+
     /* setting the color is slow, so we try to avoid it */
     unsigned char last_color, color, last_attr;
 
@@ -351,20 +391,31 @@ static void set_foreground(NSGraphicsContext *gc,
     DPSsethsbcolor(cur, WIN_BG_H, WIN_BG_S, WIN_BG_B);
     /* Fill the background of dirty cells. Since the background doesn't
        change that often, runs of dirty cells with the same background color
-       are combined and drawn with a single rectfill. */
+       are combined and drawn with a single rectfill. Only intensity, inverse
+       and selection attributes affect the background. */
+#define BG_ATTRS 0x4b
     for (iy = y0; iy < y1; iy++) {
       ry = iy + curr_sb_position;
+      rx0 = x0;
+      rx1 = x1;
+      if (!draw_all && ry >= 0) { // lazy redraw: skip clean rows and cells
+        if (dirty[ry].x0 == -1) {
+          continue;
+        }
+        rx0 = MAX(x0, dirty[ry].x0);
+        rx1 = MIN(x1, dirty[ry].x1);
+      }
       if (ry >= 0) {
-        ch = &SCREEN(x0,ry);
+        ch = &SCREEN(rx0,ry);
       } else {
-        ch = &sb_buffer[x0 + (max_sb_depth + ry) * sx];
+        ch = &SB_LINE(ry)[rx0];
       }
 
       scr_y = (sy - 1 - iy) * fy + border_y;
 
       /* ~400 cycles/cell on average */
       start_x = -1;
-      for (ix = x0; ix < x1; ix++,ch++) {
+      for (ix = rx0; ix < rx1; ix++,ch++) {
         /* no need to draw && not dirty */
         if (!draw_all && !(ch->attr & 0x80)) {
           if (start_x != -1) {
@@ -383,14 +434,14 @@ static void set_foreground(NSGraphicsContext *gc,
             color ^= 0xf0;
           }
                 
-          if (color != last_color || ch->attr != last_attr) {
+          if (color != last_color || (ch->attr & BG_ATTRS) != last_attr) {
             if (start_x != -1) {
               R(start_x, scr_y, scr_x - start_x, fy);
               start_x = scr_x;
             }
 
             last_color = color;
-            last_attr = ch->attr;
+            last_attr = ch->attr & BG_ATTRS;
                     
             // fprintf(stderr,
             //         "'%c' BG INVERSE color: %i (%i)"
@@ -417,14 +468,14 @@ static void set_foreground(NSGraphicsContext *gc,
             color ^= 0xf0; // selected
           }
                 
-          if (color != last_color || ch->attr != last_attr) {
+          if (color != last_color || (ch->attr & BG_ATTRS) != last_attr) {
             if (start_x != -1) {
               R(start_x, scr_y, scr_x - start_x, fy);
               start_x = scr_x;
             }
 
             last_color = color;
-            last_attr = ch->attr;
+            last_attr = ch->attr & BG_ATTRS;
 
             // fprintf(stderr,
             //         "'%c' BG NORMAL color: %i (%i) attrs: %i (in:%i sel:%i)"
@@ -464,18 +515,43 @@ static void set_foreground(NSGraphicsContext *gc,
 //------------------- CHARACTERS ------------------------------------------------
     last_color = -1;
     last_attr = 0;
-    /* Now draw any dirty characters */
+    bold_color = NO;
+    run_len = run_ix = 0;
+    run_table = NULL;
+    for (ix = 0; ix < sx; ix++) {
+      run_advances[ix] = NSMakeSize(fx, 0);
+    }
+    /* Now draw any dirty characters. Adjacent printable ASCII characters
+       drawn with the same font and color are collected into a run and shown
+       with a single GSShowGlyphsWithAdvances call. The run must be flushed
+       before the color or font changes. */
+#define FLUSH_RUN do {                                                  \
+      if (run_len) {                                                    \
+        DPSmoveto(cur, run_ix * fx + border_x + fx0, scr_y + fy0);      \
+        GSShowGlyphsWithAdvances(cur, run_glyphs, run_advances, run_len); \
+        run_len = 0;                                                    \
+      }                                                                 \
+    } while (0)
     for (iy = y0; iy < y1; iy++) {
       ry = iy + curr_sb_position;
+      rx0 = x0;
+      rx1 = x1;
+      if (!draw_all && ry >= 0) { // lazy redraw: skip clean rows and cells
+        if (dirty[ry].x0 == -1) {
+          continue;
+        }
+        rx0 = MAX(x0, dirty[ry].x0);
+        rx1 = MIN(x1, dirty[ry].x1);
+      }
       if (ry >= 0) {
-        ch = &SCREEN(x0,ry);
+        ch = &SCREEN(rx0,ry);
       } else {
-        ch = &sb_buffer[x0 + (max_sb_depth + ry) * sx];
+        ch = &SB_LINE(ry)[rx0];
       }
 
       scr_y = (sy - 1 - iy) * fy + border_y;
 
-      for (ix = x0; ix < x1; ix++,ch++) {
+      for (ix = rx0; ix < rx1; ix++,ch++) {
         /* no need to draw && not dirty */
         if (!draw_all && !(ch->attr & 0x80)) {
           continue;
@@ -496,6 +572,8 @@ static void set_foreground(NSGraphicsContext *gc,
             }
                     
             if (color != last_color || ch->attr != last_attr) {
+              FLUSH_RUN;
+              bold_color = NO;
               last_color = color;
               last_attr = ch->attr;
                         
@@ -516,6 +594,8 @@ static void set_foreground(NSGraphicsContext *gc,
           } else if (ch->attr & 0x10) { //---------------------------- FG BLINK
             // fprintf(stderr, "'%c' blink\n", ch->ch);
             if (ch->attr != last_attr) {
+              FLUSH_RUN;
+              bold_color = NO;
               last_attr = ch->attr;
               if (last_attr & 0x40) { // selection FG
                 // fprintf(stderr, "'%c' \tFG INVERSE: setting TEXT_NORM\n", ch->ch);
@@ -531,6 +611,8 @@ static void set_foreground(NSGraphicsContext *gc,
             }
                     
             if (color != last_color || ch->attr != last_attr) {
+              FLUSH_RUN;
+              bold_color = NO;
               last_color = color;
               last_attr = ch->attr;
                         
@@ -560,18 +642,36 @@ static void set_foreground(NSGraphicsContext *gc,
           if ((ch->attr & 3) == 2) {
             encoding = boldFont_encoding;
             f = boldFont;
-            if ((ch->color & 0x0f) == 15) {
+            table = boldFont_glyph_runs ? boldFont_glyphs : NULL;
+            if ((ch->color & 0x0f) == 15 && !bold_color) {
+              FLUSH_RUN;
               DPSsethsbcolor(cur, TEXT_BOLD_H, TEXT_BOLD_S, TEXT_BOLD_B);
+              bold_color = YES;
             }
           } else {
             encoding = font_encoding;
             f = font;
+            table = font_glyph_runs ? font_glyphs : NULL;
           }
           if (f != current_font) {
+            FLUSH_RUN;
             /* ~190 cycles/change */
             [f set];
             current_font = f;
           }
+
+          if (table && ch->ch >= 0x20 && ch->ch < 0x7f) {
+            if (run_len && (run_ix + run_len != ix || run_table != table)) {
+              FLUSH_RUN;
+            }
+            if (!run_len) {
+              run_ix = ix;
+              run_table = table;
+            }
+            run_glyphs[run_len++] = table[ch->ch - 0x20];
+            goto underline;
+          }
+          FLUSH_RUN;
                  
           /* we short-circuit utf8 for performance with back-art */
           /* TODO: short-circuit latin1 too? */
@@ -623,14 +723,25 @@ static void set_foreground(NSGraphicsContext *gc,
           /* ~3140 cycles blit loop, setup */
           /* ~3325 cycles blit loop, no write */
           /* ~3800 cycles total */
+        } else if (run_len && run_ix + run_len == ix
+                   && (ch->ch == 0 || ch->ch == 32)) {
+          /* blanks draw nothing, keep the run going */
+          run_glyphs[run_len++] = run_table[0];
         }
 
+      underline:
         //--- UNDERLINE
         if (ch->attr & 0x4) {
           DPSrectfill(cur, scr_x, scr_y, fx, 1);
         }
       }
+      FLUSH_RUN;
+
+      if (ry >= 0 && x0 <= dirty[ry].x0 && x1 >= dirty[ry].x1) {
+        dirty[ry].x0 = -1;
+      }
     }
+#undef FLUSH_RUN
   }
 
 //------------------- CURSOR ----------------------------------------------------
@@ -719,6 +830,35 @@ static void set_foreground(NSGraphicsContext *gc,
   ADD_DIRTY(x, y, c, 1);
 }
 
+- (void)ts_putChars:(const screen_char_t *)chars count:(int)c at:(int)x :(int)y
+{
+  int i;
+  screen_char_t *s;
+
+  NSDebugLLog(@"ts",@"putChars: count: %i at: %i:%i", c, x, y);
+
+  if (y < 0 || y >= sy) {
+    return;
+  }
+  if (x < 0) {
+    chars -= x;
+    c += x;
+    x = 0;
+  }
+  if (x + c > sx) {
+    c = sx - x;
+  }
+  if (c <= 0) {
+    return;
+  }
+  s = &SCREEN(x, y);
+  memcpy(s, chars, c * sizeof(screen_char_t));
+  for (i = 0; i < c; i++) {
+    s[i].attr |= 0x80;
+  }
+  ADD_DIRTY(x, y, c, 1);
+}
+
 - (void)ts_putChar:(screen_char_t)ch count:(int)c offset:(int)ofs
 {
   int i;
@@ -820,24 +960,17 @@ static void set_foreground(NSGraphicsContext *gc,
 
   NSDebugLLog(@"ts",@"scrollUp: %i:%i  rows: %i  save: %i", t, b, nr, save);
 
-  if (save && (t == 0) && (b == sy)) { /* TODO? */
-    int num;
-    if (nr < max_sb_depth) {
-      memmove(sb_buffer, &sb_buffer[sx * nr], sizeof(screen_char_t) * sx * (max_sb_depth - nr));
-      num = nr;
-    } else {
-      num = max_sb_depth;
+  if (save && (t == 0) && (b == sy) && (max_sb_depth > 0)) { /* TODO? */
+    int iy;
+    /* Lines that would be pushed out of the buffer right away are skipped. */
+    iy = (nr > max_sb_depth) ? nr - max_sb_depth : 0;
+    for (; iy < nr; iy++) {
+      /* TODO: should blank lines use video_erase_char? */
+      sb_push(&sb_buffer, (iy < sy) ? &SCREEN(0, iy) : NULL, sx);
     }
-    if (num < sy) {
-      memmove(&sb_buffer[sx * (max_sb_depth - num)], screen, num * sx * sizeof(screen_char_t));
-    } else {
-      memmove(&sb_buffer[sx * (max_sb_depth - num)], screen, sy * sx * sizeof(screen_char_t));
-      /* TODO: should this use video_erase_char? */
-      memset(&sb_buffer[sx * (max_sb_depth - num + sy)], 0, sx * (num - sy) * sizeof(screen_char_t));
-    }
-    curr_sb_depth += num;
-    if (curr_sb_depth > max_sb_depth) {
-      curr_sb_depth = max_sb_depth;
+    curr_sb_depth = sb_buffer.depth;
+    if (curr_sb_position < -curr_sb_depth) {
+      curr_sb_position = -curr_sb_depth;
     }
   }
 
@@ -1032,6 +1165,7 @@ static void set_foreground(NSGraphicsContext *gc,
 // Menu item "Edit > Clear Buffer"
 - (void)clearBuffer:(id)sender
 {
+  sb_clear(&sb_buffer);
   curr_sb_depth = 0;
   curr_sb_position = 0;
   [self _updateScroller];
@@ -1054,7 +1188,9 @@ static void set_foreground(NSGraphicsContext *gc,
   }
   t2 = [NSDate timeIntervalSinceReferenceDate];
   t2 -= t1;
-  fprintf(stderr,"%8.4f  %8.5f/redraw   total_draw=%i\n", t2, t2/i, total_draw);
+  fprintf(stderr,"%8.4f  %8.5f/redraw  %8.1f frames/s  %10.0f cells/s"
+          "  total_draw=%i\n",
+          t2, t2/i, i/t2, (double)sx*sy*i/t2, total_draw);
 }
 
 @end
@@ -1270,7 +1406,6 @@ static void set_foreground(NSGraphicsContext *gc,
 
 - (NSString *)_selectionAsString
 {
-  int ofs = max_sb_depth * sx;
   NSMutableString *mstr;
   NSString *tmp;
   unichar buf[32];
@@ -1290,7 +1425,7 @@ static void set_foreground(NSGraphicsContext *gc,
       while (1)
         {
           if (i < 0)
-            ch = sb_buffer[ofs+i].ch;
+            ch = SB_CHAR(i).ch;
           else
             ch = screen[i].ch;
 
@@ -1358,7 +1493,7 @@ static void set_foreground(NSGraphicsContext *gc,
 
 - (void)_setSelection:(struct selection_range)s
 {
-  int i,j,ofs2;
+  int i,j;
 
   if (s.location < -curr_sb_depth * sx)
     {
@@ -1375,18 +1510,13 @@ static void set_foreground(NSGraphicsContext *gc,
   if (s.length == selection.length && s.location == selection.location)
     return;
 
-  ofs2 = max_sb_depth * sx;
-
   j = selection.location + selection.length;
   if (j > s.location)
     j = s.location;
 
-  for (i = selection.location;i < j && i < 0;i++)
-    {
-      sb_buffer[ofs2+i].attr &= 0xbf;
-      sb_buffer[ofs2+i].attr |= 0x80;
-    }
-  for (;i < j;i++)
+  /* Scrollback lines get selection bits in SB_LINE, only the screen
+     needs updating. */
+  for (i = MAX(selection.location, 0);i < j;i++)
     {
       screen[i].attr &= 0xbf;
       screen[i].attr |= 0x80;
@@ -1395,25 +1525,17 @@ static void set_foreground(NSGraphicsContext *gc,
   i = s.location + s.length;
   if (i < selection.location)
     i = selection.location;
+  if (i < 0)
+    i = 0;
   j = selection.location + selection.length;
-  for (;i<j && i<0;i++)
-    {
-      sb_buffer[ofs2+i].attr &= 0xbf;
-      sb_buffer[ofs2+i].attr |= 0x80;
-    }
   for (;i<j;i++)
     {
       screen[i].attr &= 0xbf;
       screen[i].attr |= 0x80;
     }
 
-  i = s.location;
+  i = MAX(s.location, 0);
   j = s.location+s.length;
-  for (;i<j && i<0;i++)
-    {
-      if (!(sb_buffer[ofs2+i].attr & 0x40))
-        sb_buffer[ofs2+i].attr |= 0xc0;
-    }
   for (;i<j;i++)
     {
       if (!(screen[i].attr & 0x40))
@@ -1607,13 +1729,12 @@ static void set_foreground(NSGraphicsContext *gc,
 
   if (g == 2)
     { /* select words */
-      int ofs = max_sb_depth * sx;
       unichar ch,ch2;
       NSCharacterSet *cs;
       int i,j;
 
       if (pos < 0)
-        ch = sb_buffer[ofs+pos].ch;
+        ch = SB_CHAR(pos).ch;
       else
         ch = screen[pos].ch;
       if (ch == 0) ch = ' ';
@@ -1643,7 +1764,7 @@ static void set_foreground(NSGraphicsContext *gc,
       for (i = pos-1; i >= j; i--)
         {
           if (i < 0)
-            ch2 = sb_buffer[ofs+i].ch;
+            ch2 = SB_CHAR(i).ch;
           else
             ch2 = screen[i].ch;
           if (ch2 == 0) ch2 = ' ';
@@ -1658,7 +1779,7 @@ static void set_foreground(NSGraphicsContext *gc,
       for (i = pos+1; i < j; i++)
         {
           if (i < 0)
-            ch2 = sb_buffer[ofs+i].ch;
+            ch2 = SB_CHAR(i).ch;
           else
             ch2=screen[i].ch;
           if (ch2 == 0) ch2 = ' ';
@@ -1784,12 +1905,12 @@ static void set_foreground(NSGraphicsContext *gc,
 
 - (void)readData
 {
-  char buf[256];
-  int size,total,i;
+  unsigned char buf[16384];
+  int size,total;
 
   total = 0;
   num_scrolls = 0;
-  dirty.x0 = -1;
+  dirty_changed = NO;
 
   current_x = cursor_x;
   current_y = cursor_y;
@@ -1847,8 +1968,7 @@ static void set_foreground(NSGraphicsContext *gc,
         }
 
 
-      for (i=0;i<size;i++)
-        [terminalParser processByte: buf[i]];
+      [terminalParser processBytes:buf length:size];
 
       total+=size;
       /*
@@ -1861,7 +1981,7 @@ static void set_foreground(NSGraphicsContext *gc,
 
         TODO: tweak more? seems pretty good now
       */
-      if (total>=8192 || (num_scrolls+abs(pending_scroll))>10)
+      if (total>=65536 || (num_scrolls+abs(pending_scroll))>10)
         break;
     }
 
@@ -1873,23 +1993,40 @@ static void set_foreground(NSGraphicsContext *gc,
       draw_cursor=YES;
     }
 
-  NSDebugLLog(@"term",@"done (%i %i) (%i %i)\n",
-              dirty.x0,dirty.y0,dirty.x1,dirty.y1);
-
-  if (dirty.x0>=0)
+  if (dirty_changed)
     {
       NSRect dr;
+      int x0 = sx, x1 = 0, y0 = -1, y1 = 0;
+      int iy;
 
-// NSLog(@"dirty=(%i %i)-(%i %i)\n",dirty.x0,dirty.y0,dirty.x1,dirty.y1);
-      dr.origin.x = dirty.x0*fx;
-      dr.origin.y = dirty.y0*fy;
-      dr.size.width = (dirty.x1-dirty.x0)*fx;
-      dr.size.height = (dirty.y1-dirty.y0)*fy;
-      dr.origin.y = fy*sy-(dr.origin.y+dr.size.height);
-// NSLog(@"-> dirty=(%g %g)+(%g %g)\n",dirty.origin.x,dirty.origin.y,dirty.size.width,dirty.size.height);
-      dr.origin.x += border_x;
-      dr.origin.y += border_y;
-      [self setNeedsLazyDisplayInRect:dr];
+      /* Rows still dirty from previous passes are included: they might
+         not have been drawn yet. */
+      for (iy = 0; iy < sy; iy++)
+        {
+          if (dirty[iy].x0 == -1)
+            continue;
+          if (y0 == -1)
+            y0 = iy;
+          y1 = iy + 1;
+          if (dirty[iy].x0 < x0)
+            x0 = dirty[iy].x0;
+          if (dirty[iy].x1 > x1)
+            x1 = dirty[iy].x1;
+        }
+
+      NSDebugLLog(@"term",@"done (%i %i) (%i %i)\n", x0, y0, x1, y1);
+
+      if (y0 >= 0)
+        {
+          dr.origin.x = x0*fx;
+          dr.origin.y = y0*fy;
+          dr.size.width = (x1-x0)*fx;
+          dr.size.height = (y1-y0)*fy;
+          dr.origin.y = fy*sy-(dr.origin.y+dr.size.height);
+          dr.origin.x += border_x;
+          dr.origin.y += border_y;
+          [self setNeedsLazyDisplayInRect:dr];
+        }
 
       if (curr_sb_position != 0)
         { /* TODO */
@@ -2223,6 +2360,40 @@ static int handled_mask = (NSDragOperationCopy |
 
 @implementation TerminalView
 
+/* Fill `glyphs` for printable ASCII characters of font `f`. Returns NO if
+   some character has no glyph or its advancement differs from cell width
+   `fx`: such font can't be drawn in glyph runs. */
+static BOOL get_ascii_glyphs(NSFont *f, float fx, NSGlyph *glyphs)
+{
+  unichar c;
+
+  if (!f) {
+    return NO;
+  }
+  for (c = 0x20; c < 0x7f; c++) {
+    glyphs[c - 0x20] = [f glyphForCharacter:c];
+    if (glyphs[c - 0x20] == NSNullGlyph) {
+      return NO;
+    }
+    if (fabs([f advancementForGlyph:glyphs[c - 0x20]].width - fx) > 0.01) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+// (Re)allocate per-row dirty spans for current screen height, all rows
+// are clean. Whole view is expected to be redrawn after this call.
+- (void)_resetDirtyRows
+{
+  int iy;
+
+  dirty = realloc(dirty, sizeof(struct dirty_row) * sy);
+  for (iy = 0; iy < sy; iy++) {
+    dirty[iy].x0 = -1;
+  }
+}
+
 // ---
 // Resize
 // ---
@@ -2230,8 +2401,8 @@ static int handled_mask = (NSDragOperationCopy |
 {
   int nsx, nsy;
   struct winsize ws;
-  screen_char_t *nscreen, *new_sb_buffer;
-  int iy,ny;
+  screen_char_t *nscreen;
+  int iy,ny,shift;
   int copy_sx;
 
   nsx = (size.width - border_x) / fx;
@@ -2264,27 +2435,19 @@ static int handled_mask = (NSDragOperationCopy |
 
   [self _clearSelection]; /* TODO? */
 
-  // Prepare new screen and history buffer
+  // Prepare new screen
   nscreen = malloc(nsx * nsy * sizeof(screen_char_t));
-  new_sb_buffer = malloc(nsx * max_sb_depth * sizeof(screen_char_t));
-  if (!nscreen || !new_sb_buffer) {
+  if (!nscreen) {
     NSLog(@"Failed to allocate screen buffer!");
-    if (nscreen)
-      free(nscreen);
-    if (new_sb_buffer)
-      free(new_sb_buffer);
     return;
   }
   memset(nscreen, 0, sizeof(screen_char_t) * nsx * nsy);
-  memset(new_sb_buffer, 0, sizeof(screen_char_t) * nsx * max_sb_depth);
 
   copy_sx = sx;
   if (copy_sx > nsx) {
     copy_sx = nsx;
   }
 
-  //NSLog(@"copy %i+%i %i  (%ix%i)-(%ix%i)\n",start,num,copy_sx,sx,sy,nsx,nsy);
-
   /* TODO: handle resizing and scrollback improve? */
   // sy,sx - current screen height(lines) and width(chars)
   // nsy,nsx - screen height(lines) and width(chars) after resize 
@@ -2305,47 +2468,39 @@ static int handled_mask = (NSDragOperationCopy |
     line_shift = curr_sb_depth;
   }
 
-  // NOTE: this part of code is not very short, but it's clear and simple.
-  // Leave it as is.
-  for (iy = -curr_sb_depth; iy < sy; iy++) {
-    screen_char_t *src, *dst;
+  // Old line `iy` becomes new line `iy + shift`. What direction of resize:
+  // increase or descrease?
+  if (sy > nsy) { // decrease
+    // cut bottom of 'screen' or not?
+    shift = (cursor_y < nsy) ? 0 : line_shift;
+  } else { // increase
+    // do we have scrollback buffer filled?
+    shift = (curr_sb_depth > 0) ? line_shift : 0;
+  }
 
-    // what is direction of resize: increase or descrease?
-    if (sy > nsy) { // decrease
-      // cut bottom of 'screen' or not?
-      if (cursor_y < nsy) { // cut
-        ny = iy;
-      } else { // not cut
-        ny = iy + line_shift;
-      }
-    } else { // increase
-      // do we have scrollback buffer filled?
-      if (curr_sb_depth > 0) { // YES
-        ny = iy + line_shift;
-      } else { // NO
-        ny = iy;
-      }
-    }
-    if (ny >= nsy) {
+  // Scrollback lines are stored width independent, only lines which move
+  // between screen and scrollback buffer are copied.
+  for (ny = 0; ny < nsy; ny++) {
+    iy = ny - shift;
+    if (iy >= sy) {
       break;
     }
-    if (ny < -max_sb_depth) {
+    if (iy < -curr_sb_depth) {
       continue;
     }
-      
-    // fprintf(stderr, "* iy=%i ny=%i\n", iy, ny);
-      
     if (iy < 0) {
-      src = &sb_buffer[sx * (max_sb_depth + iy)];
+      memcpy(&nscreen[nsx * ny], sb_line_at(&sb_buffer, iy, nsx),
+             nsx * sizeof(screen_char_t));
     } else {
-      src = &screen[sx * iy];
+      memcpy(&nscreen[nsx * ny], &screen[sx * iy],
+             copy_sx * sizeof(screen_char_t));
     }
-    if (ny < 0) {
-      dst = &new_sb_buffer[nsx * (max_sb_depth + ny)];
-    } else {
-      dst = &nscreen[nsx * ny];
-    }
-    memcpy(dst, src, copy_sx * sizeof(screen_char_t));
+  }
+  if (shift > 0) { // lines moved from scrollback to screen
+    sb_pop(&sb_buffer, shift);
+  }
+  for (iy = 0; iy < -shift && iy < sy; iy++) { // and from screen to scrollback
+    sb_push(&sb_buffer, &screen[sx * iy], sx);
   }
 
   // update cursor y position
@@ -2353,15 +2508,9 @@ static int handled_mask = (NSDragOperationCopy |
     cursor_y = cursor_y + line_shift;
   }
 
-  // Calculate new scroll buffer length
-  if (nsy <= cursor_y || sy < nsy) {
-    curr_sb_depth = curr_sb_depth - line_shift;
-  }
-  if (curr_sb_depth > max_sb_depth) {
-    curr_sb_depth = max_sb_depth;
-  }
-  if (curr_sb_depth < 0) {
-    curr_sb_depth = 0;
+  curr_sb_depth = sb_buffer.depth;
+  if (curr_sb_position < -curr_sb_depth) {
+    curr_sb_position = -curr_sb_depth;
   }
   // fprintf(stderr,
   //         "***< curr_sb_depth=%i, max_sb_depth=%i, sy=%i, nsy=%i cursor_y=%i\n",
@@ -2370,9 +2519,8 @@ static int handled_mask = (NSDragOperationCopy |
   sx = nsx;
   sy = nsy;
   free(screen);
-  free(sb_buffer);
   screen = nscreen;
-  sb_buffer = new_sb_buffer;
+  [self _resetDirtyRows];
 
   if (cursor_x > sx) {
     cursor_x = sx - 1;
@@ -2440,11 +2588,11 @@ static int handled_mask = (NSDragOperationCopy |
 
   screen = malloc(sizeof(screen_char_t)*sx*sy);
   memset(screen,0,sizeof(screen_char_t)*sx*sy);
+  [self _resetDirtyRows];
   draw_all = 2;
 
   max_sb_depth = [defaults scrollBackLines];
-  sb_buffer = malloc(sizeof(screen_char_t)*sx*max_sb_depth);
-  memset(sb_buffer, 0, sizeof(screen_char_t)*sx*max_sb_depth);
+  sb_init(&sb_buffer, max_sb_depth, [defaults scrollBackBytes]);
   scroll_bottom_on_input = [defaults scrollBottomOnInput];
 
   terminalParser = [[TerminalParser_Linux alloc] initWithTerminalScreen:self
@@ -2492,9 +2640,10 @@ static int handled_mask = (NSDragOperationCopy |
   DESTROY(scroller);
 
   free(screen);
-  free(sb_buffer);
+  free(dirty);
+  sb_free(&sb_buffer);
   screen = NULL;
-  sb_buffer = NULL;
+  dirty = NULL;
 
   DESTROY(additionalWordCharacters);
   DESTROY(font);
@@ -2521,7 +2670,6 @@ static int handled_mask = (NSDragOperationCopy |
 // - (NSString *)stringForRange:(struct selection_range)range
 - (NSString *)stringRepresentation
 {
-  int			ofs = max_sb_depth * sx;
   NSMutableString	*mstr = [[NSMutableString alloc] init];
   NSString		*tmp;
   unichar		buf[32];
@@ -2540,7 +2688,7 @@ static int handled_mask = (NSDragOperationCopy |
   len = 0;
   for (int i = start_index; i < end_index; i++) {
     if (i < 0) {
-      ch = sb_buffer[ofs+i].ch;
+      ch = SB_CHAR(i).ch;
     } else {
       ch = screen[i].ch;
     }
@@ -2626,6 +2774,8 @@ static int handled_mask = (NSDragOperationCopy |
   fx0 = -r.origin.x;
   fy0 = -r.origin.y;
   font_encoding = [font mostCompatibleStringEncoding];
+  font_glyph_runs = get_ascii_glyphs(font, fx, font_glyphs);
+  boldFont_glyph_runs = get_ascii_glyphs(boldFont, fx, boldFont_glyphs);
   
   NSDebugLLog(@"term", @"Bounding (%g %g)+(%g %g)", -fx0, -fy0, fx, fy);
   NSDebugLLog(@"term", @"Normal font encoding %i", font_encoding);
@@ -2638,6 +2788,7 @@ static int handled_mask = (NSDragOperationCopy |
   ASSIGN(boldFont, bFont);
   
   boldFont_encoding = [boldFont mostCompatibleStringEncoding];
+  boldFont_glyph_runs = get_ascii_glyphs(boldFont, fx, boldFont_glyphs);
   
   NSDebugLLog(@"term", @"Bold font encoding %i", boldFont_encoding);
     
@@ -2655,54 +2806,39 @@ static int handled_mask = (NSDragOperationCopy |
     return;
   }
   
+  [self _clearSelection];
   if (lines == 0) {
     [self clearBuffer:self];
   }
 
+  // Adopt scrollback buffer to new 'max_sb_depth' value: the most recent
+  // lines are kept.
   max_sb_depth = lines;
-  
-  { // Adopt scrollback buffer to new 'max_sb_depth' value
-    screen_char_t *new_sb_buffer;
-    int sby = (max_sb_depth > 0) ? max_sb_depth : 1;
-
-    curr_sb_depth = max_sb_depth;
+  sb_set_limits(&sb_buffer, max_sb_depth, sb_buffer.max_bytes);
+  curr_sb_depth = sb_buffer.depth;
 
-    new_sb_buffer = malloc(sizeof(screen_char_t) * sx * sby);
-    memset(new_sb_buffer, 0, sizeof(screen_char_t) * sx * sby);
-    free(sb_buffer);
-    
-    sb_buffer = new_sb_buffer;
-  }
-  
-  // Adopt scrollback buffer to new 'max_sb_depth' value.
-  // General logic:
-  // - initially allocate memory for 3 terminal screens
-  // - realloc scrollback buffer by screen page until max_sb_depth will be reached
-  // - on window resize or preference change buffer size should be recalculated
-
-#if 0
-  screen_char_t *new_sb_buffer;
-  
-  if (curr_sb_depth > 0) { // not empty
-    if (curr_sb_depth < lines) {
-      // new value is greater - realloc current buffer if needed
-        
-    } else {
-      // new buffer smaller of the currently used - realloc to the `lines` size and refresh screen
-    }
+  if (curr_sb_position < -curr_sb_depth) {
+    curr_sb_position = -curr_sb_depth;
   }
+  [self _updateScroller];
+  [self setNeedsDisplay:YES];
+}
 
-  // Initial state: unlimited<->sized, empty<->filled
-  if (curr_sb_depth < max_sb_depth) {
-    realloc(sb_buffer, sizeof(screen_char_t) * sx * curr_sb_depth);
+- (void)setScrollBufferMaxBytes:(NSUInteger)bytes
+{
+  if (sb_buffer.max_bytes == bytes) {
+    return;
   }
-  curr_sb_depth = max_sb_depth;
 
-  new_sb_buffer = malloc(sizeof(screen_char_t) * sx * curr_sb_depth);
-  memset(new_sb_buffer, 0, sizeof(screen_char_t) * sx * curr_sb_depth);
-  free(sb_buffer);
-  sb_buffer = new_sb_buffer;
-#endif
+  [self _clearSelection];
+  sb_set_limits(&sb_buffer, max_sb_depth, bytes);
+  curr_sb_depth = sb_buffer.depth;
+
+  if (curr_sb_position < -curr_sb_depth) {
+    curr_sb_position = -curr_sb_depth;
+  }
+  [self _updateScroller];
+  [self setNeedsDisplay:YES];
 }
 
 - (void)setScrollBottomOnInput:(BOOL)scrollBottom
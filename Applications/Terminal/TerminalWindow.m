@@ -488,6 +488,12 @@ NSString *TerminalWindowSizeDidChangeNotification =
           [tView setScrollBufferMaxLength:0];
         }
     }
+
+  if ([prefs objectForKey:ScrollBackBytesKey] != nil)
+    {
+      [tView setScrollBufferMaxBytes:[prefs scrollBackBytes]];
+      [livePreferences setScrollBackBytes:[prefs scrollBackBytes]];
+    }
   
   //---  For TerminalView usage only ---
   // Font changed
@@ -56,7 +56,8 @@
 - (void)deactivate;
 - (NSWindow *)window;
 
-- (void)addResult:(NSString *)resultString;
+- (void)addResults:(NSArray *)results;
+- (void)finishSearch;
 - (void)finishFind;
 
 @end
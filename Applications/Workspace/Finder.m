@@ -19,6 +19,12 @@
 // Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
 //
 
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
 #import <AppKit/AppKit.h>
 #import <DesktopKit/NXTDefaults.h>
 #import <DesktopKit/NXTAlert.h>
@@ -81,12 +87,42 @@
 //=============================================================================
 // NSOperation to perform search asynchronously
 //=============================================================================
+#define FIND_MAX_THREADS      16
+#define FIND_DENTS_BUFFER     (64 * 1024)
+// Results are sent to Finder at this interval (seconds)
+#define FIND_RESULTS_INTERVAL 0.1
+
+// Record returned by getdents64()
+struct linux_dirent64 {
+  uint64_t       d_ino;
+  int64_t        d_off;
+  unsigned short d_reclen;
+  unsigned char  d_type;
+  char           d_name[];
+};
+
+typedef struct {
+  NSLock         *lock;
+  NSMutableArray *paths; // owner pops last object, other threads steal first
+} FindStack;
+
 @interface FindWorker : NSOperation
 {
   Finder *finder;
   NSArray *searchPaths;
   NSRegularExpression *expression;
   BOOL isContentSearch;
+  BOOL isShowHidden;
+
+  // Directories are read by threads. Each thread pops directories from its
+  // own stack and steals from other stacks when its stack is empty.
+  FindStack stacks[FIND_MAX_THREADS];
+  NSUInteger threadCount;
+  NSCondition *condition;   // guards the variables below
+  NSUInteger runningThreads;
+  NSUInteger pendingDirs;   // queued or being read
+  NSMutableArray *results;  // not sent to Finder yet
+  volatile BOOL isStopped;
 }
 - (id)initWithFinder:(Finder *)onwer
                paths:(NSArray *)paths
@@ -116,6 +152,7 @@
     expression = regexp;
     [expression retain];
     isContentSearch = isContent;
+    isShowHidden = [[NXTFileManager defaultManager] isShowHiddenFiles];
   }
 
   return self;
@@ -168,57 +205,265 @@
   return isMatched;
 }
 
+// --- Directory stacks
+
+- (void)pushDirectory:(NSString *)dirPath toStack:(NSUInteger)index
+{
+  [condition lock];
+  pendingDirs++;
+  [condition unlock];
+
+  [stacks[index].lock lock];
+  [stacks[index].paths addObject:dirPath];
+  [stacks[index].lock unlock];
+}
+
+// Returns retained path or nil if all stacks are empty.
+- (NSString *)popDirectoryFromStack:(NSUInteger)index
+{
+  FindStack *stack = &stacks[index];
+  NSString  *dirPath = nil;
+
+  [stack->lock lock];
+  if ([stack->paths count] > 0) {
+    dirPath = [[stack->paths lastObject] retain];
+    [stack->paths removeLastObject];
+  }
+  [stack->lock unlock];
+
+  // steal directory closest to the search root
+  for (NSUInteger i = 1; dirPath == nil && i < threadCount; i++) {
+    stack = &stacks[(index + i) % threadCount];
+    if ([stack->lock tryLock]) {
+      if ([stack->paths count] > 0) {
+        dirPath = [[stack->paths objectAtIndex:0] retain];
+        [stack->paths removeObjectAtIndex:0];
+      }
+      [stack->lock unlock];
+    }
+  }
+
+  return dirPath;
+}
+
+// --- Traversal threads
+
+// Names listed in .hidden file of directory
+- (NSSet *)hiddenNamesInDirectory:(NSString *)dirPath fd:(int)dir_fd
+{
+  NSString *hidden;
+
+  if (isShowHidden != NO || faccessat(dir_fd, ".hidden", F_OK, 0) < 0) {
+    return nil;
+  }
+  hidden = [NSString stringWithContentsOfFile:
+                       [dirPath stringByAppendingPathComponent:@".hidden"]];
+
+  return [NSSet setWithArray:[hidden componentsSeparatedByString:@"\n"]];
+}
+
+// Entry types are taken from getdents64() records. Entries are stat'ed
+// only if file system doesn't provide types.
 - (void)findInDirectory:(NSString *)dirPath
+                  stack:(NSUInteger)index
+                 buffer:(char *)buffer
 {
-  NXTFileManager *fm = [NXTFileManager defaultManager];
-  BOOL           isDir;
-  NSArray        *dirContents;
-  NSString       *itemPath;
-  NSDictionary   *attrs;
-  NSString       *itemFormat;
+  NSFileManager         *fm = [NSFileManager defaultManager];
+  NSMutableArray        *found = [NSMutableArray array];
+  NSSet                 *hiddenNames;
+  NSString              *item, *itemPath;
+  NSString              *itemFormat;
+  struct linux_dirent64 *entry;
+  struct stat           st;
+  unsigned char         type;
+  long                  count, offset;
+  int                   fd;
 
   // NSLog(@"Processing directory %@...", dirPath);
 
-  dirContents = [fm directoryContentsAtPath:dirPath
-                                    forPath:nil
-                                 showHidden:[fm isShowHiddenFiles]];
+  // search roots (shelf icons) may be symbolic links to directories,
+  // subdirectories are never links: d_type or stat tells
+  fd = open([dirPath fileSystemRepresentation],
+            O_RDONLY | O_DIRECTORY | O_CLOEXEC |
+            ([searchPaths containsObject:dirPath] ? 0 : O_NOFOLLOW));
+  if (fd < 0) {
+    return;
+  }
+  hiddenNames = [self hiddenNamesInDirectory:dirPath fd:fd];
   itemFormat = ([dirPath isEqualToString:@"/"] == NO) ? @"%@/%@" : @"%@%@";
-  
-  for (NSString *item in dirContents) {
-    if ([self isCancelled]) {
-      break;
-    }
-    itemPath = [NSString stringWithFormat:itemFormat, dirPath, item];
-    [fm fileExistsAtPath:itemPath isDirectory:&isDir];
-    attrs = [fm fileAttributesAtPath:itemPath traverseLink:NO];
 
-    if ([[attrs fileType] isEqualToString:NSFileTypeSymbolicLink] == NO) {
-      if ([[attrs fileType] isEqualToString:NSFileTypeDirectory] != NO) {
-        [self findInDirectory:itemPath];
+  while (isStopped == NO &&
+         (count = syscall(SYS_getdents64, fd, buffer, FIND_DENTS_BUFFER)) > 0) {
+    for (offset = 0; offset < count && isStopped == NO;
+         offset += entry->d_reclen) {
+      entry = (struct linux_dirent64 *)(buffer + offset);
+      if (entry->d_name[0] == '.' &&
+          (isShowHidden == NO || entry->d_name[1] == '\0' ||
+           (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+        continue;
+      }
+
+      type = entry->d_type;
+      if (type == DT_UNKNOWN) {
+        if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+          continue;
+        }
+        type = IFTODT(st.st_mode);
+      }
+      if (type == DT_LNK) {
+        continue;
+      }
+
+      item = [fm stringWithFileSystemRepresentation:entry->d_name
+                                             length:strlen(entry->d_name)];
+      if (item == nil ||
+          (hiddenNames != nil && [hiddenNames containsObject:item])) {
+        continue;
       }
-      else if (isContentSearch != NO) {
+      itemPath = nil;
+
+      if (type == DT_DIR) {
+        itemPath = [NSString stringWithFormat:itemFormat, dirPath, item];
+        [self pushDirectory:itemPath toStack:index];
+      }
+      else if (isContentSearch != NO && type == DT_REG) {
+        itemPath = [NSString stringWithFormat:itemFormat, dirPath, item];
         if ([self isFileMatched:itemPath]) {
-          [finder performSelectorOnMainThread:@selector(addResult:)
-                                   withObject:itemPath
-                                waitUntilDone:NO];
+          [found addObject:itemPath];
         }
       }
       if (isContentSearch == NO && [self isTextMatched:item]) {
-        [finder performSelectorOnMainThread:@selector(addResult:)
-                                 withObject:itemPath
-                              waitUntilDone:NO];
+        if (itemPath == nil) {
+          itemPath = [NSString stringWithFormat:itemFormat, dirPath, item];
+        }
+        [found addObject:itemPath];
+      }
+    }
+  }
+  close(fd);
+
+  if ([found count] > 0) {
+    [condition lock];
+    [results addObjectsFromArray:found];
+    [condition unlock];
+  }
+}
+
+- (void)findWithStack:(NSNumber *)stackIndex
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NSUInteger        index = [stackIndex unsignedIntegerValue];
+  char              *buffer = malloc(FIND_DENTS_BUFFER);
+  NSString          *dirPath;
+
+  while (1) {
+    if ((dirPath = [self popDirectoryFromStack:index]) != nil) {
+      NSAutoreleasePool *dirPool = [NSAutoreleasePool new];
+
+      if (isStopped == NO) {
+        [self findInDirectory:dirPath stack:index buffer:buffer];
+      }
+      [dirPath release];
+      [dirPool release];
+
+      [condition lock];
+      if (--pendingDirs == 0) {
+        [condition broadcast];
       }
+      [condition unlock];
+      continue;
+    }
+
+    // Nothing to read: wait for other threads to push directories
+    [condition lock];
+    if (pendingDirs == 0) {
+      [condition unlock];
+      break;
     }
+    [condition waitUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.002]];
+    [condition unlock];
+  }
+
+  free(buffer);
+  [pool release];
+
+  [condition lock];
+  runningThreads--;
+  [condition broadcast];
+  [condition unlock];
+}
+
+// Sends results found since last call to Finder. Called with `condition`
+// locked. Results of stopped search are dropped: Finder may already be
+// showing results of the next search.
+- (void)sendResults
+{
+  NSArray *batch;
+
+  if (isStopped != NO) {
+    [results removeAllObjects];
+    return;
+  }
+  if ([results count] == 0) {
+    return;
   }
+  batch = [results copy];
+  [results removeAllObjects];
+  [finder performSelectorOnMainThread:@selector(addResults:)
+                           withObject:batch
+                        waitUntilDone:NO];
+  [batch release];
 }
 
 - (void)main
 {
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NSUInteger        i;
+
   NSLog(@"[Finder] will search contents: %@", isContentSearch ? @"Yes" : @"No");
-  
+
+  condition = [NSCondition new];
+  results = [NSMutableArray new];
+  threadCount = MIN(MAX([[NSProcessInfo processInfo] activeProcessorCount], 4),
+                    FIND_MAX_THREADS);
+  for (i = 0; i < threadCount; i++) {
+    stacks[i].lock = [NSLock new];
+    stacks[i].paths = [NSMutableArray new];
+  }
+
   for (NSString *path in searchPaths) {
-    [self findInDirectory:path];
-  }  
+    [self pushDirectory:path toStack:0];
+  }
+  runningThreads = threadCount;
+  for (i = 0; i < threadCount; i++) {
+    [NSThread detachNewThreadSelector:@selector(findWithStack:)
+                             toTarget:self
+                           withObject:[NSNumber numberWithUnsignedInteger:i]];
+  }
+
+  // Results are sent in batches at most every FIND_RESULTS_INTERVAL
+  [condition lock];
+  while (runningThreads > 0) {
+    [condition waitUntilDate:[NSDate dateWithTimeIntervalSinceNow:
+                                       FIND_RESULTS_INTERVAL]];
+    if (isStopped == NO && [self isCancelled]) {
+      isStopped = YES;
+    }
+    [self sendResults];
+  }
+  if ([self isCancelled]) {
+    isStopped = YES;
+  }
+  [self sendResults];
+  [condition unlock];
+
+  for (i = 0; i < threadCount; i++) {
+    [stacks[i].lock release];
+    [stacks[i].paths release];
+  }
+  [results release];
+  [condition release];
+  [pool release];
 }
 
 - (BOOL)isReady
@@ -257,7 +502,7 @@
                        context:(void *)context
 {
   NSLog(@"Finder operation was finished.");
-  [self performSelectorOnMainThread:@selector(finishFind)
+  [self performSelectorOnMainThread:@selector(finishSearch)
                          withObject:nil
                       waitUntilDone:YES];
 }
@@ -459,28 +704,56 @@
   }
 }
 
-- (void)addResult:(NSString *)resultString
+// Called by FindWorker with results found since the previous call.
+// Threads find results in no particular order: results are appended while
+// search runs and sorted by -finishSearch.
+- (void)addResults:(NSArray *)results
 {
-  [variantList addObject:resultString];
+  NSMatrix      *matrix;
+  NSBrowserCell *cell;
+  BOOL          isFirst = ([variantList count] == 0);
+
+  [variantList addObjectsFromArray:results];
   [resultsFound setStringValue:[NSString stringWithFormat:@"%lu found",
                                          [variantList count]]];
-  if ([variantList count] == 1) {
+  if (isFirst) {
     [resultList reloadColumn:0];
   }
   else {
-    NSBrowserCell *cell;
-    NSMatrix      *matrix = [resultList matrixInColumn:0];
-    
-    [matrix addRow];
-    cell = [matrix cellAtRow:[matrix numberOfRows] - 1 column:0];
-    [cell setLeaf:YES];
-    [cell setRefusesFirstResponder:YES];
-    [cell setTitle:resultString];
-    [cell setLoaded:YES];
+    matrix = [resultList matrixInColumn:0];
+    for (NSString *resultString in results) {
+      [matrix addRow];
+      cell = [matrix cellAtRow:[matrix numberOfRows] - 1 column:0];
+      [cell setLeaf:YES];
+      [cell setRefusesFirstResponder:YES];
+      [cell setTitle:resultString];
+      [cell setLoaded:YES];
+    }
     [resultList displayColumn:0];
   }
 }
 
+// Called when FindWorker is finished or stopped. Sorts results by path
+// keeping the selected one selected, so the list is the same between runs.
+- (void)finishSearch
+{
+  NSString *selected = nil;
+
+  if ([variantList count] > 1) {
+    if (resultIndex >= 0 && resultIndex < [variantList count]) {
+      selected = [[variantList objectAtIndex:resultIndex] retain];
+    }
+    [variantList sortUsingSelector:@selector(localizedCompare:)];
+    [resultList reloadColumn:0];
+    if (selected != nil) {
+      resultIndex = [variantList indexOfObject:selected];
+      [resultList selectRow:resultIndex inColumn:0];
+      [selected release];
+    }
+  }
+  [self finishFind];
+}
+
 - (void)finishFind
 {
   [findButton setImagePosition:NSImageAbove];
@@ -148,6 +148,15 @@
     }
 }
 
+// Sizer:BGOperation notification selector. Shows size found so far.
+- (void)_updateSizeOfSelection:(NSNotification *)notif
+{
+  unsigned long long size;
+
+  size = [[[notif userInfo] objectForKey:@"Size"] unsignedLongLongValue];
+  [fileSizeField setStringValue:[self _stringFromSize:size]];
+}
+
 // Sizer:BGOperation notification selector.
 - (void)_showSizeOfSelection:(NSNotification *)notif
 {
@@ -158,6 +167,10 @@
     removeObserver:self
               name:WMSizerGotNumbersNotification
             object:[notif object]];
+  [[NSNotificationCenter defaultCenter]
+    removeObserver:self
+              name:WMSizerUpdatedNumbersNotification
+            object:[notif object]];
 
   [[notif object] release];
   
@@ -463,6 +476,11 @@ static id attributesInspector = nil;
        selector:@selector(_showSizeOfSelection:)
            name:WMSizerGotNumbersNotification
          object:sizer];
+  [[NSNotificationCenter defaultCenter]
+    addObserver:self
+       selector:@selector(_updateSizeOfSelection:)
+           name:WMSizerUpdatedNumbersNotification
+         object:sizer];
 }
 
 - (void)changePerms:sender
@@ -39,8 +39,8 @@
   NSPipe   *readPipe;
   NSPipe   *writePipe;
   
-  NSLock   *inputLock;
-  NSString *truncatedLine;
+  NSMutableData *inputBuffer;   // unprocessed frames
+  BOOL          isReadingInput;
 }
 
 - (void)startSizer;
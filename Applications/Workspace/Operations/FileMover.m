@@ -22,6 +22,7 @@
 #import <DesktopKit/NXTDefaults.h>
 
 #import "Operations/FileMover.h"
+#import "Tools/OperationProtocol.h"
 #import "Processes/FileMoverUI.h"
 
 static inline void ReportGarbage(NSString *garbage)
@@ -397,8 +398,6 @@ static inline void ReportGarbage(NSString *garbage)
   totalBatchSize = 0;
   isSizing = NO;
 
-  inputLock = [NSLock new];
-
   [self startSizer];
 
   [self setState:OperationRunning];
@@ -450,6 +449,8 @@ static inline void ReportGarbage(NSString *garbage)
   ASSIGN(currSourceDir, source);
   ASSIGN(currTargetDir, target);
   ASSIGN(currFile, [files objectAtIndex:0]);
+  // Drop incomplete frame left by Sizer
+  [inputBuffer setLength:0];
   
   fileMoverTask = [NSTask new];
   [fileMoverTask setLaunchPath:fileMoverPath];
@@ -506,6 +507,7 @@ static inline void ReportGarbage(NSString *garbage)
 
   TEST_RELEASE(problemDesc);
   TEST_RELEASE(solutions);
+  TEST_RELEASE(inputBuffer);
 
   [super dealloc];
 }
@@ -581,26 +583,124 @@ static inline void ReportGarbage(NSString *garbage)
 //
 //--- NSTask management ------------------------------------------------------
 //
-- (void)readInput:(NSNotification *)notif
+// Applies a frame of FileMover or Sizer tool (see Tools/OperationProtocol.h).
+// Returns YES if process view should be updated.
+- (BOOL)processFrame:(char)type
+             payload:(const char *)payload
+              length:(uint32_t)length
 {
-  NSTask         *task = (isSizing ? sizerTask : fileMoverTask);
-  NSString       *input;
-  NSMutableArray *lines;
-  NSEnumerator   *e;
-  NSString       *line;
-  NSData         *data = nil;
-
-  //NSLog(@"==== [FileOperation readInput]");
+  uint32_t   offset = 0;
+  const char *strings[4];
+  uint64_t   numbers[2];
 
-  // === LOCK
-  while (inputLock && [inputLock tryLock] == NO)
+  switch (type)
     {
-      NSDebugLLog(@"FileMover",
-                  @"[FileMover readInput] LOCK FAILED! Waiting...");
-      [[NSRunLoop currentRunLoop] 
-        runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+    case '0':
+    case '1':
+      if ((strings[0] = OPFrameString(payload, length, &offset)) == NULL)
+        {
+          NSDebugLLog(@"FileMover", @"%c: not enought args", type);
+          return NO;
+        }
+      ASSIGN(message, [NSString stringWithUTF8String:strings[0]]);
+      ASSIGN(currFile, @"");
+      ASSIGN(currSourceDir, @"");
+      ASSIGN(currTargetDir, @"");
+      numberOfFilesDone = 0.0;
+      doneBatchSize = 0.0;
+      return YES;
+      // F <message> <currFile> <source dir> <target dir>
+    case 'F':
+      for (int i = 0; i < 4; i++)
+        {
+          if ((strings[i] = OPFrameString(payload, length, &offset)) == NULL)
+            {
+              NSDebugLLog(@"FileMover", @"F: not enought args");
+              return NO;
+            }
+        }
+      ASSIGN(message, [NSString stringWithUTF8String:strings[0]]);
+      ASSIGN(currFile, [NSString stringWithUTF8String:strings[1]]);
+      ASSIGN(currSourceDir, [NSString stringWithUTF8String:strings[2]]);
+      ASSIGN(currTargetDir, [NSString stringWithUTF8String:strings[3]]);
+      return YES;
+      // P <files> <bytes>
+    case 'P':
+      if (!OPFrameNumber(payload, length, &offset, &numbers[0]) ||
+          !OPFrameNumber(payload, length, &offset, &numbers[1]))
+        {
+          NSDebugLLog(@"FileMover", @"P: not enought args");
+          return NO;
+        }
+      if (numberOfFiles > 0)
+        {
+          numberOfFilesDone += numbers[0];
+        }
+      doneBatchSize += numbers[1];
+      return YES;
+      // Q <files> <bytes> <increment>
+    case 'Q':
+      if (!OPFrameNumber(payload, length, &offset, &numbers[0]) ||
+          !OPFrameNumber(payload, length, &offset, &numbers[1]) ||
+          offset >= length)
+        {
+          NSDebugLLog(@"FileMover", @"Q: not enought args");
+          return NO;
+        }
+      if (payload[offset] == 1)
+        {
+          numberOfFiles += numbers[0];
+          totalBatchSize += numbers[1];
+        }
+      else
+        {
+          numberOfFiles = numbers[0];
+          totalBatchSize = numbers[1];
+        }
+      return NO;
+    case 'R':
+      [self reportReadError];
+      break;
+    case 'W':
+      [self reportWriteError];
+      break;
+    case 'M':
+      [self reportMoveError];
+      break;
+    case 'S':
+      [self reportSymlink];
+      break;
+    case 'D':
+      [self reportDeleteError];
+      break;
+    case 'A':
+      [self reportAttributesUnchangeable];
+      break;
+    case 'E':
+      [self reportFileExists];
+      break;
+    case 'U':
+      [self reportUnknownFile];
+      break;
+    case 'T':
+      [self reportSymlinkTargetNotExist];
+      break;
+    default:
+      ReportGarbage([NSString stringWithFormat:@"frame type %d", type]);
+      break;
     }
-  // ===
+
+  return NO;
+}
+
+- (void)readInput:(NSNotification *)notif
+{
+  NSTask     *task = (isSizing ? sizerTask : fileMoverTask);
+  NSData     *data = nil;
+  NSUInteger offset = 0;
+  char       type;
+  uint32_t   length;
+  BOOL       needsUpdate = NO;
 
   NS_DURING
     {
@@ -618,242 +718,48 @@ static inline void ReportGarbage(NSString *garbage)
   NS_HANDLER
     {
       NSDebugLLog(@"FileMover", @"==== [FileMover readInput] EXCEPTION");
-      [inputLock unlock];
       return;
     }
   NS_ENDHANDLER
 
-  // NSUTF8StringEncoding is important in case of non ASCII file names
-  input = [[[NSString alloc] initWithData:data
-                                 encoding:NSUTF8StringEncoding] autorelease];
-  
-  if (input == nil)
+  if (inputBuffer == nil)
     {
-      NSDebugLLog(@"FileMover", @"==== [FileMover readInput] NIL");
-      [inputLock unlock];
-      [[readPipe fileHandleForReading] waitForDataInBackgroundAndNotify];
-      return;
-    }
-
-  //  lines = [input componentsSeparatedByString:@"\n"];
-  lines = [NSMutableArray 
-            arrayWithArray:[input componentsSeparatedByString:@"\n"]];
-
-  // Assemble remembered truncated line with newly received 
-  // input's first line
-  if (truncatedLine != nil && [truncatedLine length] > 0)
-    {
-      truncatedLine = 
-        [truncatedLine stringByAppendingString:[lines objectAtIndex:0]];
-      [lines replaceObjectAtIndex:0 withObject:[truncatedLine copy]];
-      //NSLog(@"LINE ASSEMBLED: %@", truncatedLine);
-      ASSIGN(truncatedLine, @"");
-    }
-
-  // Check if input is truncated. It means that last line is not fully 
-  // transmitted from FileOperation tool.
-  if (input != nil && 
-      [input length] > 1 &&
-      [input characterAtIndex:[input length]-1] != '\n')
-    {
-      ASSIGN(truncatedLine, [lines objectAtIndex:[lines count]-1]);
-      //NSLog(@"GOT TRUNCATED LINE: %@", truncatedLine);
+      inputBuffer = [NSMutableData new];
     }
+  [inputBuffer appendData:data];
 
-  // NSLog(@"%@", input);
-
-  e = [lines objectEnumerator];
-  while ((line = [e nextObject]) != nil)
+  // Called while processing frames (e.g. from an alert): frames will be
+  // processed by the outer call.
+  if (isReadingInput == NO)
     {
-      NSArray *args = nil;
-      char    msgType = ' ';
-
-      // skip over empty lines
-      if ([line length] < 1)
-        { 
-          //NSLog(@"skipping empty line");
-          //ReportGarbage(line);
-          continue;
-        }
-
-      args = [line componentsSeparatedByString:@"\t"];
-      msgType = [[args objectAtIndex:0] characterAtIndex:0];
-      //NSLog(@"ARGS: %@", args);
-
-      switch (msgType) 
+      isReadingInput = YES;
+      // Incomplete frame at the end is kept for the next read
+      while ([inputBuffer length] - offset >= OP_HEADER_SIZE)
         {
-        case '0':
-          if ([args count] < 2)
+          const char *bytes = (const char *)[inputBuffer bytes] + offset;
+
+          OPFrameGetHeader(bytes, &type, &length);
+          if ([inputBuffer length] - offset - OP_HEADER_SIZE < length)
             {
-              NSDebugLLog(@"FileMover", @"0: not enought args: %@", args);
-              continue;
+              break;
             }
-          ASSIGN(message, [args objectAtIndex:1]);
-          ASSIGN(currFile, @"");
-          ASSIGN(currSourceDir, @"");
-          ASSIGN(currTargetDir, @"");
-          numberOfFilesDone = 0.0;          
-          doneBatchSize = 0.0;
-          
-          [self updateProcessView:NO];
-          break;
-        case '1':
-          if ([args count] < 2)
+          if ([self processFrame:type
+                         payload:bytes + OP_HEADER_SIZE
+                          length:length])
             {
-              NSDebugLLog(@"FileMover", @"0: not enought args: %@", args);
-              continue;
+              needsUpdate = YES;
             }
-          ASSIGN(message, [args objectAtIndex:1]);
-          ASSIGN(currFile, @"");
-          ASSIGN(currSourceDir, @"");
-          ASSIGN(currTargetDir, @"");
-          numberOfFilesDone = 0.0;          
-          doneBatchSize = 0.0;
-          
+          offset += OP_HEADER_SIZE + length;
+        }
+      [inputBuffer replaceBytesInRange:NSMakeRange(0, offset)
+                             withBytes:NULL
+                                length:0];
+      isReadingInput = NO;
+
+      // Tools send progress a few times per second: one update per read
+      if (needsUpdate)
+        {
           [self updateProcessView:NO];
-          break;
-          // F\t<message>\t<currFile>\t<source dir>\t<target dir>
-        case 'F':
-          {
-            // NSLog(@"%@", input);
-            if ([args count] < 5)
-              {
-                NSDebugLLog(@"FileMover", @"F: not enought args: %@", args);
-                continue;
-              }
-            ASSIGN(message, [args objectAtIndex:1]);
-            ASSIGN(currFile, [args objectAtIndex:2]);
-            ASSIGN(currSourceDir, [args objectAtIndex:3]);
-            ASSIGN(currTargetDir, [args objectAtIndex:4]);
-
-            if (numberOfFiles > 0)
-              {
-                numberOfFilesDone++;
-                //NSLog(@"numberOfFilesDone: %llu (%llu)", 
-                //      numberOfFilesDone, numberOfFiles);
-              }
-            if (!isSizing && [currFile isEqualToString:@""])
-              {
-                [self setState:OperationCompleted];
-              }
-            [self updateProcessView:NO];
-          }
-          break;
-        case 'B':
-          {
-            unsigned long long advance;
-            NSString *arg;
-
-            if ([args count] < 2)
-              {
-                NSDebugLLog(@"FileMover", @"B: not enought args: %@", args);
-                continue;
-              }
-
-            arg = [args objectAtIndex:1];
-            if (sscanf([arg cString], "%llu", &advance) != 1) 
-              {
-                ReportGarbage(line);
-                break;
-              }
-            doneBatchSize += advance;
-
-            // NSLog(@"doneBatchSize: %llu (%llu)",
-            //       doneBatchSize, totalBatchSize);
-            [self updateProcessView:NO];
-          }
-          break;
-        case 'Q':
-          // Catch and update file count and batch size.
-          // Number of files: "Q\tF\t%u\t+"   <----(Queued Files)
-          //      Batch size: "Q\tS\t%llu\t+" <----(Queued Size)
-          // If field #4 contains '+' it is an update to the totals.
-          {
-            char     qType = ' ';
-            BOOL     isIncrement = NO;
-            NSString *digits;
-            unsigned long long files_count;
-            unsigned long long batch_size;
- 
-            if ([args count] < 3)
-              continue;
-
-            qType = [[args objectAtIndex:1] characterAtIndex:0];
-            digits = [args objectAtIndex:2];
-            if ([args count] > 3 &&
-                [[args objectAtIndex:3] characterAtIndex:0] == '+')
-              {
-                isIncrement = YES;
-              }
-
-            if (qType == 'F') // Queued file count
-              {
-                if (sscanf([digits cString], "%llu", &files_count) != 1)
-                  {
-                    ReportGarbage(line);
-                    continue;
-                  }
-                
-                if (isIncrement)
-                  {
-                    numberOfFiles += files_count;
-                  }
-                else
-                  {
-                    numberOfFiles = files_count;
-                  }
-                continue;
-              }
-            else if (qType == 'S') // Queued batch file size
-              {
-                if (sscanf([digits cString], "%llu", &batch_size) != 1)
-                  {
-                    ReportGarbage(line);
-                    continue;
-                  }
-                
-                if (isIncrement)
-                  {
-                    totalBatchSize += batch_size;
-                  }
-                else
-                  {
-                    totalBatchSize = batch_size;
-                  }
-                continue;
-              }
-          }
-          break;
-        case 'R':
-          [self reportReadError];
-          break;
-        case 'W':
-          [self reportWriteError];
-          break;
-        case 'M':
-          [self reportMoveError];
-          break;
-        case 'S':
-          [self reportSymlink];
-          break;
-        case 'D':
-          [self reportDeleteError];
-          break;
-        case 'A':
-          [self reportAttributesUnchangeable];
-          break;
-        case 'E':
-          [self reportFileExists];
-          break;
-        case 'U':
-          [self reportUnknownFile];
-          break;
-        case 'T':
-          [self reportSymlinkTargetNotExist];
-          break;
-        default:
-          ReportGarbage(line);
-          break;
         }
     }
 
@@ -861,11 +767,6 @@ static inline void ReportGarbage(NSString *garbage)
     {
       [[readPipe fileHandleForReading] waitForDataInBackgroundAndNotify];
     }
-
-  //NSLog(@"==== [FileOperation readInput] END");
-
-  // === UNLOCK
-  [inputLock unlock];
 }
 
 - (void)destroyOperation
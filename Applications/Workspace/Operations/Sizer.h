@@ -28,6 +28,8 @@
 #import "Operations/BGOperation.h"
 
 extern NSString *WMSizerGotNumbersNotification;
+// Posted while Sizer.tool walks directories, with the totals found so far.
+extern NSString *WMSizerUpdatedNumbersNotification;
 
 @interface Sizer : BGOperation
 {
@@ -39,8 +41,8 @@ extern NSString *WMSizerGotNumbersNotification;
   NSTask   *task;
   NSPipe   *readPipe;
   NSPipe   *writePipe;
-  NSLock   *inputLock;
-  NSString *truncatedLine;
+  NSMutableData *inputBuffer;   // unprocessed frames
+  BOOL          isReadingInput;
 }
 
 @end
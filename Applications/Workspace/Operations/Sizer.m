@@ -22,9 +22,11 @@
 #import <DesktopKit/NXTDefaults.h>
 
 #import "Operations/Sizer.h"
+#import "Tools/OperationProtocol.h"
 #import "Processes/BGProcess.h"
 
 NSString *WMSizerGotNumbersNotification = @"WMSizerGotNumbersNotification";
+NSString *WMSizerUpdatedNumbersNotification = @"WMSizerUpdatedNumbersNotification";
 
 static inline void ReportGarbage(NSString *garbage)
 {
@@ -56,8 +58,6 @@ static inline void ReportGarbage(NSString *garbage)
   numberOfFiles = 0;
   totalBatchSize = 0;
 
-  inputLock = [NSLock new];
-
   // Create task for tool
   task = [NSTask new];
   [task setLaunchPath:
@@ -97,6 +97,7 @@ static inline void ReportGarbage(NSString *garbage)
   NSDebugLLog(@"Sizer", @"Sizer: dealloc");
 
   [[NSNotificationCenter defaultCenter] removeObserver:self];
+  TEST_RELEASE(inputBuffer);
 
   [super dealloc];
 }
@@ -134,6 +135,18 @@ static inline void ReportGarbage(NSString *garbage)
   [self setState:OperationStopped];
 }
 
+- (NSDictionary *)numbersInfo
+{
+  NSNumber *fCount, *bSize;
+
+  fCount = [NSNumber numberWithUnsignedLongLong:numberOfFiles];
+  bSize = [NSNumber numberWithUnsignedLongLong:totalBatchSize];
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                         fCount, @"FileCount",
+                       bSize, @"Size", nil];
+}
+
 - (void)reportNumbers
 {
   if (state == OperationStopped)
@@ -145,43 +158,111 @@ static inline void ReportGarbage(NSString *garbage)
     }
   else
     {
-      NSNumber     *fCount, *bSize;
-      NSDictionary *uInfo;
-      
-      fCount = [NSNumber numberWithUnsignedLongLong:numberOfFiles];
-      bSize = [NSNumber numberWithUnsignedLongLong:totalBatchSize];
-      uInfo = [NSDictionary dictionaryWithObjectsAndKeys:
-                              fCount, @"FileCount",
-                            bSize, @"Size", nil];
-      
       [[NSNotificationCenter defaultCenter]
                       postNotificationName:WMSizerGotNumbersNotification
                                     object:self
-                                  userInfo:uInfo];
+                                  userInfo:[self numbersInfo]];
     }
 }
 
 //
 //--- NSTask management ------------------------------------------------------
 //
-- (void)readInput:(NSNotification *)notif
+// Applies a frame of Sizer tool (see Tools/OperationProtocol.h)
+- (void)processFrame:(char)type
+             payload:(const char *)payload
+              length:(uint32_t)length
 {
-  NSString       *input;
-  NSMutableArray *lines;
-  NSEnumerator   *e;
-  NSString       *line;
-  NSData         *data = nil;
+  uint32_t   offset = 0;
+  const char *strings[3];
+  uint64_t   numbers[2];
 
-  //NSLog(@"==== [FileOperation readInput]");
-
-  // === LOCK
-  while (inputLock && [inputLock tryLock] == NO)
+  switch (type)
     {
-      NSDebugLLog(@"Sizer",@"[Sizer readInput] LOCK FAILED! Waiting...");
-      [[NSRunLoop currentRunLoop] 
-        runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+    case '0':
+    case '1':
+      if ((strings[0] = OPFrameString(payload, length, &offset)) == NULL)
+        {
+          NSDebugLLog(@"Sizer", @"%c: not enought args", type);
+          return;
+        }
+      [self setState:(type == '0') ? OperationCompleted : OperationStopped];
+      if (processUI)
+        {
+          [processUI
+            updateWithMessage:[NSString stringWithUTF8String:strings[0]]
+                         file:@""
+                       source:@""
+                       target:@""
+                     progress:0.0];
+        }
+      break;
+      // F <message> <currFile> <source dir> <target dir>
+    case 'F':
+      for (int i = 0; i < 3; i++)
+        {
+          if ((strings[i] = OPFrameString(payload, length, &offset)) == NULL)
+            {
+              NSDebugLLog(@"Sizer", @"F: not enought args");
+              return;
+            }
+        }
+      ASSIGN(message, [NSString stringWithUTF8String:strings[0]]);
+      ASSIGN(currFile, [NSString stringWithUTF8String:strings[1]]);
+      ASSIGN(currSourceDir, [NSString stringWithUTF8String:strings[2]]);
+
+      if (processUI)
+        {
+          [processUI updateWithMessage:message
+                                  file:currFile
+                                source:currSourceDir
+                                target:nil
+                              progress:0.0];
+        }
+      break;
+    case 'P':
+      // Sizer reports no progress
+      break;
+      // Q <files> <bytes> <increment>
+    case 'Q':
+      if (!OPFrameNumber(payload, length, &offset, &numbers[0]) ||
+          !OPFrameNumber(payload, length, &offset, &numbers[1]) ||
+          offset >= length)
+        {
+          NSDebugLLog(@"Sizer", @"Q: not enought args");
+          return;
+        }
+      if (payload[offset] == 1)
+        {
+          numberOfFiles += numbers[0];
+          totalBatchSize += numbers[1];
+          [[NSNotificationCenter defaultCenter]
+                      postNotificationName:WMSizerUpdatedNumbersNotification
+                                    object:self
+                                  userInfo:[self numbersInfo]];
+        }
+      else
+        {
+          numberOfFiles = numbers[0];
+          totalBatchSize = numbers[1];
+          if (numberOfFiles > 0)
+            {
+              [self reportNumbers];
+            }
+        }
+      break;
+    default:
+      ReportGarbage([NSString stringWithFormat:@"frame type %d", type]);
+      break;
     }
-  // ===
+}
+
+- (void)readInput:(NSNotification *)notif
+{
+  NSData     *data = nil;
+  NSUInteger offset = 0;
+  char       type;
+  uint32_t   length;
 
   NS_DURING
     {
@@ -199,207 +280,44 @@ static inline void ReportGarbage(NSString *garbage)
   NS_HANDLER
     {
       NSDebugLLog(@"Sizer", @"==== [Sizer readInput] EXCEPTION");
-      [inputLock unlock];
       return;
     }
   NS_ENDHANDLER
 
-  // NSUTF8StringEncoding is important in case of non ASCII file names
-  input = [[[NSString alloc] initWithData:data
-                                 encoding:NSUTF8StringEncoding] autorelease];
-  
-  if (input == nil)
-    {
-      NSDebugLLog(@"Sizer", @"==== [Sizer readInput] NIL");
-      // [inputLock unlock];
-      // [[readPipe fileHandleForReading] waitForDataInBackgroundAndNotify];
-      return;
-    }
-
-  lines = [NSMutableArray 
-            arrayWithArray:[input componentsSeparatedByString:@"\n"]];
-
-  // Assemble remembered truncated line with newly received 
-  // input's first line
-  if (truncatedLine != nil && [truncatedLine length] > 0)
-    {
-      truncatedLine = 
-        [truncatedLine stringByAppendingString:[lines objectAtIndex:0]];
-      [lines replaceObjectAtIndex:0 withObject:[truncatedLine copy]];
-      //NSLog(@"LINE ASSEMBLED: %@", truncatedLine);
-      ASSIGN(truncatedLine, @"");
-    }
-
-  // Check if input is truncated. It means that last line is not fully 
-  // transmitted from FileOperation tool.
-  if (input != nil && 
-      [input length] > 1 &&
-      [input characterAtIndex:[input length]-1] != '\n')
+  if (inputBuffer == nil)
     {
-      ASSIGN(truncatedLine, [lines objectAtIndex:[lines count]-1]);
-      //NSLog(@"GOT TRUNCATED LINE: %@", truncatedLine);
+      inputBuffer = [NSMutableData new];
     }
+  [inputBuffer appendData:data];
 
-  // NSLog(@"%@", input);
-
-  e = [lines objectEnumerator];
-  while ((line = [e nextObject]) != nil)
+  // Called while processing frames: frames will be processed by the outer
+  // call.
+  if (isReadingInput == NO)
     {
-      NSArray *args = nil;
-      char    msgType = ' ';
-
-      // skip over empty lines
-      if ([line length] < 1)
-        { 
-          //NSLog(@"skipping empty line");
-          //ReportGarbage(line);
-          continue;
-        }
-
-      args = [line componentsSeparatedByString:@"\t"];
-      msgType = [[args objectAtIndex:0] characterAtIndex:0];
-      //NSLog(@"ARGS: %@", args);
-
-      switch (msgType) 
+      isReadingInput = YES;
+      // Incomplete frame at the end is kept for the next read
+      while ([inputBuffer length] - offset >= OP_HEADER_SIZE)
         {
-        case '0':
-          if ([args count] < 2)
-            {
-              NSDebugLLog(@"Sizer", @"0: not enought args: %@", args);
-              continue;
-            }
-          [self setState:OperationCompleted];
-          if (processUI)
-            {
-              [processUI updateWithMessage:[args objectAtIndex:1]
-                                      file:@""
-                                    source:@""
-                                    target:@""
-                                  progress:0.0];
-            }
-          break;
-        case '1':
-          if ([args count] < 2)
-            {
-              NSDebugLLog(@"Sizer", @"0: not enought args: %@", args);
-              continue;
-            }
-          [self setState:OperationStopped];
-          if (processUI)
+          const char *bytes = (const char *)[inputBuffer bytes] + offset;
+
+          OPFrameGetHeader(bytes, &type, &length);
+          if ([inputBuffer length] - offset - OP_HEADER_SIZE < length)
             {
-              [processUI updateWithMessage:[args objectAtIndex:1]
-                                      file:@""
-                                    source:@""
-                                    target:@""
-                                  progress:0.0];
+              break;
             }
-          break;
-          // F\t<message>\t<currFile>\t<source dir>
-        case 'F':
-          {
-            if ([args count] < 4)
-              {
-                NSDebugLLog(@"Sizer", @"F: not enought args: %@", args);
-                continue;
-              }
-            ASSIGN(message, [args objectAtIndex:1]);
-            ASSIGN(currFile, [args objectAtIndex:2]);
-            ASSIGN(currSourceDir, [args objectAtIndex:3]);
-
-            if (processUI)
-              {
-                [processUI updateWithMessage:message
-                                        file:currFile
-                                      source:currSourceDir
-                                      target:nil
-                                    progress:0.0];
-              }
-          }
-          break;
-        case 'Q':
-          // Catch and update file count and batch size.
-          // Number of files: "Q\tF\t%u\t+"   <----(Queued Files)
-          //      Batch size: "Q\tS\t%llu\t+" <----(Queued Size)
-          // If field #4 contains '+' it is an update to the totals.
-          {
-            char     qType = ' ';
-            BOOL     isIncrement = NO;
-            NSString *digits;
-            unsigned long long files_count;
-            unsigned long long batch_size;
- 
-            if ([args count] < 3)
-              continue;
-
-            qType = [[args objectAtIndex:1] characterAtIndex:0];
-            digits = [args objectAtIndex:2];
-            if ([args count] > 3 &&
-                [[args objectAtIndex:3] characterAtIndex:0] == '+')
-              {
-                isIncrement = YES;
-              }
-
-            if (qType == 'F') // Queued file count
-              {
-                if (sscanf([digits cString], "%llu", &files_count) != 1)
-                  {
-                    ReportGarbage(line);
-                    continue;
-                  }
-                
-                if (isIncrement)
-                  {
-                    numberOfFiles += files_count;
-                  }
-                else
-                  {
-                    numberOfFiles = files_count;
-                    if (totalBatchSize > 0)
-                      {
-                        [self reportNumbers];
-                      }
-                  }
-                continue;
-              }
-            else if (qType == 'S') // Queued batch file size
-              {
-                if (sscanf([digits cString], "%llu", &batch_size) != 1)
-                  {
-                    ReportGarbage(line);
-                    continue;
-                  }
-                
-                if (isIncrement)
-                  {
-                    totalBatchSize += batch_size;
-                  }
-                else
-                  {
-                    totalBatchSize = batch_size;
-                    if (numberOfFiles > 0)
-                      {
-                        [self reportNumbers];
-                      }
-                  }
-                continue;
-              }
-          }
-          break;
-        default:
-          ReportGarbage(line);
-          break;
+          [self processFrame:type payload:bytes + OP_HEADER_SIZE length:length];
+          offset += OP_HEADER_SIZE + length;
         }
+      [inputBuffer replaceBytesInRange:NSMakeRange(0, offset)
+                             withBytes:NULL
+                                length:0];
+      isReadingInput = NO;
     }
 
   if (task != nil && [task isRunning])
     {
       [[readPipe fileHandleForReading] waitForDataInBackgroundAndNotify];
     }
-
-  //NSLog(@"==== [Sizer readInput] END");
-
-  // === UNLOCK
-  [inputLock unlock];
 }
 
 - (void)destroyOperation
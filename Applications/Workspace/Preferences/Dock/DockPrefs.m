@@ -29,6 +29,7 @@
 #include <core/wuserdefaults.h>
 #include <screen.h>
 #include <dock.h>
+#include <window_attributes.h>
 
 // --- Appicons getters/setters of on-screen Dock
 
@@ -151,6 +152,7 @@ void WMSetDockAppImage(NSString *path, int position, BOOL save)
     CFDictionarySetValue(winAttrs, appKey, appAttrs);
     CFRelease(appKey);
     CFRelease(appAttrs);
+    wDefaultFlushAttributesCache();
     WMUserDefaultsWrite(winAttrs, CFSTR("WMWindowAttributes"));
   }
   
@@ -58,23 +58,18 @@ typedef enum {
   OverwriteFile
 } ProblemSolution;
 
-// Communication messages:
-// "F\t<message>\t<filename>\t<source dir>\t<target dir>"
-// "B\t<size>\n" - file size progress
-// "B\t<file count>\t<size>\n"
-// --- Alerts
-// "R<message>\n" - Read error
-// "W<message>\n" - Wrtite error
-// "D<message>\n" - Delete error
-// "M<message>\n" - Move error
-// "S<message>\n" - Symlink encountered
+// Messages to Workspace are frames described in OperationProtocol.h.
+// Answers to problems are read from stdin:
+//     Ss - Skip
 //     Cc - Copy the orignial 
 //     Nn - New Link
-//     Ss - Skip
-// "T<message>\n" - symlink's Taget doesn't exist
-// "A<message>\n" - Attributes is unchangeable
-// "E<message>\n" - target file already Exists
-// "U<message>\n" - target file type is Unknown
+//     Oo - Overwrite
+//     Ii - Ignore
+//     t  - sTop operation
+
+// Adds bytes to the progress sent with next report. Thread safe, doesn't
+// lock: used by copying threads.
+void CommunicatorAdvanceBytes(unsigned long long bytes);
 
 @interface Communicator : NSObject
 {
@@ -91,11 +86,15 @@ typedef enum {
   OperationType lastOpType;
   
   NSString *sentFilename;
+  NSString *currentMessage;
   NSString *currentFilename;
   NSString *currentSourcePrefix;
   NSString *currentTargetPrefix;
 
-  unsigned long long fileProgress;
+  // Progress is sent at most every OP_REPORT_INTERVAL
+  NSTimeInterval     lastReportTime;
+  BOOL               isFilePending;
+  unsigned long long filesAdvanced;
 }
 
 + (id)shared;
@@ -106,6 +105,15 @@ typedef enum {
                  bytesAdvanced:(unsigned long long)progress
                  operationType:(OperationType)opType;
 
+// Sends pending filename and progress. Unless `force` is YES, does nothing
+// if last report was sent less than OP_REPORT_INTERVAL ago.
+- (void)flushProgress:(BOOL)force;
+
+// Number of files and bytes to process
+- (void)sendTotalFiles:(unsigned long long)fileCount
+                  size:(unsigned long long)batchSize
+             increment:(BOOL)isIncrement;
+
 - (void)finishOperation:(NSString *)opName
                 stopped:(BOOL)isStopped;
   
@@ -21,12 +21,47 @@
 //
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #import "Communicator.h"
+#import "OperationProtocol.h"
 
 BOOL makeCleanupOnStop;
 
+// Bytes processed since last report
+static unsigned long long bytesAdvanced;
+
+void CommunicatorAdvanceBytes(unsigned long long bytes)
+{
+  __atomic_fetch_add(&bytesAdvanced, bytes, __ATOMIC_RELAXED);
+}
+
+static void SendFrame(char type, const void *payload, uint32_t length)
+{
+  char header[OP_HEADER_SIZE];
+
+  OPFrameSetHeader(header, type, length);
+  fwrite(header, 1, OP_HEADER_SIZE, stdout);
+  if (length > 0)
+    {
+      fwrite(payload, 1, length, stdout);
+    }
+}
+
+static void SendStrings(char type, NSArray *strings)
+{
+  NSMutableData *payload = [NSMutableData data];
+  const char    *string;
+
+  for (NSString *s in strings)
+    {
+      string = [s UTF8String];
+      [payload appendBytes:string length:strlen(string) + 1];
+    }
+  SendFrame(type, [payload bytes], [payload length]);
+}
+
 @implementation Communicator
 
 static Communicator *shared = nil;
@@ -77,13 +112,12 @@ static Communicator *shared = nil;
   ASSIGN(currentFilename, ((filename != nil) ? filename : @""));
   ASSIGN(currentSourcePrefix, ((sourcePrefix != nil) ? sourcePrefix : @""));
   ASSIGN(currentTargetPrefix, ((targetPrefix != nil) ? targetPrefix : @""));
-  // currentSourcePrefix = (sourcePrefix != nil) ? sourcePrefix : @"";
-  // currentTargetPrefix = (targetPrefix != nil) ? targetPrefix : @"";
 
-  fileProgress += progress;
+  CommunicatorAdvanceBytes(progress);
 
   // Construct message
-  if (filename != nil && ![filename isEqualToString:@""])
+  if (filename != nil && ![filename isEqualToString:@""] &&
+      (![sentFilename isEqual:currentFilename] || lastOpType != opType))
     {
       switch (opType)
         {
@@ -110,41 +144,87 @@ static Communicator *shared = nil;
           opMessage = @"";
           break;
         }
-      // Send output
-      if (![sentFilename isEqual:currentFilename] || lastOpType != opType)
-        {
-          ASSIGN(sentFilename, currentFilename);
-          lastOpType = opType;
-          // F\t<message>\t<filename>\t<source dir>\t<target dir>
-          printf("F\t%s\t%s\t%s\t%s\n",
-                 [opMessage cString],
-                 [currentFilename cString],
-                 [currentSourcePrefix cString],
-                 [currentTargetPrefix cString]);
-        }
+      ASSIGN(sentFilename, currentFilename);
+      ASSIGN(currentMessage, opMessage);
+      lastOpType = opType;
+      filesAdvanced++;
+      isFilePending = YES;
     }
 
-  if (fileProgress != 0)
+  [self flushProgress:NO];
+}
+
+- (void)flushProgress:(BOOL)force
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  uint64_t       numbers[2];
+
+  if (!force && now - lastReportTime < OP_REPORT_INTERVAL)
     {
-      printf("B\t%llu\n", fileProgress);
-      fileProgress = 0;
+      return;
     }
-  
+  lastReportTime = now;
+
+  // F <message> <filename> <source dir> <target dir>
+  if (isFilePending)
+    {
+      SendStrings('F', [NSArray arrayWithObjects:currentMessage,
+                                currentFilename, currentSourcePrefix,
+                                currentTargetPrefix, nil]);
+      isFilePending = NO;
+    }
+
+  // P <files> <bytes>
+  numbers[0] = filesAdvanced;
+  numbers[1] = __atomic_exchange_n(&bytesAdvanced, 0, __ATOMIC_RELAXED);
+  if (numbers[0] != 0 || numbers[1] != 0)
+    {
+      SendFrame('P', numbers, sizeof(numbers));
+      filesAdvanced = 0;
+    }
+
+  fflush(stdout);
+}
+
+- (void)sendTotalFiles:(unsigned long long)fileCount
+                  size:(unsigned long long)batchSize
+             increment:(BOOL)isIncrement
+{
+  char payload[2 * sizeof(uint64_t) + 1];
+  uint64_t numbers[2] = {fileCount, batchSize};
+
+  [self flushProgress:YES];
+
+  // Q <files> <bytes> <increment>
+  memcpy(payload, numbers, sizeof(numbers));
+  payload[sizeof(numbers)] = isIncrement ? 1 : 0;
+  SendFrame('Q', payload, sizeof(payload));
+  fflush(stdout);
+}
+
+- (void)sendProblem:(char)type
+            message:(NSString *)message
+{
+  [self flushProgress:YES];
+  SendStrings(type, [NSArray arrayWithObject:(message != nil) ? message : @""]);
   fflush(stdout);
 }
 
 - (void)finishOperation:(NSString *)opName
                 stopped:(BOOL)isStopped
 {
+  NSString *message;
+
+  [self flushProgress:YES];
   if (isStopped)
     {
-      printf("1\t%s\n",
-             [[NSString stringWithFormat:@"%@ Operation Stopped", opName] cString]);
+      message = [NSString stringWithFormat:@"%@ Operation Stopped", opName];
+      SendStrings('1', [NSArray arrayWithObject:message]);
     }
   else
     {
-      printf("0\t%s\n",
-             [[NSString stringWithFormat:@"%@ Operation Completed", opName] cString]);
+      message = [NSString stringWithFormat:@"%@ Operation Completed", opName];
+      SendStrings('0', [NSArray arrayWithObject:message]);
     }
   fflush(stdout);
 }
@@ -169,8 +249,7 @@ static Communicator *shared = nil;
 	  return defaultReadErrorAction;
 	}
 
-      printf("R%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'R' message:message];
       do
 	{
 	  answer = fgetc(stdin);
@@ -195,8 +274,7 @@ static Communicator *shared = nil;
 	  return defaultWriteErrorAction;
 	}
 
-      printf("W%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'W' message:message];
       do
 	{
 	  answer = fgetc(stdin);
@@ -221,8 +299,7 @@ static Communicator *shared = nil;
 	  return defaultDeleteErrorAction;
 	}
 
-      printf("D%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'D' message:message];
       do
 	{
 	  answer = fgetc(stdin);
@@ -247,8 +324,7 @@ static Communicator *shared = nil;
 	  return defaultMoveErrorAction;
 	}
 
-      printf("M%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'M' message:message];
       do
 	{
 	  answer = fgetc(stdin);
@@ -276,8 +352,7 @@ static Communicator *shared = nil;
       // Cc - Copy the orignial 
       // Nn - New Link
       // Ss - Skip
-      printf("S%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'S' message:message];
       do
 	{
 	  answer = fgetc(stdin);
@@ -315,8 +390,7 @@ static Communicator *shared = nil;
 	  return defaultSymlinkTargetAction;
 	}
       
-      printf("T%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'T' message:message];
       // Nn - New Link
       // Ss - Skip
       do
@@ -352,8 +426,7 @@ static Communicator *shared = nil;
 	{
 	  return defaultAttrsAction;
 	}
-      printf("A%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'A' message:message];
       do
 	{
 	  answer = fgetc(stdin);
@@ -377,8 +450,7 @@ static Communicator *shared = nil;
 	  return defaultFileExistsAction;
 	}
 
-      printf("E%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'E' message:message];
       do
 	{
 	  answer = fgetc(stdin);
@@ -410,8 +482,7 @@ static Communicator *shared = nil;
 	  return defaultUnknownFileAction;
 	}
 
-      printf("U%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self sendProblem:'U' message:message];
       do
 	{
 	  answer = fgetc(stdin);
@@ -22,9 +22,13 @@
 
 #import "Copy.h"
 #import "NSStringAdditions.h"
+#import "CopyEngine.h"
+#import "CopyQueue.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // --- Copy
 
@@ -53,14 +57,22 @@ BOOL CopyOperation(NSString *sourceDir,
   NSEnumerator *e;
   NSString     *file;
   BOOL         opResult = YES;
+  BOOL         isQueued = CopyQueueStart(destDir);
 
+  // a failed queued file stops the operation as a failed CopyRegular() does
   e = [files objectEnumerator];
-  while (((file = [e nextObject]) != nil) && !isStopped && (opResult == YES))
+  while (((file = [e nextObject]) != nil) && !isStopped && (opResult == YES)
+         && !(isQueued && CopyQueueHasFailed()))
     {
       NSLog(@"Copy operation START");
       opResult = CopyFile(file, sourceDir, destDir, NO, opType);
       NSLog(@"Copy operation END");
     }
+
+  if (isQueued && CopyQueueFinish() == NO)
+    {
+      opResult = NO;
+    }
   
   // We received SIGTERM signal or 'Stop' command
   // Remove created duplicates and exit
@@ -129,7 +141,14 @@ BOOL CopyDirectory(NSString *sourceDir,
       CopyFile(filename, sourceDir, targetDir, NO, opType);
     }
 
-  if (chmod([targetDir cString], [fileAttributes filePosixPermissions]) == -1)
+  // Queued files may be not copied yet into the directory
+  if (CopyQueueIsActive() &&
+      ([fileAttributes filePosixPermissions] & (S_IWUSR | S_IXUSR)) != (S_IWUSR | S_IXUSR))
+    {
+      CopyQueueAddDirectoryPermissions(targetDir,
+                                       [fileAttributes filePosixPermissions]);
+    }
+  else if (chmod([targetDir cString], [fileAttributes filePosixPermissions]) == -1)
     {
       [comm howToHandleProblem:AttributesUnchangeable
 		      argument:[NSString errnoDescription]];
@@ -138,12 +157,33 @@ BOOL CopyDirectory(NSString *sourceDir,
   return YES;
 }
 
+typedef struct {
+  NSString           *filename;
+  NSString           *sourceDir;
+  NSString           *targetDir;
+  OperationType      opType;
+  unsigned long long doneSize;
+} CopyProgress;
+
+static int ReportCopyProgress(unsigned long long bytes, void *context)
+{
+  CopyProgress *progress = context;
+
+  progress->doneSize += bytes;
+  [[Communicator shared] showProcessingFilename:progress->filename
+                                   sourcePrefix:progress->sourceDir
+                                   targetPrefix:progress->targetDir
+                                  bytesAdvanced:bytes
+                                  operationType:progress->opType];
+  return !isStopped;
+}
+
 BOOL CopyRegular(NSString *sourceFile,
 		 NSString *targetFile,
 		 NSDictionary *fileAttributes,
                  OperationType opType)
 {
-  NSUInteger	doneSize = 0;
+  unsigned long long doneSize = 0;
   NSString	*sourceDir = [sourceFile stringByDeletingLastPathComponent];
   NSString	*targetDir = [targetFile stringByDeletingLastPathComponent];
   NSFileManager	*fm = [NSFileManager defaultManager];
@@ -161,6 +201,11 @@ BOOL CopyRegular(NSString *sourceFile,
     }
   }
 
+  if (CopyQueueIsActive()) {
+    CopyQueueAddFile(sourceFile, targetFile, fileAttributes, opType);
+    return YES;
+  }
+
   if (![fm createFileAtPath:targetFile contents:nil attributes:nil]) {
     [comm howToHandleProblem:WriteError];
     return NO;
@@ -173,10 +218,11 @@ BOOL CopyRegular(NSString *sourceFile,
   }
 
   {
-    int		read_fd, write_fd;
-    ssize_t	bytes_read = 1;
-    size_t	block_size = 64 * 1024;
-    void	*buf;
+    int              read_fd, write_fd;
+    CopyEngineResult result;
+    NSString         *errorDescription = nil;
+    CopyProgress     progress = {[sourceFile lastPathComponent],
+                                 sourceDir, targetDir, opType, 0};
 
     read_fd = open([sourceFile cString], O_RDONLY);
     if (read_fd < 0) {
@@ -189,23 +235,26 @@ BOOL CopyRegular(NSString *sourceFile,
       close(read_fd);
       return NO;
     }
-    buf = malloc(64 * 1024);
 
-    while (!isStopped && bytes_read) {
-      bytes_read = read(read_fd, buf, block_size);
-      if (bytes_read > 0) {
-        write(write_fd, buf, bytes_read);
-      }
-      doneSize += bytes_read;
-      [comm showProcessingFilename:[sourceFile lastPathComponent]
-                      sourcePrefix:sourceDir
-                      targetPrefix:targetDir
-                     bytesAdvanced:(NSUInteger)bytes_read
-                     operationType:opType];
+    result = CopyFileData(read_fd, write_fd, [fileAttributes fileSize],
+                          ReportCopyProgress, &progress);
+    doneSize = progress.doneSize;
+    if (close(write_fd) < 0 && result == CopyEngineDone) {
+      result = CopyEngineWriteFailed;
+    }
+    if (result == CopyEngineReadFailed || result == CopyEngineWriteFailed) {
+      errorDescription = [NSString errnoDescription];
     }
     close(read_fd);
-    close(write_fd);
-    free(buf);
+
+    if (result == CopyEngineReadFailed) {
+      [comm howToHandleProblem:ReadError argument:errorDescription];
+      return NO;
+    }
+    else if (result == CopyEngineWriteFailed) {
+      [comm howToHandleProblem:WriteError argument:errorDescription];
+      return NO;
+    }
   }
 
   if (!isStopped) {
@@ -332,15 +381,19 @@ BOOL CopyFile(NSString *filename,
   sourceFile = [sourcePrefix stringByAppendingPathComponent:filename];
   targetFile = [targetPrefix stringByAppendingPathComponent:filename];
   fattrs = [fm fileAttributesAtPath:sourceFile traverseLink:traverseLink];
+  fileType = [fattrs fileType];
 
   //NSLog(@"Copy filename: %@ %@ %@", filename, sourcePrefix, targetPrefix);
-  [comm showProcessingFilename:filename
-                  sourcePrefix:sourcePrefix
-                  targetPrefix:targetPrefix
-                 bytesAdvanced:0
-                 operationType:opType];
+  // Queued regular files are shown when reported as copied
+  if (!CopyQueueIsActive() || ![fileType isEqualToString:NSFileTypeRegular])
+    {
+      [comm showProcessingFilename:filename
+                      sourcePrefix:sourcePrefix
+                      targetPrefix:targetPrefix
+                     bytesAdvanced:0
+                     operationType:opType];
+    }
 
-  fileType = [fattrs fileType];
   if ([fileType isEqualToString:NSFileTypeSymbolicLink])
     {
       return CopySymbolicLink(sourceFile, targetFile, fattrs, opType);
@@ -408,6 +461,7 @@ void DuplicateOperation(NSString *sourceDir, NSArray *files)
   NSEnumerator  *e;
   NSString      *file;
   Communicator  *comm = [Communicator shared];
+  BOOL          isQueued;
 
   //NSLog(@"FileOperation: Duplicate %@, %@", sourceDir, files);
 
@@ -420,11 +474,16 @@ void DuplicateOperation(NSString *sourceDir, NSArray *files)
     }
   
   // Proceed with duplicating...
+  isQueued = CopyQueueStart(sourceDir);
   e = [files objectEnumerator];
   while (((file = [e nextObject]) != nil) && !isStopped)
     {
       DuplicateFile(file, sourceDir, NO);
     }
+  if (isQueued)
+    {
+      CopyQueueFinish();
+    }
 
   // We received SIGTERM signal or 'Stop' command
   // Remove created duplicates and exit
@@ -0,0 +1,241 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: The FileMover tool's file data copying.
+//
+// Copyright (C) 2006-2014 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "CopyEngine.h"
+
+// Bytes copied between progress reports
+#define COPY_CHUNK_SIZE  (8 * 1024 * 1024)
+// read()/write() buffer
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
+// copy_file_range() is called through syscall() - older C libraries have
+// no wrapper for it.
+static ssize_t _copyRange(int source_fd, off_t *source_offset,
+                          int target_fd, off_t *target_offset, size_t length)
+{
+#ifdef SYS_copy_file_range
+  return syscall(SYS_copy_file_range, source_fd, source_offset,
+                 target_fd, target_offset, length, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Errors meaning that copy_file_range() can't be used for these files:
+// fall back to read()/write().
+static int _isRangeUnsupported(int error)
+{
+  return (error == ENOSYS || error == EXDEV || error == EINVAL ||
+          error == EOPNOTSUPP || error == EBADF || error == EPERM);
+}
+
+static CopyEngineResult _writeAll(int fd, const char *buf, size_t length,
+                                  off_t offset)
+{
+  ssize_t written;
+
+  while (length > 0) {
+    written = pwrite(fd, buf, length, offset);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return CopyEngineWriteFailed;
+    }
+    buf += written;
+    offset += written;
+    length -= written;
+  }
+
+  return CopyEngineDone;
+}
+
+typedef struct {
+  int                source_fd;
+  int                target_fd;
+  int                use_range; // cleared if copy_file_range() is unsupported
+  char               *buffer;   // read()/write() fallback
+  off_t              reported;  // progress reported up to this offset
+  CopyEngineProgress progress;
+  void               *context;
+} CopyState;
+
+static int _reportProgress(CopyState *state, off_t offset)
+{
+  unsigned long long bytes = offset - state->reported;
+
+  state->reported = offset;
+  if (state->progress == NULL)
+    return 1;
+
+  return state->progress(bytes, state->context);
+}
+
+// Copies the [offset, end) data extent
+static CopyEngineResult _copyExtent(CopyState *state, off_t offset, off_t end)
+{
+  off_t            chunk_end;
+  ssize_t          count;
+  CopyEngineResult result;
+
+  while (offset < end) {
+    chunk_end = offset + COPY_CHUNK_SIZE;
+    if (chunk_end > end)
+      chunk_end = end;
+
+    while (state->use_range && offset < chunk_end) {
+      off_t source_offset = offset, target_offset = offset;
+
+      count = _copyRange(state->source_fd, &source_offset,
+                         state->target_fd, &target_offset, chunk_end - offset);
+      if (count < 0) {
+        if (errno == EINTR)
+          continue;
+        if (!_isRangeUnsupported(errno))
+          return (errno == EIO) ? CopyEngineReadFailed : CopyEngineWriteFailed;
+        state->use_range = 0;
+      }
+      else if (count == 0) {
+        // source is shorter than reported
+        return CopyEngineDone;
+      }
+      else {
+        offset += count;
+      }
+    }
+
+    if (!state->use_range && state->buffer == NULL &&
+        (state->buffer = malloc(COPY_BUFFER_SIZE)) == NULL) {
+      return CopyEngineWriteFailed;
+    }
+    while (!state->use_range && offset < chunk_end) {
+      size_t length = chunk_end - offset;
+
+      if (length > COPY_BUFFER_SIZE)
+        length = COPY_BUFFER_SIZE;
+      count = pread(state->source_fd, state->buffer, length, offset);
+      if (count < 0) {
+        if (errno == EINTR)
+          continue;
+        return CopyEngineReadFailed;
+      }
+      if (count == 0)
+        return CopyEngineDone;
+      result = _writeAll(state->target_fd, state->buffer, count, offset);
+      if (result != CopyEngineDone)
+        return result;
+      offset += count;
+    }
+
+    if (!_reportProgress(state, offset))
+      return CopyEngineStopped;
+  }
+
+  return CopyEngineDone;
+}
+
+CopyEngineResult CopyFileData(int source_fd, int target_fd, off_t size,
+                              CopyEngineProgress progress, void *context)
+{
+  CopyState        state = {source_fd, target_fd, 1, NULL, 0, progress, context};
+  CopyEngineResult result = CopyEngineDone;
+  int              sparse;
+  off_t            data, hole;
+
+  if (size <= 0)
+    return CopyEngineDone;
+
+  posix_fadvise(source_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+#ifdef FICLONE
+  // Same file system with shared extents (btrfs, XFS): nothing to copy
+  if (ioctl(target_fd, FICLONE, source_fd) == 0) {
+    _reportProgress(&state, size);
+    return CopyEngineDone;
+  }
+#endif
+
+  data = lseek(source_fd, 0, SEEK_DATA);
+  if (data < 0 && errno == ENXIO) {
+    // nothing but a hole
+    data = hole = size;
+    sparse = 1;
+  }
+  else if (data < 0 || (hole = lseek(source_fd, data, SEEK_HOLE)) < 0) {
+    data = 0;
+    hole = size;
+    sparse = 0;
+  }
+  else {
+    sparse = (data > 0 || hole < size);
+  }
+
+  // Source without holes is one data extent: preallocate the whole target
+  if (!sparse && fallocate(target_fd, 0, 0, size) < 0 && errno == ENOSPC)
+    return CopyEngineWriteFailed;
+
+  while (data < size) {
+    if (hole > size)
+      hole = size;
+    if (sparse && fallocate(target_fd, 0, data, hole - data) < 0 && errno == ENOSPC) {
+      result = CopyEngineWriteFailed;
+      break;
+    }
+    result = _copyExtent(&state, data, hole);
+    if (result != CopyEngineDone || hole >= size)
+      break;
+
+    data = lseek(source_fd, hole, SEEK_DATA);
+    if (data < 0) {
+      // trailing hole
+      break;
+    }
+    hole = lseek(source_fd, data, SEEK_HOLE);
+    if (hole < 0)
+      hole = size;
+  }
+
+  free(state.buffer);
+
+  if (result == CopyEngineDone) {
+    // holes are not written: set the length explicitly
+    if (sparse && ftruncate(target_fd, size) < 0)
+      result = CopyEngineWriteFailed;
+    else if (state.reported < size && !_reportProgress(&state, size))
+      result = CopyEngineStopped;
+  }
+
+  return result;
+}
@@ -0,0 +1,48 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: The FileMover tool's file data copying.
+//
+// Copyright (C) 2006-2014 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#ifndef __FILEMOVER_COPYENGINE_H__
+#define __FILEMOVER_COPYENGINE_H__
+
+#include <sys/types.h>
+
+typedef enum {
+  CopyEngineDone = 0,
+  CopyEngineReadFailed,
+  CopyEngineWriteFailed,
+  CopyEngineStopped
+} CopyEngineResult;
+
+// Called after each copied chunk with the number of bytes advanced (holes
+// included). Returns 0 to stop copying.
+typedef int (*CopyEngineProgress)(unsigned long long bytes, void *context);
+
+// Copies `size` bytes of `source_fd` into the empty file `target_fd`.
+// Methods are tried in order: reflink (FICLONE), copy_file_range() and
+// read()/write() through a large buffer. Holes of the source are kept
+// (SEEK_DATA/SEEK_HOLE), data extents are preallocated with fallocate().
+// On failure errno describes the error.
+CopyEngineResult CopyFileData(int source_fd, int target_fd, off_t size,
+                              CopyEngineProgress progress, void *context);
+
+#endif
@@ -0,0 +1,58 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: The FileMover tool's concurrent copying of regular files.
+//
+// Copyright (C) 2006-2014 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#import <Foundation/Foundation.h>
+#import "../Communicator.h"
+
+// While the copy queue is active, the tree walk (main thread) only checks
+// for conflicts and creates directories. The data of regular files is
+// copied by worker threads. Workers never talk to Communicator. The main
+// thread reports finished files in the order they were queued, with their
+// progress and problems.
+//
+// The number of workers is set by the "CopyThreads" default (0 - copy on
+// the main thread). Otherwise it depends on the target device: 2 for
+// rotational disks, 8 for others.
+
+// Starts workers for copying into `targetDir`. Returns NO if the queue is
+// disabled: copy files with CopyRegular() then.
+BOOL CopyQueueStart(NSString *targetDir);
+BOOL CopyQueueIsActive(void);
+// Returns YES if a reported file was not copied. Failures are known only
+// when files are reported, so files queued meanwhile are still copied.
+BOOL CopyQueueHasFailed(void);
+
+// Queues the copy of the regular file. The target must not exist.
+void CopyQueueAddFile(NSString *sourceFile,
+                      NSString *targetFile,
+                      NSDictionary *fileAttributes,
+                      OperationType opType);
+
+// Sets permissions of the directory once the queued files are copied.
+// Used for permissions which deny creation of files in the directory.
+void CopyQueueAddDirectoryPermissions(NSString *targetDir,
+                                      NSUInteger permissions);
+
+// Waits for queued files, reports them and stops workers. Returns NO if
+// some files were not copied.
+BOOL CopyQueueFinish(void);
@@ -0,0 +1,403 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: The FileMover tool's concurrent copying of regular files.
+//
+// Copyright (C) 2006-2014 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#import "CopyQueue.h"
+#import "CopyEngine.h"
+
+// Jobs queued ahead of the reporter
+#define QUEUE_SIZE      256
+#define MAX_WORKERS     64
+// Progress of the file being copied is flushed at this interval (ms)
+#define REPORT_INTERVAL 100
+
+typedef struct {
+  // set by the main thread
+  char               *source;
+  char               *target;
+  mode_t             mode;
+  off_t              size;
+  NSString           *filename;
+  NSString           *sourceDir;
+  NSString           *targetDir;
+  OperationType      opType;
+  // set by a worker, read by the main thread once `done` is set
+  BOOL               done;
+  CopyEngineResult   result;
+  int                error;
+  int                modeError;
+  unsigned long long copied;
+  // main thread only
+  BOOL               isShown;
+} CopyJob;
+
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  workCondition = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  doneCondition = PTHREAD_COND_INITIALIZER;
+
+static CopyJob         jobs[QUEUE_SIZE];
+static unsigned long   head;   // next job to report
+static unsigned long   next;   // next job to copy
+static unsigned long   tail;   // next free slot
+static BOOL            quit;
+static BOOL            failed;
+
+static pthread_t       workers[MAX_WORKERS];
+static unsigned        workerCount;
+static NSMutableArray  *directoryPermissions;
+
+// --- Workers
+
+static int _jobProgress(unsigned long long bytes, void *context)
+{
+  CopyJob *job = context;
+
+  job->copied += bytes;
+  CommunicatorAdvanceBytes(bytes);
+
+  return !isStopped;
+}
+
+static void _copyJob(CopyJob *job)
+{
+  int              source_fd, target_fd;
+  CopyEngineResult result;
+  int              error = 0, modeError = 0;
+
+  if (isStopped) {
+    result = CopyEngineStopped;
+  }
+  else if ((source_fd = open(job->source, O_RDONLY | O_CLOEXEC)) < 0) {
+    result = CopyEngineReadFailed;
+    error = errno;
+  }
+  else if ((target_fd = open(job->target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                             S_IRUSR | S_IWUSR)) < 0) {
+    result = CopyEngineWriteFailed;
+    error = errno;
+    close(source_fd);
+  }
+  else {
+    result = CopyFileData(source_fd, target_fd, job->size, _jobProgress, job);
+    if (result == CopyEngineReadFailed || result == CopyEngineWriteFailed) {
+      error = errno;
+    }
+    else if (result == CopyEngineDone && fchmod(target_fd, job->mode) < 0) {
+      modeError = errno;
+    }
+    if (close(target_fd) < 0 && result == CopyEngineDone) {
+      result = CopyEngineWriteFailed;
+      error = errno;
+    }
+    close(source_fd);
+  }
+
+  pthread_mutex_lock(&queueLock);
+  job->result = result;
+  job->error = error;
+  job->modeError = modeError;
+  job->done = YES;
+  pthread_cond_broadcast(&doneCondition);
+  pthread_mutex_unlock(&queueLock);
+}
+
+static void *_copyWorker(void *arg)
+{
+  CopyJob *job;
+
+  pthread_mutex_lock(&queueLock);
+  while (1) {
+    while (next == tail && !quit) {
+      pthread_cond_wait(&workCondition, &queueLock);
+    }
+    if (next == tail) {
+      break;
+    }
+    job = &jobs[next++ % QUEUE_SIZE];
+    pthread_mutex_unlock(&queueLock);
+
+    _copyJob(job);
+
+    pthread_mutex_lock(&queueLock);
+  }
+  pthread_mutex_unlock(&queueLock);
+
+  return NULL;
+}
+
+// --- Reporter (main thread)
+
+static void _showJob(CopyJob *job, unsigned long long bytes)
+{
+  [[Communicator shared] showProcessingFilename:job->filename
+                                   sourcePrefix:job->sourceDir
+                                   targetPrefix:job->targetDir
+                                  bytesAdvanced:bytes
+                                  operationType:job->opType];
+  job->isShown = YES;
+}
+
+static void _reportJob(CopyJob *job)
+{
+  Communicator *comm = [Communicator shared];
+  NSString     *message;
+
+  if (job->result == CopyEngineReadFailed || job->result == CopyEngineWriteFailed) {
+    failed = YES;
+    _showJob(job, 0);
+    message = [NSString stringWithFormat:@"%@: %s", job->filename,
+                        strerror(job->error)];
+    [comm howToHandleProblem:(job->result == CopyEngineReadFailed) ? ReadError
+                                                                   : WriteError
+                    argument:message];
+  }
+  else {
+    if (job->result == CopyEngineDone &&
+        (job->copied < job->size || job->isShown == NO)) {
+      _showJob(job, (job->copied < job->size) ? job->size - job->copied : 0);
+    }
+    if (job->modeError != 0) {
+      [comm howToHandleProblem:AttributesUnchangeable
+                      argument:[NSString stringWithCString:strerror(job->modeError)]];
+    }
+  }
+
+  free(job->source);
+  free(job->target);
+  [job->filename release];
+  [job->sourceDir release];
+  [job->targetDir release];
+}
+
+// Reports finished jobs. Waits for jobs queued before `waitUntil`,
+// showing the job being copied and its progress meanwhile.
+static void _reportJobs(unsigned long waitUntil)
+{
+  CopyJob         *job;
+  struct timespec timeout;
+
+  pthread_mutex_lock(&queueLock);
+  while (head < tail) {
+    job = &jobs[head % QUEUE_SIZE];
+
+    if (job->done == NO) {
+      if (head >= waitUntil) {
+        break;
+      }
+      if (job->isShown == NO) {
+        pthread_mutex_unlock(&queueLock);
+        _showJob(job, 0);
+        pthread_mutex_lock(&queueLock);
+        continue;
+      }
+      clock_gettime(CLOCK_REALTIME, &timeout);
+      timeout.tv_nsec += REPORT_INTERVAL * 1000000;
+      if (timeout.tv_nsec >= 1000000000) {
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&doneCondition, &queueLock, &timeout);
+      if (job->done == NO) {
+        // bytes copied by workers
+        pthread_mutex_unlock(&queueLock);
+        [[Communicator shared] flushProgress:NO];
+        pthread_mutex_lock(&queueLock);
+      }
+      continue;
+    }
+
+    // only the main thread adds jobs: the slot stays intact until we return
+    head++;
+    pthread_mutex_unlock(&queueLock);
+    _reportJob(job);
+    pthread_mutex_lock(&queueLock);
+  }
+  pthread_mutex_unlock(&queueLock);
+}
+
+// --- Workers number
+
+static BOOL _isRotationalDevice(NSString *path)
+{
+  struct stat st;
+  char        sysPath[128];
+  FILE        *file;
+  int         rotational = 0;
+
+  if (stat([path fileSystemRepresentation], &st) < 0) {
+    return NO;
+  }
+
+  // whole disk or its partition
+  snprintf(sysPath, sizeof(sysPath), "/sys/dev/block/%u:%u/queue/rotational",
+           major(st.st_dev), minor(st.st_dev));
+  if ((file = fopen(sysPath, "r")) == NULL) {
+    snprintf(sysPath, sizeof(sysPath), "/sys/dev/block/%u:%u/../queue/rotational",
+             major(st.st_dev), minor(st.st_dev));
+    file = fopen(sysPath, "r");
+  }
+  if (file != NULL) {
+    if (fscanf(file, "%d", &rotational) != 1) {
+      rotational = 0;
+    }
+    fclose(file);
+  }
+
+  return (rotational == 1);
+}
+
+static unsigned _workersForPath(NSString *targetDir)
+{
+  NSUserDefaults *df = [NSUserDefaults standardUserDefaults];
+  id             threads = [df objectForKey:@"CopyThreads"];
+  NSInteger      count;
+
+  if (threads != nil) {
+    count = [threads integerValue];
+    if (count < 0) {
+      count = 0;
+    }
+    return (count > MAX_WORKERS) ? MAX_WORKERS : count;
+  }
+
+  return _isRotationalDevice(targetDir) ? 2 : 8;
+}
+
+// --- Interface
+
+BOOL CopyQueueStart(NSString *targetDir)
+{
+  unsigned count = _workersForPath(targetDir);
+
+  if (workerCount > 0 || count == 0) {
+    return NO;
+  }
+
+  head = next = tail = 0;
+  quit = NO;
+  failed = NO;
+  directoryPermissions = [[NSMutableArray alloc] init];
+
+  for (workerCount = 0; workerCount < count; workerCount++) {
+    if (pthread_create(&workers[workerCount], NULL, _copyWorker, NULL) != 0) {
+      break;
+    }
+  }
+  if (workerCount == 0) {
+    [directoryPermissions release];
+    directoryPermissions = nil;
+    return NO;
+  }
+
+  return YES;
+}
+
+BOOL CopyQueueIsActive(void)
+{
+  return (workerCount > 0);
+}
+
+BOOL CopyQueueHasFailed(void)
+{
+  // set by the main thread in _reportJob()
+  return failed;
+}
+
+void CopyQueueAddFile(NSString *sourceFile,
+                      NSString *targetFile,
+                      NSDictionary *fileAttributes,
+                      OperationType opType)
+{
+  CopyJob *job;
+
+  // report finished jobs, wait for a free slot
+  _reportJobs((tail >= QUEUE_SIZE) ? tail - QUEUE_SIZE + 1 : 0);
+
+  job = &jobs[tail % QUEUE_SIZE];
+  memset(job, 0, sizeof(CopyJob));
+  job->source = strdup([sourceFile fileSystemRepresentation]);
+  job->target = strdup([targetFile fileSystemRepresentation]);
+  job->mode = [fileAttributes filePosixPermissions];
+  job->size = [fileAttributes fileSize];
+  job->filename = [[sourceFile lastPathComponent] retain];
+  job->sourceDir = [[sourceFile stringByDeletingLastPathComponent] retain];
+  job->targetDir = [[targetFile stringByDeletingLastPathComponent] retain];
+  job->opType = opType;
+
+  pthread_mutex_lock(&queueLock);
+  tail++;
+  pthread_cond_signal(&workCondition);
+  pthread_mutex_unlock(&queueLock);
+}
+
+void CopyQueueAddDirectoryPermissions(NSString *targetDir,
+                                      NSUInteger permissions)
+{
+  [directoryPermissions
+    addObject:[NSArray arrayWithObjects:targetDir,
+                       [NSNumber numberWithUnsignedInteger:permissions], nil]];
+}
+
+BOOL CopyQueueFinish(void)
+{
+  Communicator *comm = [Communicator shared];
+  NSEnumerator *e;
+  NSArray      *item;
+
+  if (workerCount == 0) {
+    return YES;
+  }
+
+  _reportJobs(tail);
+
+  pthread_mutex_lock(&queueLock);
+  quit = YES;
+  pthread_cond_broadcast(&workCondition);
+  pthread_mutex_unlock(&queueLock);
+  while (workerCount > 0) {
+    pthread_join(workers[--workerCount], NULL);
+  }
+
+  // deepest directories were added first
+  e = [directoryPermissions objectEnumerator];
+  while ((item = [e nextObject]) != nil) {
+    if (chmod([[item objectAtIndex:0] fileSystemRepresentation],
+              [[item objectAtIndex:1] unsignedIntegerValue]) == -1) {
+      [comm howToHandleProblem:AttributesUnchangeable
+                      argument:[NSString stringWithCString:strerror(errno)]];
+    }
+  }
+  [directoryPermissions release];
+  directoryPermissions = nil;
+
+  return !failed;
+}
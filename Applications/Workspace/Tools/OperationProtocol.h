@@ -0,0 +1,89 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: Messages of FileMover and Sizer tools to Workspace.
+//
+// Copyright (C) 2006-2014 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#ifndef __WORKSPACE_OPERATION_PROTOCOL_H__
+#define __WORKSPACE_OPERATION_PROTOCOL_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// Tools write frames to stdout: 1 byte type, 4 bytes payload length (host
+// byte order, both processes run on the same host) and the payload.
+// Strings are UTF-8, terminated by NUL. Numbers are uint64_t.
+//
+// 'F' <message> <filename> <source dir> <target dir> - file being processed
+// 'P' <files> <bytes>         - files and bytes processed since last 'P'
+// 'Q' <files> <bytes> <0|1>   - totals, 1 - increment of the totals
+// '0' <message>               - operation completed
+// '1' <message>               - operation stopped
+// 'R' 'W' 'D' 'M' 'S' 'T' 'A' 'E' 'U' <message> - problems (see Communicator.h)
+//
+// Progress is coalesced by tools: 'F' and 'P' are sent at most every
+// OP_REPORT_INTERVAL and right before other frames.
+
+#define OP_HEADER_SIZE     5
+#define OP_REPORT_INTERVAL 0.1
+
+static inline void OPFrameSetHeader(char *header, char type, uint32_t length)
+{
+  header[0] = type;
+  memcpy(header + 1, &length, sizeof(uint32_t));
+}
+
+static inline void OPFrameGetHeader(const char *header, char *type,
+                                    uint32_t *length)
+{
+  *type = header[0];
+  memcpy(length, header + 1, sizeof(uint32_t));
+}
+
+// Returns next string of payload or NULL if payload is malformed.
+static inline const char *OPFrameString(const char *payload, uint32_t length,
+                                        uint32_t *offset)
+{
+  const char *string = payload + *offset;
+  const char *end;
+
+  if (*offset >= length ||
+      (end = memchr(string, '\0', length - *offset)) == NULL) {
+    return NULL;
+  }
+  *offset += end - string + 1;
+
+  return string;
+}
+
+// Returns 0 if payload is too short.
+static inline int OPFrameNumber(const char *payload, uint32_t length,
+                                uint32_t *offset, uint64_t *number)
+{
+  if (*offset + sizeof(uint64_t) > length) {
+    return 0;
+  }
+  memcpy(number, payload + *offset, sizeof(uint64_t));
+  *offset += sizeof(uint64_t);
+
+  return 1;
+}
+
+#endif
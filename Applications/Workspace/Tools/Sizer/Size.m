@@ -19,101 +19,58 @@
 // Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
 //
 
+#include <limits.h>
+#include <sys/stat.h>
+
 #import "Size.h"
+#import "TreeWalk.h"
 
-static unsigned long long batchSize = 0;
-static unsigned long filecount = 0;
+// Totals are sent to Workspace at this interval (ms) while walking
+#define WALK_REPORT_INTERVAL 100
 
 @implementation Size
 
-// Recursive calculation of the 'dir' contents
-- (void)calculateBatchSizeInDirectory:(NSString *)dir
-                        operationType:(OperationType)opType
-                         communicator:(Communicator *)comm
-{
-  NSFileManager *fm = [NSFileManager defaultManager];
-  NSArray       *dirContents = [fm directoryContentsAtPath:dir];
-  NSString     *path = nil;
-  NSDictionary *fattrs = nil;
-
-  for (NSString *file in dirContents)
-    {
-      path = [dir stringByAppendingPathComponent:file];
-      fattrs = [fm fileAttributesAtPath:path traverseLink:NO];
-
-      [comm showProcessingFilename:[path lastPathComponent]
-                      sourcePrefix:[path stringByDeletingLastPathComponent]
-                      targetPrefix:nil
-                     bytesAdvanced:0
-                     operationType:SizingOp];
-
-      if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory])
-        {
-          // Recursion
-          [self calculateBatchSizeInDirectory:path
-                                operationType:opType
-                                 communicator:comm];
-        }
-      else
-        {
-          if (opType != DeleteOp)
-            {
-              batchSize += [fattrs fileSize];
-            }
-          filecount++;
-        }
-      filecount++;
-      
-      if (isStopped == YES)
-        return;
-    }
-}
-
-// Should update with printf:
-//           number of files: "Q\tF\t%u\t+"   <----(Queued Files)
-//                batch size: "Q\tS\t%llu\t+" <----(Queued Size)
-// If field #4 contains '+' it is an update to the totals (sendIncrement:YES).
-// Currently FileOperation.m gets this numbers if no other message types
-// detected "F" "B"
+// Sends number of files and batch size with 'Q' frame. With
+// sendIncrement:YES they are added to the totals.
+// Directories are walked by TreeWalk threads. Totals found so far are sent
+// as increments while walking, so Workspace shows them before the walk
+// is finished.
 - (void)calculateBatchSizeInDirectory:(NSString *)sourceDir
                                 files:(NSArray *)filenames
                         operationType:(OperationType)opType
                         sendIncrement:(BOOL)isIncrement
                          communicator:(Communicator *)comm
 {
+  TreeWalk           *walk;
+  TreeWalkTotals     totals;
+  unsigned long long filecount = 0, batchSize = 0;
+  unsigned long long sentFiles = 0, sentSize = 0;
+  char               dir[PATH_MAX];
+  BOOL               isFinished;
+
   isStopped = NO;
 
   // if (opType == LinkOp || opType == MoveOp)
   if (opType == LinkOp)
     {
-      if (isIncrement)
-        {
-          printf("Q\tF\t%lu\t+\n", [filenames count]);
-        }
-      else
-        {
-          printf("Q\tF\t%lu\n", [filenames count]);
-        }
-      fflush(stdout);
+      [comm sendTotalFiles:[filenames count] size:0 increment:isIncrement];
       return;
     }
 
+  walk = TreeWalkCreate(opType != DeleteOp);
+
   if (!filenames)
     { // Process all FS heirarchy starting from -Source directory
-      [self calculateBatchSizeInDirectory:sourceDir
-                            operationType:opType
-                             communicator:comm];
+      TreeWalkAddDirectory(walk, [sourceDir fileSystemRepresentation]);
     }
   else
     { // Process objects specified in -Files located in -Source
-      NSFileManager *fm = [NSFileManager defaultManager];
-      NSString      *path = nil;
-      NSDictionary  *fattrs = nil;
+      NSString    *path = nil;
+      struct stat st;
 
       for (NSString *file in filenames)
         {
           path = [sourceDir stringByAppendingPathComponent:file];
-          fattrs = [fm fileAttributesAtPath:path traverseLink:NO];
 
           [comm showProcessingFilename:[file lastPathComponent]
                           sourcePrefix:sourceDir
@@ -121,36 +78,68 @@ static unsigned long filecount = 0;
                          bytesAdvanced:0
                          operationType:SizingOp];
 
-          if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory])
-            { // recursive
-              [self calculateBatchSizeInDirectory:path
-                                    operationType:opType
-                                     communicator:comm];
+          if (lstat([path fileSystemRepresentation], &st) < 0)
+            {
+              continue;
             }
-          else
+          if (S_ISDIR(st.st_mode))
+            {
+              TreeWalkAddDirectory(walk, [path fileSystemRepresentation]);
+            }
+          else if (opType != DeleteOp)
+            {
+              batchSize += st.st_size;
+            }
+          filecount++;
+        }
+    }
+
+  TreeWalkStart(walk, MAX(4, [[NSProcessInfo processInfo] activeProcessorCount]));
+  do
+    {
+      isFinished = TreeWalkWait(walk, WALK_REPORT_INTERVAL, &totals,
+                                dir, sizeof(dir));
+      if (isStopped == YES)
+        {
+          TreeWalkStop(walk);
+        }
+      else if (!isFinished && filecount + totals.files > sentFiles)
+        {
+          [comm sendTotalFiles:filecount + totals.files - sentFiles
+                          size:batchSize + totals.bytes - sentSize
+                     increment:YES];
+          sentFiles = filecount + totals.files;
+          sentSize = batchSize + totals.bytes;
+          if (dir[0] != '\0')
             {
-              if (opType != DeleteOp)
-                {
-                  batchSize += [fattrs fileSize];
-                }
-              filecount++;
+              NSString *path = [NSString stringWithUTF8String:dir];
+
+              [comm showProcessingFilename:[path lastPathComponent]
+                              sourcePrefix:[path stringByDeletingLastPathComponent]
+                              targetPrefix:nil
+                             bytesAdvanced:0
+                             operationType:SizingOp];
             }
-          if (isStopped == YES)
-            return;
         }
     }
+  while (!isFinished);
+  TreeWalkDestroy(walk);
+
+  if (isStopped == YES)
+    return;
 
+  filecount += totals.files;
+  batchSize += totals.bytes;
   if (isIncrement)
     {
-      printf("Q\tF\t%lu\t+\n", filecount);
-      printf("Q\tS\t%llu\t+\n", batchSize);
+      [comm sendTotalFiles:filecount - sentFiles
+                      size:batchSize - sentSize
+                 increment:YES];
     }
   else
     {
-      printf("Q\tF\t%lu\n", filecount);
-      printf("Q\tS\t%llu\n", batchSize);
+      [comm sendTotalFiles:filecount size:batchSize increment:NO];
     }
-  fflush(stdout);
 }
 
 @end
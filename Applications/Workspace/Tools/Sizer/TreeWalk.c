@@ -0,0 +1,422 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: The Sizer tool's parallel directory tree walker.
+//
+// Copyright (C) 2006-2014 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "TreeWalk.h"
+
+#define MAX_THREADS      16
+#define DENTS_BUFFER     (64 * 1024)
+
+// Record returned by getdents64()
+struct linux_dirent64 {
+  uint64_t       d_ino;
+  int64_t        d_off;
+  unsigned short d_reclen;
+  unsigned char  d_type;
+  char           d_name[];
+};
+
+typedef struct {
+  char *path;
+  int  isRoot;  // added by TreeWalkAddDirectory(): symbolic links are followed
+} WalkDirectory;
+
+// Directories to read. The owner thread pushes and pops at the end,
+// other threads steal from the start (directories closer to the root).
+typedef struct {
+  pthread_mutex_t    lock;
+  WalkDirectory      *paths;
+  size_t             first;
+  size_t             count;
+  size_t             capacity;
+  char               current[PATH_MAX]; // directory being read
+  unsigned long long files;
+  unsigned long long bytes;
+} WalkStack;
+
+typedef struct {
+  TreeWalk  *walk;
+  unsigned  index;
+  pthread_t thread;
+  int       isStarted;
+} WalkThread;
+
+struct TreeWalk {
+  int             withSizes;
+  int             isStopped;
+  unsigned long   pending;     // directories queued or being read
+  unsigned long   queued;      // directories in stacks
+  unsigned        idleThreads; // threads waiting for idleCondition
+  pthread_mutex_t idleLock;
+  pthread_cond_t  idleCondition;
+  pthread_cond_t  doneCondition;
+  unsigned        threadCount;
+  WalkStack       stacks[MAX_THREADS];
+  WalkThread      threads[MAX_THREADS];
+};
+
+// --- Stacks
+
+static void _push(WalkStack *stack, WalkDirectory directory)
+{
+  pthread_mutex_lock(&stack->lock);
+  if (stack->first + stack->count == stack->capacity) {
+    if (stack->first > 0) {
+      memmove(stack->paths, stack->paths + stack->first,
+              stack->count * sizeof(WalkDirectory));
+      stack->first = 0;
+    }
+    else {
+      stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+      stack->paths = realloc(stack->paths,
+                             stack->capacity * sizeof(WalkDirectory));
+    }
+  }
+  stack->paths[stack->first + stack->count++] = directory;
+  pthread_mutex_unlock(&stack->lock);
+}
+
+static int _pop(WalkStack *stack, WalkDirectory *directory)
+{
+  int found = 0;
+
+  pthread_mutex_lock(&stack->lock);
+  if (stack->count > 0) {
+    *directory = stack->paths[stack->first + --stack->count];
+    found = 1;
+  }
+  pthread_mutex_unlock(&stack->lock);
+
+  return found;
+}
+
+static int _steal(WalkStack *stack, WalkDirectory *directory)
+{
+  int found = 0;
+
+  if (pthread_mutex_trylock(&stack->lock) != 0) {
+    return 0;
+  }
+  if (stack->count > 0) {
+    *directory = stack->paths[stack->first++];
+    stack->count--;
+    found = 1;
+  }
+  pthread_mutex_unlock(&stack->lock);
+
+  return found;
+}
+
+// --- Walking
+
+static void _addDirectory(TreeWalk *walk, WalkStack *stack, char *path,
+                          int isRoot)
+{
+  __atomic_add_fetch(&walk->pending, 1, __ATOMIC_RELAXED);
+  _push(stack, (WalkDirectory){ path, isRoot });
+
+  // Idle threads count themselves before checking `queued`: one of us
+  // sees the other.
+  __atomic_add_fetch(&walk->queued, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&walk->idleThreads, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&walk->idleLock);
+    pthread_cond_signal(&walk->idleCondition);
+    pthread_mutex_unlock(&walk->idleLock);
+  }
+}
+
+static int _takeDirectory(TreeWalk *walk, unsigned index,
+                          WalkDirectory *directory)
+{
+  int found = _pop(&walk->stacks[index], directory);
+
+  for (unsigned i = 1; !found && i < walk->threadCount; i++) {
+    found = _steal(&walk->stacks[(index + i) % walk->threadCount], directory);
+  }
+  if (found) {
+    __atomic_sub_fetch(&walk->queued, 1, __ATOMIC_SEQ_CST);
+  }
+
+  return found;
+}
+
+// Returns 0 if entry can't be stat'ed.
+static int _statEntry(int dir_fd, const char *name, unsigned char *type,
+                      unsigned long long *size)
+{
+#ifdef STATX_SIZE
+  struct statx stx;
+
+  if (statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT | AT_STATX_DONT_SYNC,
+            STATX_TYPE | STATX_SIZE, &stx) < 0) {
+    return 0;
+  }
+  *type = IFTODT(stx.stx_mode);
+  *size = stx.stx_size;
+#else
+  struct stat st;
+
+  if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT) < 0) {
+    return 0;
+  }
+  *type = IFTODT(st.st_mode);
+  *size = st.st_size;
+#endif
+
+  return 1;
+}
+
+static void _readDirectory(TreeWalk *walk, WalkStack *stack,
+                           WalkDirectory directory, char *buffer)
+{
+  char                  *path = directory.path;
+  struct linux_dirent64 *entry;
+  unsigned long long    files = 0, bytes = 0, size;
+  unsigned char         type;
+  size_t                pathLength = strlen(path);
+  long                  count, offset;
+  int                   fd;
+
+  pthread_mutex_lock(&stack->lock);
+  strncpy(stack->current, path, PATH_MAX - 1);
+  pthread_mutex_unlock(&stack->lock);
+
+  // subdirectories are never symbolic links: d_type or stat tells
+  fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC |
+            (directory.isRoot ? 0 : O_NOFOLLOW));
+  if (fd < 0) {
+    return;
+  }
+
+  while (!walk->isStopped &&
+         (count = syscall(SYS_getdents64, fd, buffer, DENTS_BUFFER)) > 0) {
+    for (offset = 0; offset < count; offset += entry->d_reclen) {
+      entry = (struct linux_dirent64 *)(buffer + offset);
+      if (entry->d_name[0] == '.' &&
+          (entry->d_name[1] == '\0' ||
+           (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+        continue;
+      }
+
+      type = entry->d_type;
+      size = 0;
+      if (type == DT_UNKNOWN || (walk->withSizes && type != DT_DIR)) {
+        if (!_statEntry(fd, entry->d_name, &type, &size)) {
+          continue;
+        }
+      }
+
+      files++;
+      if (type == DT_DIR) {
+        size_t nameLength = strlen(entry->d_name);
+        char   *subdir = malloc(pathLength + nameLength + 2);
+
+        memcpy(subdir, path, pathLength);
+        subdir[pathLength] = '/';
+        memcpy(subdir + pathLength + 1, entry->d_name, nameLength + 1);
+        _addDirectory(walk, stack, subdir, 0);
+      }
+      else if (walk->withSizes) {
+        bytes += size;
+      }
+    }
+  }
+  close(fd);
+
+  __atomic_add_fetch(&stack->files, files, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&stack->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static void *_walkThread(void *arg)
+{
+  WalkThread    *thread = arg;
+  TreeWalk      *walk = thread->walk;
+  WalkStack     *stack = &walk->stacks[thread->index];
+  char          *buffer = malloc(DENTS_BUFFER);
+  WalkDirectory directory;
+
+  while (1) {
+    if (_takeDirectory(walk, thread->index, &directory)) {
+      if (!walk->isStopped) {
+        _readDirectory(walk, stack, directory, buffer);
+      }
+      free(directory.path);
+      if (__atomic_sub_fetch(&walk->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&walk->idleLock);
+        pthread_cond_broadcast(&walk->idleCondition);
+        pthread_cond_broadcast(&walk->doneCondition);
+        pthread_mutex_unlock(&walk->idleLock);
+      }
+      continue;
+    }
+
+    // Nothing to read: wait for other threads to push directories
+    pthread_mutex_lock(&walk->idleLock);
+    __atomic_add_fetch(&walk->idleThreads, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&walk->queued, __ATOMIC_SEQ_CST) == 0 &&
+           __atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE) > 0) {
+      pthread_cond_wait(&walk->idleCondition, &walk->idleLock);
+    }
+    __atomic_sub_fetch(&walk->idleThreads, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE) == 0) {
+      pthread_mutex_unlock(&walk->idleLock);
+      break;
+    }
+    pthread_mutex_unlock(&walk->idleLock);
+  }
+
+  free(buffer);
+
+  return NULL;
+}
+
+// --- Interface
+
+TreeWalk *TreeWalkCreate(int withSizes)
+{
+  TreeWalk *walk = calloc(1, sizeof(TreeWalk));
+
+  walk->withSizes = withSizes;
+  pthread_mutex_init(&walk->idleLock, NULL);
+  pthread_cond_init(&walk->idleCondition, NULL);
+  pthread_cond_init(&walk->doneCondition, NULL);
+  for (unsigned i = 0; i < MAX_THREADS; i++) {
+    pthread_mutex_init(&walk->stacks[i].lock, NULL);
+  }
+
+  return walk;
+}
+
+void TreeWalkAddDirectory(TreeWalk *walk, const char *path)
+{
+  _addDirectory(walk, &walk->stacks[0], strdup(path), 1);
+}
+
+void TreeWalkStart(TreeWalk *walk, unsigned threads)
+{
+  if (threads < 1) {
+    threads = 1;
+  }
+  if (threads > MAX_THREADS) {
+    threads = MAX_THREADS;
+  }
+  walk->threadCount = threads;
+
+  for (unsigned i = 0; i < threads; i++) {
+    walk->threads[i].walk = walk;
+    walk->threads[i].index = i;
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    if (pthread_create(&walk->threads[i].thread, NULL, _walkThread,
+                       &walk->threads[i]) != 0) {
+      // stacks of missing threads are never popped: read them all by
+      // the started ones
+      walk->threadCount = (i > 0) ? i : 1;
+      if (i == 0) {
+        _walkThread(&walk->threads[0]);
+      }
+      break;
+    }
+    walk->threads[i].isStarted = 1;
+  }
+}
+
+int TreeWalkWait(TreeWalk *walk, unsigned msec, TreeWalkTotals *totals,
+                 char *dir, size_t dirSize)
+{
+  struct timespec timeout;
+  int             isFinished;
+
+  pthread_mutex_lock(&walk->idleLock);
+  if (__atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE) > 0) {
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_sec += msec / 1000;
+    timeout.tv_nsec += (msec % 1000) * 1000000;
+    if (timeout.tv_nsec >= 1000000000) {
+      timeout.tv_sec++;
+      timeout.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&walk->doneCondition, &walk->idleLock, &timeout);
+  }
+  isFinished = (__atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE) == 0);
+  pthread_mutex_unlock(&walk->idleLock);
+
+  totals->files = totals->bytes = 0;
+  for (unsigned i = 0; i < MAX_THREADS; i++) {
+    totals->files += __atomic_load_n(&walk->stacks[i].files, __ATOMIC_RELAXED);
+    totals->bytes += __atomic_load_n(&walk->stacks[i].bytes, __ATOMIC_RELAXED);
+  }
+
+  if (dir != NULL && dirSize > 0) {
+    dir[0] = '\0';
+    for (unsigned i = 0; i < walk->threadCount && dir[0] == '\0'; i++) {
+      pthread_mutex_lock(&walk->stacks[i].lock);
+      strncpy(dir, walk->stacks[i].current, dirSize - 1);
+      dir[dirSize - 1] = '\0';
+      pthread_mutex_unlock(&walk->stacks[i].lock);
+    }
+  }
+
+  return isFinished;
+}
+
+void TreeWalkStop(TreeWalk *walk)
+{
+  walk->isStopped = 1;
+}
+
+void TreeWalkDestroy(TreeWalk *walk)
+{
+  for (unsigned i = 0; i < MAX_THREADS; i++) {
+    if (walk->threads[i].isStarted) {
+      pthread_join(walk->threads[i].thread, NULL);
+    }
+  }
+  for (unsigned i = 0; i < MAX_THREADS; i++) {
+    WalkStack *stack = &walk->stacks[i];
+
+    for (size_t j = 0; j < stack->count; j++) {
+      free(stack->paths[stack->first + j].path);
+    }
+    free(stack->paths);
+    pthread_mutex_destroy(&stack->lock);
+  }
+  pthread_mutex_destroy(&walk->idleLock);
+  pthread_cond_destroy(&walk->idleCondition);
+  pthread_cond_destroy(&walk->doneCondition);
+  free(walk);
+}
@@ -0,0 +1,56 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: The Sizer tool's parallel directory tree walker.
+//
+// Copyright (C) 2006-2014 Sergii Stoian
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#ifndef __SIZER_TREEWALK_H__
+#define __SIZER_TREEWALK_H__
+
+#include <stddef.h>
+
+// Counts entries and sizes of directory trees. Each thread reads
+// directories with getdents64() from its own stack of directories and
+// steals directories from other threads when its stack is empty. Entries
+// are stat'ed only if the directory entry type is unknown or sizes are
+// requested.
+typedef struct TreeWalk TreeWalk;
+
+typedef struct {
+  unsigned long long files; // all entries: files, directories, links...
+  unsigned long long bytes; // sizes of entries other than directories
+} TreeWalkTotals;
+
+TreeWalk *TreeWalkCreate(int withSizes);
+// Adds tree to walk. Call before TreeWalkStart().
+void TreeWalkAddDirectory(TreeWalk *walk, const char *path);
+void TreeWalkStart(TreeWalk *walk, unsigned threads);
+
+// Waits up to `msec` milliseconds. Returns 1 when walk is finished.
+// `totals` are counted so far, `dir` (may be NULL) receives the path of a
+// directory being read.
+int TreeWalkWait(TreeWalk *walk, unsigned msec, TreeWalkTotals *totals,
+                 char *dir, size_t dirSize);
+// Makes threads finish as soon as possible.
+void TreeWalkStop(TreeWalk *walk);
+// Waits for threads and frees resources.
+void TreeWalkDestroy(TreeWalk *walk);
+
+#endif
@@ -161,7 +161,7 @@ static NSDragOperation savedMask;
 
   appIcon->icon->file = wstrdup([iconPath cString]);
   appIcon->icon->file_image = RCloneImage(r_image);
-  wfree(r_image);
+  RReleaseImage(r_image);
   wIconUpdate(appIcon->icon);
   
   wGhostIcon = MakeGhostIcon(wScreen, appIcon->icon->pixmap);
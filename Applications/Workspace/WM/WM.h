@@ -207,8 +207,16 @@ typedef enum {
 enum {
   WFontSettings = 1 << 0,
   WTextureSettings = 1 << 1,
-  WColorSettings = 1 << 2
+  WColorSettings = 1 << 2,
+  /* parts of window frames changed, all of them if none is set */
+  WFocusedTitleSettings = 1 << 3,
+  WUnfocusedTitleSettings = 1 << 4,
+  WPFocusedTitleSettings = 1 << 5,
+  WResizebarSettings = 1 << 6
 };
+#define WTitleStateSettings(state) (WFocusedTitleSettings << (state))
+#define WFramePartSettings (WFocusedTitleSettings | WUnfocusedTitleSettings | \
+                            WPFocusedTitleSettings | WResizebarSettings)
 
 typedef struct {
   int x1, y1;
@@ -317,11 +325,11 @@ extern struct wm_global_variables {
 
   } atom;
 
-  /* X Contexts */
+  /* Window to object maps (see winmap.h) */
   struct {
-    XContext client_win;
-    XContext app_win;
-    XContext stack;
+    struct WWindowMap *client_win;  /* WObjDescriptor */
+    struct WWindowMap *app_win;     /* WApplication */
+    struct WWindowMap *stack;       /* WCoreWindow of stacked frames */
   } context;
 
   /* X Extensions */
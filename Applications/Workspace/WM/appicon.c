@@ -42,6 +42,7 @@
 
 #include "WM.h"
 #include "window.h"
+#include "window_attributes.h"
 #include "icon.h"
 #include "application.h"
 #include "appicon.h"
@@ -59,6 +60,7 @@
 #include "event.h"
 #include "moveres.h"
 #include "iconyard.h"
+#include "winmap.h"
 #ifdef USE_DOCK_XDND
 #include "xdnd.h"
 #endif
@@ -1003,6 +1005,8 @@ static void wApplicationSaveIconPathFor(const char *iconPath, const char *wm_ins
 
   if (adict) {
     CFDictionarySetValue(dict, key, adict);
+    /* cached attributes refer to the replaced dictionary */
+    wDefaultFlushAttributesCache();
   }
   
   if (val && !wPreferences.flags.noupdates) {
@@ -1121,7 +1125,8 @@ WAppIcon *wAppIconFor(Window window)
   if (window == None)
     return NULL;
 
-  if (XFindContext(dpy, window, w_global.context.client_win, (XPointer *) & desc) == XCNOENT)
+  desc = wWindowMapFind(w_global.context.client_win, window);
+  if (!desc)
     return NULL;
 
   if (desc->parent_type == WCLASS_APPICON || desc->parent_type == WCLASS_DOCK_ICON)
@@ -50,6 +50,7 @@
 #include "client.h"
 #include "framewin.h"
 #include "appmenu.h"
+#include "winmap.h"
 
 #include <Workspace+WM.h>
 
@@ -169,8 +170,7 @@ WApplication *wApplicationOf(Window window)
 
   if (window == None)
     return NULL;
-  if (XFindContext(dpy, window, w_global.context.app_win, (XPointer *) & wapp) != XCSUCCESS)
-    return NULL;
+  wapp = wWindowMapFind(w_global.context.app_win, window);
   return wapp;
 }
 
@@ -318,7 +318,7 @@ WApplication *wApplicationCreate(WWindow * wwin)
   wapp->flags.emulated = WFLAGP(wapp->main_wwin, emulate_appicon);
 
   /* application descriptor */
-  XSaveContext(dpy, main_window, w_global.context.app_win, (XPointer) wapp);
+  wWindowMapSave(w_global.context.app_win, main_window, wapp);
 
   create_appicon_for_application(wapp, wwin);
 
@@ -450,7 +450,7 @@ void wApplicationDestroy(WApplication *wapp)
       wapp->prev->next = wapp->next;
   }
 
-  XDeleteContext(dpy, wapp->main_window, w_global.context.app_win);
+  wWindowMapDelete(w_global.context.app_win, wapp->main_window);
   
   /* Remove application icon */
   removeAppIconFor(wapp);
@@ -460,8 +460,8 @@ void wApplicationDestroy(WApplication *wapp)
   wWindowDestroy(wapp->main_wwin);
   if (wwin) {
     /* undelete client window context that was deleted in wWindowDestroy */
-    XSaveContext(dpy, wwin->client_win, w_global.context.client_win,
-                 (XPointer) & wwin->client_descriptor);
+    wWindowMapSave(w_global.context.client_win, wwin->client_win,
+                   &wwin->client_descriptor);
   }
 
   wfree(wapp);
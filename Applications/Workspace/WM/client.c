@@ -47,6 +47,7 @@
 #include "wmspec.h"
 #include "misc.h"
 #include "iconyard.h"
+#include "winmap.h"
 
 
 /*
@@ -198,7 +199,7 @@ void wClientConfigure(WWindow * wwin, XConfigureRequestEvent * xcre)
     WWindow *sibling;
 
     if ((xcre->value_mask & CWSibling) &&
-        (XFindContext(dpy, xcre->above, w_global.context.client_win, (XPointer *) & desc) == XCSUCCESS)
+        (desc = wWindowMapFind(w_global.context.client_win, xcre->above)) != NULL
         && (desc->parent_type == WCLASS_WINDOW)) {
       sibling = desc->parent;
       xwc.sibling = sibling->frame->core->window;
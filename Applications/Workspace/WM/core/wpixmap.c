@@ -246,8 +246,8 @@ WMPixmap *WMCreateScaledBlendedPixmapFromFile(WMScreen *scrPtr, const char *file
     image = new_image;
   }
 
-  RCombineImageWithColor(image, color);
-  pixPtr = WMCreatePixmapFromRImage(scrPtr, image, 0);
+  /* loaded image may be shared with the image cache */
+  pixPtr = WMCreateBlendedPixmapFromRImage(scrPtr, image, color);
   RReleaseImage(image);
 
   return pixPtr;
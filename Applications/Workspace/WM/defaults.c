@@ -86,6 +86,7 @@
 #include "winmenu.h"
 #include "moveres.h"
 #include "iconyard.h"
+#include "window_attributes.h"
 
 #include "Workspace+WM.h"
 
@@ -199,6 +200,16 @@ static WDECallbackUpdate setCursor;
 #define REFRESH_BUTTON_IMAGES		(1<<12)
 #define REFRESH_ICON_TITLE_COLOR	(1<<13)
 #define REFRESH_ICON_TITLE_BACK		(1<<14)
+/* window frame parts affected by REFRESH_WINDOW_*, all if none is set */
+#define REFRESH_FOCUSED_TITLE		(1<<15)
+#define REFRESH_UNFOCUSED_TITLE		(1<<16)
+#define REFRESH_PFOCUSED_TITLE		(1<<17)
+#define REFRESH_RESIZEBAR		(1<<18)
+
+#define REFRESH_TITLE_STATE(state) (REFRESH_FOCUSED_TITLE << (state))
+#define REFRESH_WINDOW_PARTS (REFRESH_FOCUSED_TITLE|REFRESH_UNFOCUSED_TITLE| \
+                              REFRESH_PFOCUSED_TITLE|REFRESH_RESIZEBAR)
+#define REFRESH_WINDOW (REFRESH_WINDOW_TEXTURES|REFRESH_WINDOW_TITLE_COLOR|REFRESH_WINDOW_FONT)
 
 #define REFRESH_FRAME_BORDER REFRESH_MENU_FONT|REFRESH_WINDOW_FONT
 
@@ -643,6 +654,8 @@ static void _updateDomain(WDDomain *domain, Bool shouldNotify)
         CFRelease(domain->dictionary);
       }
       domain->dictionary = dict;
+      /* attributes and icon paths (IconPath) may have changed */
+      wDefaultFlushAttributesCache();
     }
   }
   else {
@@ -885,22 +898,28 @@ void wDefaultsReadStatic(CFMutableDictionaryRef dict)
   }
 }
 
-// Apply `plvalue` from `new_dict` to appropriate `entry->addr` specified in `optionList`
+// Apply `plvalue` from `new_dict` to appropriate `entry->addr` specified in `optionList`.
+// Only keys whose value (builtin default if not set) differs from the one in
+// the current dictionary are converted and applied.
 void wDefaultsRead(WScreen *scr, CFMutableDictionaryRef new_dict, Bool shouldNotify)
 {
   CFTypeRef plvalue = NULL;
   CFTypeRef old_value = NULL;
   WDefaultEntry *entry;
-  unsigned int i;
+  unsigned int i, count;
   unsigned int needs_refresh = 0;
+  unsigned int window_parts = 0;
+  unsigned int refresh;
   void *tdata;
   CFDictionaryRef old_dict = NULL;
+  WDefaultEntry *changed[wlengthof(optionList)];
+  CFTypeRef changed_values[wlengthof(optionList)];
 
   if (w_global.domain.wm->dictionary != new_dict)
     old_dict = w_global.domain.wm->dictionary;
 
-  needs_refresh = 0;
-
+  /* compute the set of changed keys */
+  count = 0;
   for (i = 0; i < wlengthof(optionList); i++) {
     entry = &optionList[i];
 
@@ -910,43 +929,46 @@ void wDefaultsRead(WScreen *scr, CFMutableDictionaryRef new_dict, Bool shouldNot
     else {
       plvalue = NULL;
     }
-    
-    if (!old_dict) {
-      old_value = NULL;
-    }
-    else {
-      old_value = CFDictionaryGetValue(old_dict, entry->plkey);
-    }
 
     // No need to hold default value in dictionary
-    /* WMLogError("Check if default exist: %@", entry->plkey); */
     if (plvalue && CFEqual(plvalue, entry->plvalue)) {
       plvalue = NULL;
-      /* WMLogError("Removing setting equal to default: %@", entry->plkey); */
       CFDictionaryRemoveValue(new_dict, entry->plkey);
-      /* WMLogError("Removed"); */
     }
 
-    if (!plvalue) {
-      /* value was deleted from DB. Keep current value */
+    /* not set or deleted from DB: use builtin default */
+    if (!plvalue)
       plvalue = entry->plvalue;
-      /* continue; */
-    }
-    else if (!old_value) {
-      /* set value for the 1st time */
-    }
-    else if (CFEqual(plvalue, old_value)) {
-      /* value was not changed since last time */
+    if (!plvalue)
       continue;
+
+    if (old_dict) {
+      old_value = CFDictionaryGetValue(old_dict, entry->plkey);
+      if (!old_value)
+        old_value = entry->plvalue;
+      /* value was not changed since last time */
+      if (old_value && CFEqual(plvalue, old_value))
+        continue;
     }
 
-    if (plvalue) {
-      /* convert data */
-      if ((*entry->convert) (scr, entry, plvalue, entry->addr, &tdata)) {
-        if (entry->update) {
-          needs_refresh |= (*entry->update) (scr, entry, tdata, entry->extra_data);
-        }
+    changed[count] = entry;
+    changed_values[count] = plvalue;
+    count++;
+  }
+
+  /* apply changes and collect the objects to refresh */
+  for (i = 0; i < count; i++) {
+    entry = changed[i];
+
+    if ((*entry->convert) (scr, entry, changed_values[i], entry->addr, &tdata) && entry->update) {
+      refresh = (*entry->update) (scr, entry, tdata, entry->extra_data);
+      if (refresh & REFRESH_WINDOW) {
+        /* settings of all frame parts (fonts, justification...) */
+        if (!(refresh & REFRESH_WINDOW_PARTS))
+          window_parts = REFRESH_WINDOW_PARTS;
+        window_parts |= refresh & REFRESH_WINDOW_PARTS;
       }
+      needs_refresh |= refresh;
     }
   }
 
@@ -984,6 +1006,15 @@ void wDefaultsRead(WScreen *scr, CFMutableDictionaryRef new_dict, Bool shouldNot
       foo |= WTextureSettings;
     if (needs_refresh & REFRESH_WINDOW_TITLE_COLOR)
       foo |= WColorSettings;
+    if (foo && window_parts != REFRESH_WINDOW_PARTS) {
+      /* don't repaint windows whose current titlebar didn't change */
+      for (i = 0; i < 3; i++) {
+        if (window_parts & REFRESH_TITLE_STATE(i))
+          foo |= WTitleStateSettings(i);
+      }
+      if (window_parts & REFRESH_RESIZEBAR)
+        foo |= WResizebarSettings;
+    }
     if (foo) {
       CFNotificationCenterPostNotification(CFNotificationCenterGetLocalCenter(),
                                            WMDidChangeWindowAppearanceSettings, 
@@ -1665,6 +1696,114 @@ static WTexture *parse_texture(WScreen *scr, CFTypeRef pl)
   return texture;
 }
 
+/*
+ * Parsed textures and fonts by property list value. Textures set by update
+ * callbacks stay in the cache while referenced. Replaced ones and fonts are
+ * kept for a while, so switching a setting back and forth (e.g. in
+ * Preferences) doesn't parse, load and render them again.
+ */
+#define PARSED_CACHE_UNUSED_MAX 8
+
+typedef struct WParsedValue {
+  struct WParsedValue *next;
+  CFPropertyListRef plvalue;
+  void *object;
+  int refcount;
+} WParsedValue;
+
+static WParsedValue *textureCache;
+static WParsedValue *fontCache;
+
+static WParsedValue *findParsedValue(WParsedValue **cache, CFTypeRef plvalue, void *object)
+{
+  WParsedValue *pv, *prev = NULL;
+
+  for (pv = *cache; pv; prev = pv, pv = pv->next) {
+    if ((plvalue && CFEqual(pv->plvalue, plvalue)) || (object && pv->object == object)) {
+      /* most recently used first */
+      if (prev) {
+        prev->next = pv->next;
+        pv->next = *cache;
+        *cache = pv;
+      }
+      return pv;
+    }
+  }
+  return NULL;
+}
+
+static WParsedValue *addParsedValue(WParsedValue **cache, CFTypeRef plvalue, void *object)
+{
+  WParsedValue *pv = wmalloc(sizeof(WParsedValue));
+
+  pv->plvalue = CFPropertyListCreateDeepCopy(kCFAllocatorDefault, plvalue,
+                                             kCFPropertyListImmutable);
+  pv->object = object;
+  pv->next = *cache;
+  *cache = pv;
+
+  return pv;
+}
+
+/* Destroy least recently used entries not referenced by anyone */
+static void trimParsedValues(WScreen *scr, WParsedValue **cache, void (*destroy)(WScreen *, void *))
+{
+  WParsedValue *pv, **link = cache;
+  int unused = 0;
+
+  while ((pv = *link)) {
+    if (pv->refcount == 0 && ++unused > PARSED_CACHE_UNUSED_MAX) {
+      *link = pv->next;
+      (*destroy)(scr, pv->object);
+      CFRelease(pv->plvalue);
+      wfree(pv);
+    } else {
+      link = &pv->next;
+    }
+  }
+}
+
+static void destroyCachedTexture(WScreen *scr, void *texture)
+{
+  wTextureDestroy(scr, texture);
+}
+
+static void destroyCachedFont(WScreen *scr, void *font)
+{
+  (void) scr;
+  WMReleaseFont(font);
+}
+
+static WTexture *acquireTexture(WScreen *scr, CFTypeRef plvalue)
+{
+  WParsedValue *pv;
+  WTexture *texture;
+
+  pv = findParsedValue(&textureCache, plvalue, NULL);
+  if (!pv) {
+    texture = parse_texture(scr, plvalue);
+    if (!texture)
+      return NULL;
+    pv = addParsedValue(&textureCache, plvalue, texture);
+  }
+  pv->refcount++;
+
+  return pv->object;
+}
+
+/* Release texture returned by getTexture() */
+static void releaseTexture(WScreen *scr, WTexture *texture)
+{
+  WParsedValue *pv = findParsedValue(&textureCache, NULL, texture);
+
+  if (!pv) {
+    wTextureDestroy(scr, texture);
+    return;
+  }
+  pv->refcount--;
+  trimParsedValues(scr, &textureCache, destroyCachedTexture);
+}
+
 static int getTexture(WScreen *scr, WDefaultEntry *entry, CFTypeRef value, void *addr, void **ret)
 {
   const char *val;
@@ -1700,7 +1839,7 @@ static int getTexture(WScreen *scr, WDefaultEntry *entry, CFTypeRef value, void
     }
   }
 
-  texture = parse_texture(scr, value);
+  texture = acquireTexture(scr, value);
 
   if (!texture) {
     WMLogWarning(_("Error in texture specification for key \"%s\""), entry->key);
@@ -1726,18 +1865,28 @@ static int getFont(WScreen *scr, WDefaultEntry *entry, CFTypeRef value, void *ad
 {
   static WMFont *font;
   const char *val;
+  WParsedValue *pv;
 
   (void) addr;
 
-  GET_STRING_OR_DEFAULT("Font", val);
+  pv = findParsedValue(&fontCache, value, NULL);
+  if (pv) {
+    font = WMRetainFont(pv->object);
+  } else {
+    GET_STRING_OR_DEFAULT("Font", val);
 
-  font = WMCreateFont(scr->wmscreen, val);
-  if (!font)
-    font = WMCreateFont(scr->wmscreen, "fixed");
+    font = WMCreateFont(scr->wmscreen, val);
+    if (!font)
+      font = WMCreateFont(scr->wmscreen, "fixed");
 
-  if (!font) {
-    WMLogCritical(_("could not load any usable font!!!"));
-    exit(1);
+    if (!font) {
+      WMLogCritical(_("could not load any usable font!!!"));
+      exit(1);
+    }
+
+    /* cache holds a reference to keep the font loaded */
+    addParsedValue(&fontCache, value, WMRetainFont(font));
+    trimParsedValues(scr, &fontCache, destroyCachedFont);
   }
 
   if (ret)
@@ -2281,7 +2430,7 @@ static int setIconTile(WScreen * scr, WDefaultEntry * entry, void *tdata, void *
   if (!img) {
     WMLogWarning(_("could not render texture for icon background"));
     if (!entry->addr)
-      wTextureDestroy(scr, *texture);
+      releaseTexture(scr, *texture);
     return 0;
   }
   RConvertImage(scr->rcontext, img, &pixmap);
@@ -2325,7 +2474,7 @@ static int setIconTile(WScreen * scr, WDefaultEntry * entry, void *tdata, void *
 
   /* Free the texture as nobody else will use it, nor refer to it.  */
   if (!entry->addr)
-    wTextureDestroy(scr, *texture);
+    releaseTexture(scr, *texture);
 
   return (reset ? REFRESH_ICON_TILE : 0);
 }
@@ -2348,7 +2497,7 @@ static int setMiniwindowTile(WScreen *scr, WDefaultEntry *entry, void *tdata, vo
     {
       WMLogWarning(_("could not render texture for miniwindow background"));
       if (!entry->addr)
-        wTextureDestroy(scr, *texture);
+        releaseTexture(scr, *texture);
       return 0;
     }
   RConvertImage(scr->rcontext, img, &pixmap);
@@ -2373,7 +2522,7 @@ static int setMiniwindowTile(WScreen *scr, WDefaultEntry *entry, void *tdata, vo
 
   /* Free the texture as nobody else will use it, nor refer to it.  */
   if (!entry->addr)
-    wTextureDestroy(scr, *texture);
+    releaseTexture(scr, *texture);
 
   return (reset ? REFRESH_ICON_TILE : 0);
 }
@@ -2547,7 +2696,7 @@ static int setWTitleColor(WScreen *scr, WDefaultEntry *entry, void *tdata, void
 
   wFreeColor(scr, color->pixel);
 
-  return REFRESH_WINDOW_TITLE_COLOR;
+  return REFRESH_WINDOW_TITLE_COLOR | REFRESH_TITLE_STATE(widx);
 }
 
 static int setMenuTitleColor(WScreen *scr, WDefaultEntry *entry, void *tdata, void *extra_data)
@@ -2722,7 +2871,7 @@ static int setWidgetColor(WScreen *scr, WDefaultEntry *entry, void *tdata, void
   (void) foo;
 
   if (scr->widget_texture) {
-    wTextureDestroy(scr, (WTexture *) scr->widget_texture);
+    releaseTexture(scr, (WTexture *) scr->widget_texture);
   }
   scr->widget_texture = *(WTexSolid **) texture;
 
@@ -2738,11 +2887,11 @@ static int setFTitleBack(WScreen *scr, WDefaultEntry *entry, void *tdata, void *
   (void) foo;
 
   if (scr->window_title_texture[WS_FOCUSED]) {
-    wTextureDestroy(scr, scr->window_title_texture[WS_FOCUSED]);
+    releaseTexture(scr, scr->window_title_texture[WS_FOCUSED]);
   }
   scr->window_title_texture[WS_FOCUSED] = *texture;
 
-  return REFRESH_WINDOW_TEXTURES;
+  return REFRESH_WINDOW_TEXTURES | REFRESH_TITLE_STATE(WS_FOCUSED);
 }
 
 static int setPTitleBack(WScreen *scr, WDefaultEntry *entry, void *tdata, void *foo)
@@ -2754,11 +2903,11 @@ static int setPTitleBack(WScreen *scr, WDefaultEntry *entry, void *tdata, void *
   (void) foo;
 
   if (scr->window_title_texture[WS_PFOCUSED]) {
-    wTextureDestroy(scr, scr->window_title_texture[WS_PFOCUSED]);
+    releaseTexture(scr, scr->window_title_texture[WS_PFOCUSED]);
   }
   scr->window_title_texture[WS_PFOCUSED] = *texture;
 
-  return REFRESH_WINDOW_TEXTURES;
+  return REFRESH_WINDOW_TEXTURES | REFRESH_TITLE_STATE(WS_PFOCUSED);
 }
 
 static int setUTitleBack(WScreen *scr, WDefaultEntry *entry, void *tdata, void *foo)
@@ -2770,11 +2919,11 @@ static int setUTitleBack(WScreen *scr, WDefaultEntry *entry, void *tdata, void *
   (void) foo;
 
   if (scr->window_title_texture[WS_UNFOCUSED]) {
-    wTextureDestroy(scr, scr->window_title_texture[WS_UNFOCUSED]);
+    releaseTexture(scr, scr->window_title_texture[WS_UNFOCUSED]);
   }
   scr->window_title_texture[WS_UNFOCUSED] = *texture;
 
-  return REFRESH_WINDOW_TEXTURES;
+  return REFRESH_WINDOW_TEXTURES | REFRESH_TITLE_STATE(WS_UNFOCUSED);
 }
 
 static int setResizebarBack(WScreen *scr, WDefaultEntry *entry, void *tdata, void *foo)
@@ -2786,11 +2935,11 @@ static int setResizebarBack(WScreen *scr, WDefaultEntry *entry, void *tdata, voi
   (void) foo;
 
   if (scr->resizebar_texture[0]) {
-    wTextureDestroy(scr, scr->resizebar_texture[0]);
+    releaseTexture(scr, scr->resizebar_texture[0]);
   }
   scr->resizebar_texture[0] = *texture;
 
-  return REFRESH_WINDOW_TEXTURES;
+  return REFRESH_WINDOW_TEXTURES | REFRESH_RESIZEBAR;
 }
 
 static int setMenuTitleBack(WScreen *scr, WDefaultEntry *entry, void *tdata, void *foo)
@@ -2802,7 +2951,7 @@ static int setMenuTitleBack(WScreen *scr, WDefaultEntry *entry, void *tdata, voi
   (void) foo;
 
   if (scr->menu_title_texture[0]) {
-    wTextureDestroy(scr, scr->menu_title_texture[0]);
+    releaseTexture(scr, scr->menu_title_texture[0]);
   }
   scr->menu_title_texture[0] = *texture;
 
@@ -2818,7 +2967,7 @@ static int setMenuTextBack(WScreen *scr, WDefaultEntry *entry, void *tdata, void
   (void) foo;
 
   if (scr->menu_item_texture) {
-    wTextureDestroy(scr, scr->menu_item_texture);
+    releaseTexture(scr, scr->menu_item_texture);
     wTextureDestroy(scr, (WTexture *) scr->menu_item_auxtexture);
   }
   scr->menu_item_texture = *texture;
@@ -2889,11 +3038,12 @@ static int setWorkspaceMapBackground(WScreen *scr, WDefaultEntry *entry, void *t
   (void) foo;
 
   if (wPreferences.wsmbackTexture)
-    wTextureDestroy(scr, wPreferences.wsmbackTexture);
+    releaseTexture(scr, wPreferences.wsmbackTexture);
 
   wPreferences.wsmbackTexture = *texture;
 
-  return REFRESH_WINDOW_TEXTURES;
+  /* used by workspace map only, window frames don't change */
+  return 0;
 }
 
 static int setMenuStyle(WScreen *scr, WDefaultEntry *entry, void *tdata, void *foo)
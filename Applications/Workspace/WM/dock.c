@@ -74,6 +74,7 @@
 #include "event.h"
 #include "moveres.h"
 #include "iconyard.h"
+#include "winmap.h"
 
 #include <Workspace+WM.h>
 
@@ -717,6 +718,7 @@ static WAppIcon *mainIconCreate(WScreen *scr, int type, const char *name)
       CFDictionarySetValue(w_global.domain.window_attr->dictionary,
                            CFSTR("Workspace.GNUstep"), icon_desc);
       CFRelease(icon_desc);
+      wDefaultFlushAttributesCache();
       btn = wAppIconCreateForDock(scr, NULL, "Workspace", "GNUstep", TILE_NORMAL);
       x_pos = scr->width - ICON_SIZE - DOCK_EXTRA_SPACE;
       if (wPreferences.flags.clip_merged_in_dock) {
@@ -3944,9 +3946,8 @@ static void clipLeave(WDock *dock)
     return;
 
   if (XCheckTypedEvent(dpy, EnterNotify, &event) != False) {
-    if (XFindContext(dpy, event.xcrossing.window, w_global.context.client_win,
-                     (XPointer *) & desc) != XCNOENT
-        && desc && desc->parent_type == WCLASS_DOCK_ICON
+    desc = wWindowMapFind(w_global.context.client_win, event.xcrossing.window);
+    if (desc && desc->parent_type == WCLASS_DOCK_ICON
         && ((WAppIcon *) desc->parent)->dock == dock) {
       /* We haven't left the dock/clip/drawer yet */
       XPutBackEvent(dpy, &event);
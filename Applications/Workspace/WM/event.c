@@ -82,6 +82,7 @@
 #include "iconyard.h"
 #include "application.h"
 #include "appmenu.h"
+#include "winmap.h"
 
 #include <Workspace+WM.h>
 extern void wIconYardShowIcons(WScreen *screen);
@@ -207,6 +208,7 @@ void DispatchEvent(XEvent * event)
     return;
 
   saveTimestamp(event);
+  wWindowMapCountEvent();
   switch (event->type) {
   case MapRequest:
     handleMapRequest(event);
@@ -703,7 +705,8 @@ static void handleExpose(XEvent * event)
 
   while (XCheckTypedWindowEvent(dpy, event->xexpose.window, Expose, &ev)) ;
 
-  if (XFindContext(dpy, event->xexpose.window, w_global.context.client_win, (XPointer *) & desc) == XCNOENT) {
+  desc = wWindowMapFind(w_global.context.client_win, event->xexpose.window);
+  if (!desc) {
     return;
   }
 
@@ -834,13 +837,12 @@ static void handleButtonPress(XEvent * event)
 
   /* desc = NULL; */
   if (desc == NULL) {
-    if (XFindContext(dpy, event->xbutton.subwindow,
-                     w_global.context.client_win, (XPointer *)&desc) == XCNOENT) {
-      if (XFindContext(dpy, event->xbutton.window,
-                       w_global.context.client_win, (XPointer *)&desc) == XCNOENT) {
-        return;
-      }
-    }
+    if (event->xbutton.subwindow != None)
+      desc = wWindowMapFind(w_global.context.client_win, event->xbutton.subwindow);
+    if (desc == NULL)
+      desc = wWindowMapFind(w_global.context.client_win, event->xbutton.window);
+    if (desc == NULL)
+      return;
   }
 
   if (desc->parent_type == WCLASS_WINDOW) {
@@ -1151,7 +1153,8 @@ static void handleClientMessage(XEvent * event)
      * For when the icon frame gets a ClientMessage
      * that should have gone to the icon_window.
      */
-    if (XFindContext(dpy, event->xbutton.window, w_global.context.client_win, (XPointer *) & desc) != XCNOENT) {
+    desc = wWindowMapFind(w_global.context.client_win, event->xbutton.window);
+    if (desc) {
       struct WIcon *icon = NULL;
 
       if (desc->parent_type == WCLASS_MINIWINDOW) {
@@ -1184,7 +1187,8 @@ static void handleEnterNotify(XEvent * event)
     }
   }
 
-  if (XFindContext(dpy, event->xcrossing.window, w_global.context.client_win, (XPointer *) & desc) != XCNOENT) {
+  desc = wWindowMapFind(w_global.context.client_win, event->xcrossing.window);
+  if (desc) {
     if (desc->handle_enternotify)
       (*desc->handle_enternotify) (desc, event);
   }
@@ -1226,7 +1230,8 @@ static void handleLeaveNotify(XEvent * event)
 {
   WObjDescriptor *desc = NULL;
 
-  if (XFindContext(dpy, event->xcrossing.window, w_global.context.client_win, (XPointer *) & desc) != XCNOENT) {
+  desc = wWindowMapFind(w_global.context.client_win, event->xcrossing.window);
+  if (desc) {
     if (desc->handle_leavenotify)
       (*desc->handle_leavenotify) (desc, event);
   }
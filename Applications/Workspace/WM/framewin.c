@@ -58,6 +58,174 @@ static void buttonMouseDown(WObjDescriptor * desc, XEvent * event);
 static void titlebarMouseDown(WObjDescriptor * desc, XEvent * event);
 static void resizebarMouseDown(WObjDescriptor * desc, XEvent * event);
 
+/*
+ * Rendered titlebar, button and resizebar pixmaps are shared by all frames
+ * of a screen. Frames of the same size with the same textures (a row of
+ * terminals, focus going back and forth) get the pixmaps rendered before
+ * instead of rasterizing the texture again. Pixmaps no frame uses stay in
+ * the cache until the cache takes more than FRAME_PIXMAP_CACHE_LIMIT bytes,
+ * least recently used are dropped first.
+ */
+#define FRAME_PIXMAP_CACHE_LIMIT (4 * 1024 * 1024)
+
+enum {
+  FP_TITLEBAR,
+  FP_RESIZEBAR
+};
+
+typedef struct WFramePixmaps {
+  struct WFramePixmaps *prev;   /* more recently used */
+  struct WFramePixmaps *next;   /* less recently used */
+
+  union WTexture *texture;
+  int kind;
+  int width;
+  int height;
+  int variant;                  /* buttons and style, or resizebar corner */
+
+  Pixmap pixmap[3];             /* titlebar or resizebar, left and right button */
+  unsigned long size;
+  int refcount;
+  int stale;                    /* texture is gone, don't hand out */
+} WFramePixmaps;
+
+static void unlinkFramePixmaps(WScreen *scr, WFramePixmaps *fp)
+{
+  if (fp->prev)
+    fp->prev->next = fp->next;
+  else
+    scr->frame_pixmaps = fp->next;
+  if (fp->next)
+    fp->next->prev = fp->prev;
+  fp->prev = fp->next = NULL;
+}
+
+static void pushFramePixmaps(WScreen *scr, WFramePixmaps *fp)
+{
+  fp->prev = NULL;
+  fp->next = scr->frame_pixmaps;
+  if (fp->next)
+    fp->next->prev = fp;
+  scr->frame_pixmaps = fp;
+}
+
+static void destroyFramePixmaps(WScreen *scr, WFramePixmaps *fp)
+{
+  int i;
+
+  unlinkFramePixmaps(scr, fp);
+  scr->frame_pixmaps_size -= fp->size;
+  for (i = 0; i < 3; i++)
+    FREE_PIXMAP(fp->pixmap[i]);
+  wfree(fp);
+}
+
+/* Drop unused pixmaps beyond the size limit, least recently used first */
+static void trimFramePixmaps(WScreen *scr)
+{
+  WFramePixmaps *fp, *next;
+  unsigned long size = 0;
+
+  for (fp = scr->frame_pixmaps; fp; fp = next) {
+    next = fp->next;
+    size += fp->size;
+    if (size > FRAME_PIXMAP_CACHE_LIMIT && fp->refcount == 0) {
+      size -= fp->size;
+      destroyFramePixmaps(scr, fp);
+    }
+  }
+}
+
+static WFramePixmaps *findFramePixmaps(WScreen *scr, union WTexture *texture, int kind,
+                                       int width, int height, int variant)
+{
+  WFramePixmaps *fp;
+
+  for (fp = scr->frame_pixmaps; fp; fp = fp->next) {
+    if (fp->texture == texture && fp->kind == kind && fp->width == width
+        && fp->height == height && fp->variant == variant && !fp->stale) {
+      fp->refcount++;
+      unlinkFramePixmaps(scr, fp);
+      pushFramePixmaps(scr, fp);
+      return fp;
+    }
+  }
+
+  return NULL;
+}
+
+static WFramePixmaps *storeFramePixmaps(WScreen *scr, union WTexture *texture, int kind,
+                                        int width, int height, int variant, Pixmap *pixmaps)
+{
+  WFramePixmaps *fp;
+  int i;
+
+  fp = wmalloc(sizeof(WFramePixmaps));
+  fp->texture = texture;
+  fp->kind = kind;
+  fp->width = width;
+  fp->height = height;
+  fp->variant = variant;
+  fp->refcount = 1;
+  fp->stale = 0;
+  /* titlebar and buttons together cover width x height, 4 bytes per pixel */
+  fp->size = (unsigned long)width * height * 4;
+  for (i = 0; i < 3; i++)
+    fp->pixmap[i] = pixmaps[i];
+
+  pushFramePixmaps(scr, fp);
+  scr->frame_pixmaps_size += fp->size;
+  trimFramePixmaps(scr);
+
+  return fp;
+}
+
+static void releaseFramePixmaps(WScreen *scr, WFramePixmaps **fpp)
+{
+  WFramePixmaps *fp = *fpp;
+
+  if (!fp)
+    return;
+  *fpp = NULL;
+
+  fp->refcount--;
+  if (fp->refcount == 0) {
+    if (fp->stale)
+      destroyFramePixmaps(scr, fp);
+    else
+      trimFramePixmaps(scr);
+  }
+}
+
+/* Called when a texture is destroyed: its pixmaps can't be reused anymore */
+void wFrameWindowForgetTexture(WScreen *scr, union WTexture *texture)
+{
+  WFramePixmaps *fp, *next;
+
+  for (fp = scr->frame_pixmaps; fp; fp = next) {
+    next = fp->next;
+    if (fp->texture == texture) {
+      fp->stale = 1;
+      if (fp->refcount == 0)
+        destroyFramePixmaps(scr, fp);
+    }
+  }
+}
+
+static void releaseTitlePixmaps(WFrameWindow *fwin, int state)
+{
+  releaseFramePixmaps(fwin->screen_ptr, &fwin->title_pixmaps[state]);
+  fwin->title_back[state] = None;
+  fwin->lbutton_back[state] = None;
+  fwin->rbutton_back[state] = None;
+}
+
+static void releaseResizebarPixmaps(WFrameWindow *fwin)
+{
+  releaseFramePixmaps(fwin->screen_ptr, &fwin->resizebar_pixmaps);
+  fwin->resizebar_back[0] = None;
+}
+
 static void checkTitleSize(WFrameWindow * fwin);
 
 static void paintButton(WCoreWindow * button, WTexture * texture,
@@ -182,13 +350,8 @@ void wFrameWindowUpdateBorders(WFrameWindow * fwin, int flags)
     }
     else {
       /* we had a titlebar, but now we don't need it anymore */
-      for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++) {
-        FREE_PIXMAP(fwin->title_back[i]);
-        if (wPreferences.titlebar_style == TS_NEW) {
-          FREE_PIXMAP(fwin->lbutton_back[i]);
-          FREE_PIXMAP(fwin->rbutton_back[i]);
-        }
-      }
+      for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++)
+        releaseTitlePixmaps(fwin, i);
       if (fwin->left_button)
         wCoreDestroy(fwin->left_button);
       fwin->left_button = NULL;
@@ -313,6 +476,7 @@ void wFrameWindowUpdateBorders(WFrameWindow * fwin, int flags)
 
     if (fwin->resizebar) {
       fwin->bottom_width = 0;
+      releaseResizebarPixmaps(fwin);
       wCoreDestroy(fwin->resizebar);
       fwin->resizebar = NULL;
     }
@@ -399,13 +563,9 @@ void wFrameWindowDestroy(WFrameWindow * fwin)
   if (fwin->title)
     wfree(fwin->title);
 
-  for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++) {
-    FREE_PIXMAP(fwin->title_back[i]);
-    if (wPreferences.titlebar_style == TS_NEW) {
-      FREE_PIXMAP(fwin->lbutton_back[i]);
-      FREE_PIXMAP(fwin->rbutton_back[i]);
-    }
-  }
+  for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++)
+    releaseTitlePixmaps(fwin, i);
+  releaseResizebarPixmaps(fwin);
 
   wfree(fwin);
 }
@@ -676,53 +836,79 @@ static void updateTexture(WFrameWindow * fwin)
   }
 }
 
-static void remakeTexture(WFrameWindow * fwin, int state)
+static void remakeTitleTexture(WFrameWindow * fwin, int state)
 {
-  Pixmap pmap, lpmap, rpmap;
+  WScreen *scr = fwin->screen_ptr;
+  WFramePixmaps *fp, *old;
+  Pixmap pmap[3];
 
   if (fwin->title_texture[state] && fwin->titlebar) {
-    FREE_PIXMAP(fwin->title_back[state]);
-    if (wPreferences.titlebar_style == TS_NEW) {
-      FREE_PIXMAP(fwin->lbutton_back[state]);
-      FREE_PIXMAP(fwin->rbutton_back[state]);
-    }
+    /* released after the lookup, which may find the same pixmaps */
+    old = fwin->title_pixmaps[state];
+    fwin->title_pixmaps[state] = NULL;
+    releaseTitlePixmaps(fwin, state);
 
     if (fwin->title_texture[state]->any.type != WTEX_SOLID) {
       int left, right;
-      int width;
+      int width, height, variant;
 
       /* eventually surrounded by if new_style */
       left = fwin->left_button && !fwin->flags.hide_left_button && !fwin->flags.lbutton_dont_fit;
       right = fwin->right_button && !fwin->flags.hide_right_button && !fwin->flags.rbutton_dont_fit;
 
       width = fwin->core->width + 1;
+      height = fwin->titlebar->height;
+      variant = left | (right << 1) | (wPreferences.titlebar_style << 2);
+
+      fp = findFramePixmaps(scr, fwin->title_texture[state], FP_TITLEBAR,
+                            width, height, variant);
+      if (!fp) {
+        renderTexture(scr, fwin->title_texture[state], width, height,
+                      height, height, left, right, &pmap[0], &pmap[1], &pmap[2]);
+        fp = storeFramePixmaps(scr, fwin->title_texture[state], FP_TITLEBAR,
+                               width, height, variant, pmap);
+      }
+      fwin->title_pixmaps[state] = fp;
 
-      renderTexture(fwin->screen_ptr, fwin->title_texture[state],
-                    width, fwin->titlebar->height,
-                    fwin->titlebar->height, fwin->titlebar->height,
-                    left, right, &pmap, &lpmap, &rpmap);
-
-      fwin->title_back[state] = pmap;
+      fwin->title_back[state] = fp->pixmap[0];
       if (wPreferences.titlebar_style == TS_NEW) {
-        fwin->lbutton_back[state] = lpmap;
-        fwin->rbutton_back[state] = rpmap;
+        fwin->lbutton_back[state] = fp->pixmap[1];
+        fwin->rbutton_back[state] = fp->pixmap[2];
       }
     }
+    releaseFramePixmaps(scr, &old);
   }
-  if (fwin->resizebar_texture && fwin->resizebar_texture[0]
-      && fwin->resizebar && state == 0) {
+}
 
-    FREE_PIXMAP(fwin->resizebar_back[0]);
+static void remakeResizebarTexture(WFrameWindow * fwin)
+{
+  WScreen *scr = fwin->screen_ptr;
+  WFramePixmaps *fp, *old;
+  Pixmap pmap[3];
 
-    if (fwin->resizebar_texture[0]->any.type != WTEX_SOLID) {
+  if (fwin->resizebar_texture && fwin->resizebar_texture[0] && fwin->resizebar) {
 
-      renderResizebarTexture(fwin->screen_ptr,
-                             fwin->resizebar_texture[0],
-                             fwin->resizebar->width,
-                             fwin->resizebar->height, fwin->resizebar_corner_width, &pmap);
+    old = fwin->resizebar_pixmaps;
+    fwin->resizebar_pixmaps = NULL;
+    releaseResizebarPixmaps(fwin);
 
-      fwin->resizebar_back[0] = pmap;
+    if (fwin->resizebar_texture[0]->any.type != WTEX_SOLID) {
+      fp = findFramePixmaps(scr, fwin->resizebar_texture[0], FP_RESIZEBAR,
+                            fwin->resizebar->width, fwin->resizebar->height,
+                            fwin->resizebar_corner_width);
+      if (!fp) {
+        renderResizebarTexture(scr, fwin->resizebar_texture[0],
+                               fwin->resizebar->width, fwin->resizebar->height,
+                               fwin->resizebar_corner_width, &pmap[0]);
+        pmap[1] = pmap[2] = None;
+        fp = storeFramePixmaps(scr, fwin->resizebar_texture[0], FP_RESIZEBAR,
+                               fwin->resizebar->width, fwin->resizebar->height,
+                               fwin->resizebar_corner_width, pmap);
+      }
+      fwin->resizebar_pixmaps = fp;
+      fwin->resizebar_back[0] = fp->pixmap[0];
     }
+    releaseFramePixmaps(scr, &old);
 
     /* this part should be in updateTexture() */
     if (fwin->resizebar_texture[0]->any.type != WTEX_SOLID)
@@ -735,6 +921,13 @@ static void remakeTexture(WFrameWindow * fwin, int state)
   }
 }
 
+static void remakeTexture(WFrameWindow * fwin, int state)
+{
+  remakeTitleTexture(fwin, state);
+  if (state == 0)
+    remakeResizebarTexture(fwin);
+}
+
 void wFrameWindowPaint(WFrameWindow * fwin)
 {
   WScreen *scr = fwin->screen_ptr;
@@ -750,6 +943,7 @@ void wFrameWindowPaint(WFrameWindow * fwin)
 
     fwin->flags.need_texture_remake = 0;
     fwin->flags.need_texture_change = 0;
+    fwin->flags.stale_textures = 0;
 
     if (fwin->flags.single_texture) {
       remakeTexture(fwin, 0);
@@ -767,6 +961,22 @@ void wFrameWindowPaint(WFrameWindow * fwin)
     }
   }
 
+  if (fwin->flags.stale_textures) {
+    int i;
+
+    /* only some of the textures were replaced */
+    for (i = 0; i < 3; i++) {
+      if ((fwin->flags.stale_textures & WFRAME_TITLE_TEXTURE(i))
+          && (i == 0 || !fwin->flags.single_texture))
+        remakeTitleTexture(fwin, i);
+    }
+    if (fwin->flags.stale_textures & WFRAME_RESIZEBAR_TEXTURE)
+      remakeResizebarTexture(fwin);
+    if (fwin->flags.stale_textures & WFRAME_TITLE_TEXTURE(state))
+      fwin->flags.need_texture_change = 1;
+    fwin->flags.stale_textures = 0;
+  }
+
   if (fwin->flags.need_texture_change) {
     fwin->flags.need_texture_change = 0;
 
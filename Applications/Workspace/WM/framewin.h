@@ -47,6 +47,10 @@
 #define WS_UNFOCUSED		1
 #define WS_PFOCUSED		2
 
+/* frame parts in stale_textures */
+#define WFRAME_TITLE_TEXTURE(state)	(1 << (state))
+#define WFRAME_RESIZEBAR_TEXTURE	(1 << 3)
+
 #define TITLEBAR_EXTEND_SPACE	4
 
 typedef struct WFrameWindow {
@@ -74,6 +78,9 @@ typedef struct WFrameWindow {
   Pixmap resizebar_back[3];	       /* any, None, None */
   Pixmap lbutton_back[3];
   Pixmap rbutton_back[3];
+  /* shared cache entries the pixmaps above come from */
+  struct WFramePixmaps *title_pixmaps[3];
+  struct WFramePixmaps *resizebar_pixmaps;
 
   WPixmap *lbutton_image;
   WPixmap *rbutton_image;
@@ -107,6 +114,7 @@ typedef struct WFrameWindow {
     unsigned int right_button:1;
     
     unsigned int need_texture_remake:1;
+    unsigned int stale_textures:4;     /* WFRAME_*_TEXTURE to remake */
     
     unsigned int single_texture:1;
     
@@ -159,4 +167,6 @@ void wFrameWindowHideButton(WFrameWindow *fwin, int flags);
 
 int wFrameWindowChangeTitle(WFrameWindow *fwin, const char *new_title);
 
+void wFrameWindowForgetTexture(WScreen *scr, union WTexture *texture);
+
 #endif /* __WORKSPACE_WM_FRAMEWINDOW__ */
@@ -56,6 +56,7 @@
 #include "moveres.h"
 #include "defaults.h"
 #include "xmodifier.h"
+#include "winmap.h"
 
 /* do not divide main menu and submenu in different tiers, opposed to OpenStep */
 #undef SINGLE_MENULEVEL
@@ -1314,7 +1315,8 @@ static WMenu *findMenu(WScreen *scr, int *x_ret, int *y_ret)
   if (win == None) {
     return NULL;
   }
-  if (XFindContext(dpy, win, w_global.context.client_win, (XPointer *) & desc) == XCNOENT) {
+  desc = wWindowMapFind(w_global.context.client_win, win);
+  if (!desc) {
     return NULL;
   }
   if (desc->parent_type == WCLASS_MENU) {
@@ -1414,7 +1416,8 @@ WMenu *wMenuUnderPointer(WScreen *screen)
   if (win == None)
     return NULL;
 
-  if (XFindContext(dpy, win, w_global.context.client_win, (XPointer *) & desc) == XCNOENT)
+  desc = wWindowMapFind(w_global.context.client_win, win);
+  if (!desc)
     return NULL;
 
   if (desc->parent_type == WCLASS_MENU)
@@ -642,6 +642,7 @@ typedef struct {
   WWindow **rightList;	/* right border */
   WWindow **bottomList;	/* bottom border */
   int count;
+  int size;		/* allocated size of the lists */
 
   /* index of window in the above lists indicating the relative position
    * of the window with the others */
@@ -652,6 +653,8 @@ typedef struct {
 
   int rubCount;		/* for workspace switching */
 
+  WArea *headEdges;	/* edges of usable area of each head */
+
   int winWidth, winHeight;	/* width/height of the window */
   int realX, realY;	/* actual position of the window */
   int calcX, calcY;	/* calculated position of window */
@@ -678,56 +681,156 @@ typedef struct {
 #define WBOTTOM(w) ((w)->frame_y + (int)(w)->frame->core->height - 1 +  \
                     (HAS_BORDER_WITH_SELECT(w) ? 2*(w)->screen->frame_border_width : 0))
 
-static int compareWTop(const void *a, const void *b)
+/*
+ * Edge index: all windows of the screen sorted by each of the frame edges,
+ * from the closest to the border of the screen to the farthest. Keys of top
+ * and left edges are negated so that every array is sorted ascending.
+ * wWindowConfigure() and wWindowMove() keep it up to date, so a move only
+ * copies the windows it resists to instead of sorting them.
+ */
+enum {
+  EDGE_TOP,
+  EDGE_LEFT,
+  EDGE_RIGHT,
+  EDGE_BOTTOM,
+  EDGE_COUNT
+};
+
+typedef struct {
+  int key;
+  WWindow *wwin;
+} WEdge;
+
+typedef struct WEdgeIndex {
+  WEdge *edges[EDGE_COUNT];
+  int count;
+  int size;
+} WEdgeIndex;
+
+static inline int edgeKey(WWindow *wwin, int edge)
+{
+  switch (edge) {
+  case EDGE_TOP:
+    return -WTOP(wwin);
+  case EDGE_LEFT:
+    return -WLEFT(wwin);
+  case EDGE_RIGHT:
+    return WRIGHT(wwin);
+  default:
+    return WBOTTOM(wwin);
+  }
+}
+
+/* Number of entries with key less than `key`. */
+static int edgeLowerBound(WEdge *edges, int count, int key)
 {
-  WWindow *wwin1 = *(WWindow **) a;
-  WWindow *wwin2 = *(WWindow **) b;
+  int low = 0, high = count, mid;
 
-  if (WTOP(wwin1) > WTOP(wwin2))
-    return -1;
-  else if (WTOP(wwin1) < WTOP(wwin2))
-    return 1;
-  else
-    return 0;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (edges[mid].key < key)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
 }
 
-static int compareWLeft(const void *a, const void *b)
+static Bool edgeIndexContains(WEdgeIndex *index, int edge, WWindow *wwin, int key)
 {
-  WWindow *wwin1 = *(WWindow **) a;
-  WWindow *wwin2 = *(WWindow **) b;
+  WEdge *edges = index->edges[edge];
+  int i;
 
-  if (WLEFT(wwin1) > WLEFT(wwin2))
-    return -1;
-  else if (WLEFT(wwin1) < WLEFT(wwin2))
-    return 1;
-  else
-    return 0;
+  for (i = edgeLowerBound(edges, index->count, key); i < index->count && edges[i].key == key; i++) {
+    if (edges[i].wwin == wwin)
+      return True;
+  }
+  return False;
 }
 
-static int compareWRight(const void *a, const void *b)
+static void edgeIndexRemove(WEdgeIndex *index, WWindow *wwin)
 {
-  WWindow *wwin1 = *(WWindow **) a;
-  WWindow *wwin2 = *(WWindow **) b;
+  WEdge *edges;
+  int edge, i;
 
-  if (WRIGHT(wwin1) < WRIGHT(wwin2))
-    return -1;
-  else if (WRIGHT(wwin1) > WRIGHT(wwin2))
-    return 1;
-  else
-    return 0;
+  for (edge = 0; edge < EDGE_COUNT; edge++) {
+    edges = index->edges[edge];
+    for (i = 0; i < index->count && edges[i].wwin != wwin; i++);
+    if (i == index->count)
+      return;
+    memmove(&edges[i], &edges[i + 1], (index->count - i - 1) * sizeof(WEdge));
+  }
+  index->count--;
 }
 
-static int compareWBottom(const void *a, const void *b)
+static void edgeIndexInsert(WEdgeIndex *index, WWindow *wwin, int *keys)
 {
-  WWindow *wwin1 = *(WWindow **) a;
-  WWindow *wwin2 = *(WWindow **) b;
+  WEdge *edges;
+  int edge, i;
 
-  if (WBOTTOM(wwin1) < WBOTTOM(wwin2))
-    return -1;
-  else if (WBOTTOM(wwin1) > WBOTTOM(wwin2))
-    return 1;
-  else
-    return 0;
+  if (index->count == index->size) {
+    index->size = index->size ? index->size * 2 : 32;
+    for (edge = 0; edge < EDGE_COUNT; edge++)
+      index->edges[edge] = wrealloc(index->edges[edge], index->size * sizeof(WEdge));
+  }
+
+  for (edge = 0; edge < EDGE_COUNT; edge++) {
+    edges = index->edges[edge];
+    i = edgeLowerBound(edges, index->count, keys[edge] + 1);
+    memmove(&edges[i + 1], &edges[i], (index->count - i) * sizeof(WEdge));
+    edges[i].key = keys[edge];
+    edges[i].wwin = wwin;
+  }
+  index->count++;
+}
+
+void wEdgeIndexUpdateWindow(WWindow *wwin)
+{
+  WScreen *scr = wwin->screen;
+  WEdgeIndex *index;
+  int keys[EDGE_COUNT];
+  int edge;
+
+  if (!wwin->frame)
+    return;
+
+  if (!scr->edge_index)
+    scr->edge_index = wmalloc(sizeof(WEdgeIndex));
+  index = scr->edge_index;
+
+  for (edge = 0; edge < EDGE_COUNT; edge++)
+    keys[edge] = edgeKey(wwin, edge);
+
+  for (edge = 0; edge < EDGE_COUNT; edge++) {
+    if (!edgeIndexContains(index, edge, wwin, keys[edge]))
+      break;
+  }
+  if (edge == EDGE_COUNT)
+    return;
+
+  edgeIndexRemove(index, wwin);
+  edgeIndexInsert(index, wwin, keys);
+}
+
+void wEdgeIndexRemoveWindow(WWindow *wwin)
+{
+  if (wwin->screen->edge_index)
+    edgeIndexRemove(wwin->screen->edge_index, wwin);
+}
+
+/* Number of windows in `list` which edge key is less than `key`. */
+static int countEdgesBefore(WWindow **list, int count, int edge, int key)
+{
+  int low = 0, high = count, mid;
+
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (edgeKey(list[mid], edge) < key)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
 }
 
 static void updateResistance(MoveData *data, int newX, int newY)
@@ -773,33 +876,14 @@ static void updateResistance(MoveData *data, int newX, int newY)
   if (!ok)
     return;
 
-  /* TODO: optimize this */
-  if (data->realY < WBOTTOM(data->bottomList[0])) {
-    data->bottomIndex = 0;
-  }
-  if (data->realX < WRIGHT(data->rightList[0])) {
-    data->rightIndex = 0;
-  }
-  if ((data->realX + data->winWidth) > WLEFT(data->leftList[0])) {
-    data->leftIndex = 0;
-  }
-  if ((data->realY + data->winHeight) > WTOP(data->topList[0])) {
-    data->topIndex = 0;
-  }
-  for (i = 0; i < data->count; i++) {
-    if (data->realY > WBOTTOM(data->bottomList[i])) {
-      data->bottomIndex = i + 1;
-    }
-    if (data->realX > WRIGHT(data->rightList[i])) {
-      data->rightIndex = i + 1;
-    }
-    if ((data->realX + data->winWidth) < WLEFT(data->leftList[i])) {
-      data->leftIndex = i + 1;
-    }
-    if ((data->realY + data->winHeight) < WTOP(data->topList[i])) {
-      data->topIndex = i + 1;
-    }
-  }
+  data->bottomIndex = countEdgesBefore(data->bottomList, data->count, EDGE_BOTTOM,
+                                       data->realY);
+  data->rightIndex = countEdgesBefore(data->rightList, data->count, EDGE_RIGHT,
+                                      data->realX);
+  data->leftIndex = countEdgesBefore(data->leftList, data->count, EDGE_LEFT,
+                                     -(data->realX + data->winWidth));
+  data->topIndex = countEdgesBefore(data->topList, data->count, EDGE_TOP,
+                                    -(data->realY + data->winHeight));
 }
 
 static void freeMoveData(MoveData * data)
@@ -812,95 +896,84 @@ static void freeMoveData(MoveData * data)
     wfree(data->rightList);
   if (data->bottomList)
     wfree(data->bottomList);
+  if (data->headEdges)
+    wfree(data->headEdges);
 }
 
 static void updateMoveData(WWindow * wwin, MoveData * data)
 {
   WScreen *scr = wwin->screen;
+  WEdgeIndex *index = scr->edge_index;
   WWindow *tmp;
-  int i;
+  int edge, i;
+  WWindow **lists[EDGE_COUNT];
 
-  data->count = 0;
-  tmp = scr->focused_window;
-  while (tmp) {
-    if (tmp != wwin && scr->current_desktop == tmp->frame->desktop
-        && !tmp->flags.miniaturized
-        && !tmp->flags.hidden && !tmp->flags.obscured && !WFLAGP(tmp, sunken)) {
-      data->topList[data->count] = tmp;
-      data->leftList[data->count] = tmp;
-      data->rightList[data->count] = tmp;
-      data->bottomList[data->count] = tmp;
-      data->count++;
-    }
-    tmp = tmp->prev;
+  /* windows may have been mapped since the move started */
+  if (index->count > data->size) {
+    data->size = index->count;
+    data->topList = wrealloc(data->topList, sizeof(WWindow *) * data->size);
+    data->leftList = wrealloc(data->leftList, sizeof(WWindow *) * data->size);
+    data->rightList = wrealloc(data->rightList, sizeof(WWindow *) * data->size);
+    data->bottomList = wrealloc(data->bottomList, sizeof(WWindow *) * data->size);
   }
 
-  if (data->count == 0) {
-    data->topIndex = 0;
-    data->leftIndex = 0;
-    data->rightIndex = 0;
-    data->bottomIndex = 0;
-    return;
-  }
+  lists[EDGE_TOP] = data->topList;
+  lists[EDGE_LEFT] = data->leftList;
+  lists[EDGE_RIGHT] = data->rightList;
+  lists[EDGE_BOTTOM] = data->bottomList;
 
   /* order from closest to the border of the screen to farthest */
 
-  qsort(data->topList, data->count, sizeof(data->topList[0]), compareWTop);
-  qsort(data->leftList, data->count, sizeof(data->leftList[0]), compareWLeft);
-  qsort(data->rightList, data->count, sizeof(data->rightList[0]), compareWRight);
-  qsort(data->bottomList, data->count, sizeof(data->bottomList[0]), compareWBottom);
+  for (edge = 0; edge < EDGE_COUNT; edge++) {
+    data->count = 0;
+    for (i = 0; i < index->count; i++) {
+      tmp = index->edges[edge][i].wwin;
+      if (tmp != wwin && scr->current_desktop == tmp->frame->desktop
+          && !tmp->flags.miniaturized
+          && !tmp->flags.hidden && !tmp->flags.obscured && !WFLAGP(tmp, sunken)) {
+        lists[edge][data->count++] = tmp;
+      }
+    }
+  }
 
   /* figure the position of the window relative to the others */
 
-  data->topIndex = -1;
-  data->leftIndex = -1;
-  data->rightIndex = -1;
-  data->bottomIndex = -1;
-
-  if (WTOP(wwin) < WBOTTOM(data->bottomList[0])) {
-    data->bottomIndex = 0;
-  }
-  if (WLEFT(wwin) < WRIGHT(data->rightList[0])) {
-    data->rightIndex = 0;
-  }
-  if (WRIGHT(wwin) > WLEFT(data->leftList[0])) {
-    data->leftIndex = 0;
-  }
-  if (WBOTTOM(wwin) > WTOP(data->topList[0])) {
-    data->topIndex = 0;
-  }
-  for (i = 0; i < data->count; i++) {
-    if (WTOP(wwin) >= WBOTTOM(data->bottomList[i])) {
-      data->bottomIndex = i + 1;
-    }
-    if (WLEFT(wwin) >= WRIGHT(data->rightList[i])) {
-      data->rightIndex = i + 1;
-    }
-    if (WRIGHT(wwin) <= WLEFT(data->leftList[i])) {
-      data->leftIndex = i + 1;
-    }
-    if (WBOTTOM(wwin) <= WTOP(data->topList[i])) {
-      data->topIndex = i + 1;
-    }
-  }
+  data->bottomIndex = countEdgesBefore(data->bottomList, data->count, EDGE_BOTTOM,
+                                       WTOP(wwin) + 1);
+  data->rightIndex = countEdgesBefore(data->rightList, data->count, EDGE_RIGHT,
+                                      WLEFT(wwin) + 1);
+  data->leftIndex = countEdgesBefore(data->leftList, data->count, EDGE_LEFT,
+                                     -WRIGHT(wwin) + 1);
+  data->topIndex = countEdgesBefore(data->topList, data->count, EDGE_TOP,
+                                    -WBOTTOM(wwin) + 1);
 }
 
 static void initMoveData(WWindow * wwin, MoveData * data)
 {
-  int i;
+  WScreen *scr = wwin->screen;
   WWindow *tmp;
+  WMRect rect;
+  int i;
 
   memset(data, 0, sizeof(MoveData));
 
-  for (i = 0, tmp = wwin->screen->focused_window; tmp != NULL; tmp = tmp->prev, i++) ;
+  /* pick up windows and geometry changes which bypassed
+     wWindowConfigure(), e.g. border width of selected windows */
+  for (tmp = scr->focused_window; tmp != NULL; tmp = tmp->prev)
+    wEdgeIndexUpdateWindow(tmp);
 
-  if (i > 1) {
-    data->topList = wmalloc(sizeof(WWindow *) * i);
-    data->leftList = wmalloc(sizeof(WWindow *) * i);
-    data->rightList = wmalloc(sizeof(WWindow *) * i);
-    data->bottomList = wmalloc(sizeof(WWindow *) * i);
+  wEdgeIndexUpdateWindow(wwin);
+  updateMoveData(wwin, data);
 
-    updateMoveData(wwin, data);
+  /* heads don't change while moving, avoid asking the server for the
+     pointer position on every motion to find out the head */
+  data->headEdges = wmalloc(sizeof(WArea) * wScreenHeads(scr));
+  for (i = 0; i < wScreenHeads(scr); i++) {
+    rect = wGetRectForHead(scr, i);
+    data->headEdges[i].x1 = WMAX(scr->totalUsableArea[i].x1, rect.pos.x);
+    data->headEdges[i].x2 = WMIN(scr->totalUsableArea[i].x2, rect.pos.x + rect.size.width);
+    data->headEdges[i].y1 = WMAX(scr->totalUsableArea[i].y1, rect.pos.y);
+    data->headEdges[i].y2 = WMIN(scr->totalUsableArea[i].y2, rect.pos.y + rect.size.height);
   }
 
   data->realX = wwin->frame_x;
@@ -1014,17 +1087,19 @@ updateWindowPosition(WWindow * wwin, MoveData * data, Bool doResistance,
     attract = wPreferences.attract;
     /* horizontal movement: check horizontal edge resistances */
     if (dx || dy) {
-      WMRect rect;
-      int i, head;
+      WMPoint pointer;
+      WArea *head;
+      int i;
       /* window is the leftmost window: check against screen edge */
 
       /* Add inter head resistance 1/2 (if needed) */
-      head = wGetHeadForPointerLocation(scr);
-      rect = wGetRectForHead(scr, head);
+      pointer.x = newMouseX;
+      pointer.y = newMouseY;
+      head = &data->headEdges[wGetHeadForPoint(scr, pointer)];
 
-      l_edge = WMAX(scr->totalUsableArea[head].x1, rect.pos.x);
+      l_edge = head->x1;
       edge_l = l_edge - resist;
-      edge_r = WMIN(scr->totalUsableArea[head].x2, rect.pos.x + rect.size.width);
+      edge_r = head->x2;
       r_edge = edge_r + resist;
 
       /* 1 */
@@ -1122,9 +1197,9 @@ updateWindowPosition(WWindow * wwin, MoveData * data, Bool doResistance,
 
       /* VeRT */
       /* Add inter head resistance 2/2 (if needed) */
-      t_edge = WMAX(scr->totalUsableArea[head].y1, rect.pos.y);
+      t_edge = head->y1;
       edge_t = t_edge - resist;
-      edge_b = WMIN(scr->totalUsableArea[head].y2, rect.pos.y + rect.size.height);
+      edge_b = head->y2;
       b_edge = edge_b + resist;
 
       if ((data->bottomIndex >= 0) && (data->bottomIndex <= data->count)) {
@@ -34,4 +34,10 @@
 #define WDIS_TITLEBAR		4	/* titlebar */
 #define WDIS_NONE		5
 
+struct WWindow;
+
+/* Keep the window in the edge index used by edge resistance of moves. */
+void wEdgeIndexUpdateWindow(struct WWindow *wwin);
+void wEdgeIndexRemoveWindow(struct WWindow *wwin);
+
 #endif /* __WORKSPACE_WM_MOVERES__ */
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 
 #include <core/WMcore.h>
 #include <core/util.h>
@@ -261,97 +262,289 @@ int calcIntersectionArea(int x1, int y1, int w1, int h1, int x2, int y2, int w2,
     * calcIntersectionLength(y1, h1, y2, h2);
 }
 
-static int calcSumOfCoveredAreas(WWindow *wwin, int x, int y, int w, int h)
-{
-  int sum_isect = 0;
-  WWindow *test_window;
-  int tw, tx, ty, th;
+/*
+ * Window coverage of the screen.
+ *
+ * Window edges split the screen into a grid of cells, each covered by a
+ * constant number of windows. `sum` is a summed-area table over that grid,
+ * so the area of a rectangle covered by windows (counted once per window,
+ * as calcIntersectionArea() summed over windows does) is found from four
+ * table corners whatever the number of windows is. Cells of coordinates
+ * are looked up in `xcell`/`ycell` maps, or by binary search if windows
+ * are spread too wide for a map.
+ */
+#define COVERAGE_MAX_MAP 16384
 
-  test_window = wwin->screen->focused_window;
-  for (; test_window != NULL && test_window->prev != NULL;)
-    test_window = test_window->prev;
+typedef struct {
+  int *xs, *ys;              /* sorted distinct window edges */
+  int nx, ny;
+  int *cover;                /* (nx - 1) x (ny - 1) cells: windows over cell */
+  long long *sum;            /* nx x ny: covered area of [xs[0],xs[i]) x [ys[0],ys[j]) */
+  long long *height;         /* nx x ny: covered height of column i under ys[j] */
+  long long *width;          /* nx x ny: covered width of row j left of xs[i] */
+  int *xcell, *ycell;        /* coordinate - xs[0] (ys[0]) -> cell, NULL if too wide */
+} WCoverage;
 
-  for (; test_window != NULL; test_window = test_window->next) {
-    if (test_window->frame->core->stacking->window_level < NSNormalWindowLevel) {
-      continue;
-    }
+static WPlacementStats placementStats;
 
-    tw = test_window->frame->core->width;
-    th = test_window->frame->core->height;
-    tx = test_window->frame_x;
-    ty = test_window->frame_y;
+static unsigned long long placementClock(void)
+{
+  struct timespec ts;
 
-    if (test_window->flags.mapped || (test_window->flags.shaded &&
-                                      test_window->frame->desktop == wwin->screen->current_desktop &&
-                                      !(test_window->flags.miniaturized || test_window->flags.hidden))) {
-      sum_isect += calcIntersectionArea(tx, ty, tw, th, x, y, w, h);
-    }
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static Bool isPlacementObstacle(WWindow *win, Bool ignore_sunken)
+{
+  if (ignore_sunken &&
+      win->frame->core->stacking->window_level < NSNormalWindowLevel) {
+    return False;
   }
 
-  return sum_isect;
+  return (win->flags.mapped ||
+          (win->flags.shaded &&
+           win->frame->desktop == win->screen->current_desktop &&
+           !(win->flags.miniaturized || win->flags.hidden)));
 }
 
-static void set_width_height(WWindow *wwin, unsigned int *width, unsigned int *height)
+static int compareInts(const void *a, const void *b)
 {
-  if (wwin->frame) {
-    *height += wwin->frame->top_width + wwin->frame->bottom_width;
-  } else {
-    if (HAS_TITLEBAR(wwin))
-      *height += TITLEBAR_HEIGHT;
-    if (HAS_RESIZEBAR(wwin))
-      *height += RESIZEBAR_HEIGHT;
-  }
-  if (HAS_BORDER(wwin)) {
-    *height += 2 * wwin->screen->frame_border_width;
-    *width  += 2 * wwin->screen->frame_border_width;
-  }
+  return *(const int *)a - *(const int *)b;
 }
 
-static Bool
-window_overlaps(WWindow *win, int x, int y, int w, int h, Bool ignore_sunken)
+static int uniqueInts(int *array, int count)
 {
-  int tw, th, tx, ty;
+  int i, n;
 
-  if (ignore_sunken &&
-      win->frame->core->stacking->window_level < NSNormalWindowLevel) {
-    return False;
+  qsort(array, count, sizeof(int), compareInts);
+  for (i = 0, n = 0; i < count; i++) {
+    if (n == 0 || array[n - 1] != array[i])
+      array[n++] = array[i];
   }
+  return n;
+}
 
-  tw = win->frame->core->width;
-  th = win->frame->core->height;
-  tx = win->frame_x;
-  ty = win->frame_y;
-
-  if ((tx < (x + w)) && ((tx + tw) > x) &&
-      (ty < (y + h)) && ((ty + th) > y) &&
-      (win->flags.mapped ||
-       (win->flags.shaded &&
-        win->frame->desktop == win->screen->current_desktop &&
-        !(win->flags.miniaturized || win->flags.hidden)))) {
-    return True;
+/* Index of the last element <= value, 0 if there is none */
+static int findEdge(const int *array, int count, int value)
+{
+  int lo = 0, hi = count - 1, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (array[mid] <= value)
+      lo = mid;
+    else
+      hi = mid - 1;
   }
+  return lo;
+}
+
+/* Cell of every coordinate from edges[0] to edges[count - 1]. */
+static int *makeCellMap(const int *edges, int count)
+{
+  int span = edges[count - 1] - edges[0];
+  int *map, c, i;
 
-  return False;
+  if (span > COVERAGE_MAX_MAP)
+    return NULL;
+
+  map = wmalloc((span + 1) * sizeof(int));
+  for (c = 0, i = 0; i <= span; i++) {
+    while (c < count - 2 && edges[0] + i >= edges[c + 1])
+      c++;
+    map[i] = c;
+  }
+  return map;
 }
 
-static Bool
-screen_has_space(WScreen *scr, int x, int y, int w, int h, Bool ignore_sunken)
+static void initCoverage(WCoverage *cov, WScreen *scr, Bool ignore_sunken)
 {
-  WWindow *focused = scr->focused_window, *i;
+  WWindow *win;
+  int *rects, count, i, j, x0, x1, y0, y1;
+  int *diff;
+  long long area;
+
+  memset(cov, 0, sizeof(WCoverage));
+
+  count = 0;
+  for (win = scr->focused_window; win && win->prev; win = win->prev)
+    ;
+  for (; win; win = win->next) {
+    if (win->frame && isPlacementObstacle(win, ignore_sunken))
+      count++;
+  }
+  if (count == 0)
+    return;
+
+  rects = wmalloc(count * 4 * sizeof(int));
+  cov->xs = wmalloc(count * 2 * sizeof(int));
+  cov->ys = wmalloc(count * 2 * sizeof(int));
+
+  i = 0;
+  for (win = scr->focused_window; win && win->prev; win = win->prev)
+    ;
+  for (; win && i < count; win = win->next) {
+    if (!win->frame || !isPlacementObstacle(win, ignore_sunken))
+      continue;
+    rects[i * 4] = win->frame_x;
+    rects[i * 4 + 1] = win->frame_y;
+    rects[i * 4 + 2] = win->frame_x + win->frame->core->width;
+    rects[i * 4 + 3] = win->frame_y + win->frame->core->height;
+    cov->xs[i * 2] = rects[i * 4];
+    cov->xs[i * 2 + 1] = rects[i * 4 + 2];
+    cov->ys[i * 2] = rects[i * 4 + 1];
+    cov->ys[i * 2 + 1] = rects[i * 4 + 3];
+    i++;
+  }
+  count = i;
+
+  cov->nx = uniqueInts(cov->xs, count * 2);
+  cov->ny = uniqueInts(cov->ys, count * 2);
+  if (cov->nx < 2 || cov->ny < 2) {
+    cov->nx = cov->ny = 0;
+    wfree(rects);
+    return;
+  }
+
+  /* 2D difference array of window corners, prefix sums give cell cover */
+  diff = wmalloc(cov->nx * cov->ny * sizeof(int));
+  for (i = 0; i < count; i++) {
+    x0 = findEdge(cov->xs, cov->nx, rects[i * 4]);
+    y0 = findEdge(cov->ys, cov->ny, rects[i * 4 + 1]);
+    x1 = findEdge(cov->xs, cov->nx, rects[i * 4 + 2]);
+    y1 = findEdge(cov->ys, cov->ny, rects[i * 4 + 3]);
+    diff[x0 * cov->ny + y0]++;
+    diff[x1 * cov->ny + y0]--;
+    diff[x0 * cov->ny + y1]--;
+    diff[x1 * cov->ny + y1]++;
+  }
 
-  for (i = focused; i; i = i->next) {
-    if (window_overlaps(i, x, y, w, h, ignore_sunken)) {
-      return False;
+  cov->cover = wmalloc((cov->nx - 1) * (cov->ny - 1) * sizeof(int));
+  cov->sum = wmalloc(cov->nx * cov->ny * sizeof(long long));
+  for (i = 0; i < cov->nx - 1; i++) {
+    for (j = 0; j < cov->ny - 1; j++) {
+      int c = diff[i * cov->ny + j];
+
+      if (i > 0)
+        c += cov->cover[(i - 1) * (cov->ny - 1) + j];
+      if (j > 0)
+        c += cov->cover[i * (cov->ny - 1) + j - 1];
+      if (i > 0 && j > 0)
+        c -= cov->cover[(i - 1) * (cov->ny - 1) + j - 1];
+      cov->cover[i * (cov->ny - 1) + j] = c;
+    }
+  }
+  for (i = 1; i < cov->nx; i++) {
+    for (j = 1; j < cov->ny; j++) {
+      area = (long long)cov->cover[(i - 1) * (cov->ny - 1) + j - 1]
+        * (cov->xs[i] - cov->xs[i - 1]) * (cov->ys[j] - cov->ys[j - 1]);
+      cov->sum[i * cov->ny + j] = area + cov->sum[(i - 1) * cov->ny + j]
+        + cov->sum[i * cov->ny + j - 1] - cov->sum[(i - 1) * cov->ny + j - 1];
     }
   }
 
-  for (i = focused; i; i = i->prev) {
-    if (window_overlaps(i, x, y, w, h, ignore_sunken)) {
-      return False;
+  cov->height = wmalloc(cov->nx * cov->ny * sizeof(long long));
+  cov->width = wmalloc(cov->nx * cov->ny * sizeof(long long));
+  for (i = 0; i < cov->nx - 1; i++) {
+    for (j = 0; j < cov->ny - 1; j++) {
+      cov->height[i * cov->ny + j] = (cov->sum[(i + 1) * cov->ny + j] - cov->sum[i * cov->ny + j])
+        / (cov->xs[i + 1] - cov->xs[i]);
+      cov->width[i * cov->ny + j] = (cov->sum[i * cov->ny + j + 1] - cov->sum[i * cov->ny + j])
+        / (cov->ys[j + 1] - cov->ys[j]);
     }
   }
 
-  return True;
+  cov->xcell = makeCellMap(cov->xs, cov->nx);
+  cov->ycell = makeCellMap(cov->ys, cov->ny);
+
+  wfree(diff);
+  wfree(rects);
+}
+
+static void destroyCoverage(WCoverage *cov)
+{
+  if (cov->xs)
+    wfree(cov->xs);
+  if (cov->ys)
+    wfree(cov->ys);
+  if (cov->cover)
+    wfree(cov->cover);
+  if (cov->sum)
+    wfree(cov->sum);
+  if (cov->height)
+    wfree(cov->height);
+  if (cov->width)
+    wfree(cov->width);
+  if (cov->xcell)
+    wfree(cov->xcell);
+  if (cov->ycell)
+    wfree(cov->ycell);
+  memset(cov, 0, sizeof(WCoverage));
+}
+
+/* Covered area of [xs[0],x) x [ys[0],y) - bilinear inside of a cell */
+static inline long long coveredAreaTo(WCoverage *cov, int x, int y)
+{
+  int i, j, k, dx, dy;
+
+  if (x <= cov->xs[0] || y <= cov->ys[0])
+    return 0;
+  if (x > cov->xs[cov->nx - 1])
+    x = cov->xs[cov->nx - 1];
+  if (y > cov->ys[cov->ny - 1])
+    y = cov->ys[cov->ny - 1];
+
+  if (cov->xcell) {
+    i = cov->xcell[x - cov->xs[0]];
+  } else {
+    /* last edge belongs to the cell before it */
+    i = findEdge(cov->xs, cov->nx, x);
+    if (i > cov->nx - 2)
+      i = cov->nx - 2;
+  }
+  if (cov->ycell) {
+    j = cov->ycell[y - cov->ys[0]];
+  } else {
+    j = findEdge(cov->ys, cov->ny, y);
+    if (j > cov->ny - 2)
+      j = cov->ny - 2;
+  }
+
+  dx = x - cov->xs[i];
+  dy = y - cov->ys[j];
+  k = i * cov->ny + j;
+
+  return cov->sum[k] + dx * cov->height[k] + dy * cov->width[k]
+    + (long long)dx * dy * cov->cover[i * (cov->ny - 1) + j];
+}
+
+/* Sum of window areas intersecting with rectangle */
+static long long coveredArea(WCoverage *cov, int x, int y, int w, int h)
+{
+  placementStats.queries++;
+
+  if (cov->nx == 0)
+    return 0;
+
+  return coveredAreaTo(cov, x + w, y + h) - coveredAreaTo(cov, x, y + h)
+    - coveredAreaTo(cov, x + w, y) + coveredAreaTo(cov, x, y);
+}
+
+static void set_width_height(WWindow *wwin, unsigned int *width, unsigned int *height)
+{
+  if (wwin->frame) {
+    *height += wwin->frame->top_width + wwin->frame->bottom_width;
+  } else {
+    if (HAS_TITLEBAR(wwin))
+      *height += TITLEBAR_HEIGHT;
+    if (HAS_RESIZEBAR(wwin))
+      *height += RESIZEBAR_HEIGHT;
+  }
+  if (HAS_BORDER(wwin)) {
+    *height += 2 * wwin->screen->frame_border_width;
+    *width  += 2 * wwin->screen->frame_border_width;
+  }
 }
 
 static void
@@ -361,20 +554,23 @@ smartPlaceWindow(WWindow *wwin, int *x_ret, int *y_ret, unsigned int width,
   int test_x = 0, test_y = Y_ORIGIN;
   int from_x, to_x, from_y, to_y;
   int sx;
-  int min_isect, min_isect_x, min_isect_y;
-  int sum_isect;
+  int min_isect_x, min_isect_y;
+  long long min_isect, sum_isect;
+  unsigned long long start = placementClock();
+  WCoverage cov;
 
   set_width_height(wwin, &width, &height);
+  initCoverage(&cov, wwin->screen, True);
 
   sx = X_ORIGIN;
-  min_isect = INT_MAX;
+  min_isect = LLONG_MAX;
   min_isect_x = sx;
   min_isect_y = test_y;
 
   while (((test_y + height) < usableArea.y2)) {
     test_x = sx;
     while ((test_x + width) < usableArea.x2) {
-      sum_isect = calcSumOfCoveredAreas(wwin, test_x, test_y, width, height);
+      sum_isect = coveredArea(&cov, test_x, test_y, width, height);
 
       if (sum_isect < min_isect) {
         min_isect = sum_isect;
@@ -401,7 +597,7 @@ smartPlaceWindow(WWindow *wwin, int *x_ret, int *y_ret, unsigned int width,
 
   for (test_x = from_x; test_x < to_x; test_x++) {
     for (test_y = from_y; test_y < to_y; test_y++) {
-      sum_isect = calcSumOfCoveredAreas(wwin, test_x, test_y, width, height);
+      sum_isect = coveredArea(&cov, test_x, test_y, width, height);
 
       if (sum_isect < min_isect) {
         min_isect = sum_isect;
@@ -411,6 +607,10 @@ smartPlaceWindow(WWindow *wwin, int *x_ret, int *y_ret, unsigned int width,
     }
   }
 
+  destroyCoverage(&cov);
+  placementStats.placements++;
+  placementStats.usecs += placementClock() - start;
+
   *x_ret = min_isect_x;
   *y_ret = min_isect_y;
 }
@@ -442,32 +642,52 @@ autoPlaceWindow(WWindow *wwin, int *x_ret, int *y_ret,
   WScreen *scr = wwin->screen;
   int x, y;
   int sw, sh;
+  unsigned long long start = placementClock();
+  WCoverage all, sunken;
+  WCoverage *cov = &all;
+  Bool found = False;
 
   set_width_height(wwin, &width, &height);
   sw = usableArea.x2 - usableArea.x1;
   sh = usableArea.y2 - usableArea.y1;
 
+  initCoverage(&all, scr, False);
+
   /* try placing at center first */
   if (center_place_window(wwin, &x, &y, width, height, usableArea) &&
-      screen_has_space(scr, x, y, width, height, False)) {
-    *x_ret = x;
-    *y_ret = y;
-    return True;
+      coveredArea(&all, x, y, width, height) == 0) {
+    found = True;
+  }
+
+  if (!found && ignore_sunken) {
+    initCoverage(&sunken, scr, True);
+    cov = &sunken;
   }
 
   /* this was based on fvwm2's smart placement */
-  for (y = Y_ORIGIN; (y + height) < sh; y += PLACETEST_VSTEP) {
+  for (y = Y_ORIGIN; !found && (y + height) < sh; y += PLACETEST_VSTEP) {
     for (x = X_ORIGIN; (x + width) < sw; x += PLACETEST_HSTEP) {
-      if (screen_has_space(scr, x, y,
-                           width, height, ignore_sunken)) {
-        *x_ret = x;
-        *y_ret = y;
-        return True;
+      if (coveredArea(cov, x, y, width, height) == 0) {
+        found = True;
+        break;
       }
     }
+    if (found)
+      break;
+  }
+
+  if (cov != &all)
+    destroyCoverage(cov);
+  destroyCoverage(&all);
+  placementStats.placements++;
+  placementStats.usecs += placementClock() - start;
+
+  if (found) {
+    *x_ret = x;
+    *y_ret = y;
   }
 
-  return False;
+  return found;
 }
 
 static void
@@ -503,6 +723,11 @@ static void randomPlaceWindow(WWindow *wwin, int *x_ret, int *y_ret,
   *y_ret = Y_ORIGIN + rand() % h;
 }
 
+void wGetPlacementStats(WPlacementStats *stats)
+{
+  *stats = placementStats;
+}
+
 void PlaceWindow(WWindow *wwin, int *x_ret, int *y_ret, unsigned width, unsigned height)
 {
   WScreen *scr = wwin->screen;
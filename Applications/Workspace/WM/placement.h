@@ -37,6 +37,15 @@ int calcIntersectionArea(int x1, int y1, int w1, int h1, int x2, int y2, int w2,
 
 void PlaceWindow(struct WWindow *wwin, int *x_ret, int *y_ret, unsigned width, unsigned height);
 
+/* Smart and automatic placement counters since startup */
+typedef struct WPlacementStats {
+  unsigned long placements;
+  unsigned long queries;       /* overlap area queries */
+  unsigned long long usecs;    /* time spent placing */
+} WPlacementStats;
+
+void wGetPlacementStats(WPlacementStats *stats);
+
 void InteractivePlaceWindow(struct WWindow * wwin, int *x_ret, int *y_ret, unsigned width, unsigned height);
 
 /* Set the points x and y inside the screen */
@@ -118,6 +118,8 @@ typedef struct _WScreen {
 
   int window_count;		       /* number of windows in window_list */
 
+  struct WEdgeIndex *edge_index;     /* windows sorted by frame edges */
+
   struct WDesktop **desktops;          /* workspace array */
   int desktop_count;                   /* number of workspaces */
   int current_desktop;                 /* current workspace number */
@@ -239,6 +241,9 @@ typedef struct _WScreen {
 
   struct RContext *rcontext;	       /* wrlib context */
 
+  struct WFramePixmaps *frame_pixmaps; /* rendered frame textures, MRU first */
+  unsigned long frame_pixmaps_size;  /* bytes of pixmaps in frame_pixmaps */
+
   WMScreen *wmscreen;		       /* for widget library */
 
   struct RImage *icon_tile;
@@ -41,6 +41,8 @@
 #include "wmspec.h"
 #include "colormap.h"
 #include "shutdown.h"
+#include "winmap.h"
+#include "placement.h"
 
 #import <Workspace+WM.h>
 
@@ -76,6 +78,26 @@ static void _wipeDesktop(WScreen * scr)
   XSync(dpy, False);
 }
 
+static void _logStatistics(void)
+{
+  WWindowMapStats stats;
+  WPlacementStats placement;
+
+  wWindowMapGetStats(&stats);
+  if (stats.events > 0 && stats.lookups > 0) {
+    WMLogInfo("window lookups: %lu in %lu events (%.2f per event), %lu misses, %.2f probes per lookup",
+              stats.lookups, stats.events, (double)stats.lookups / stats.events,
+              stats.misses, (double)stats.probes / stats.lookups);
+  }
+
+  wGetPlacementStats(&placement);
+  if (placement.placements > 0) {
+    WMLogInfo("window placement: %lu windows, %lu overlap queries, %.1f ms per window",
+              placement.placements, placement.queries,
+              placement.usecs / 1000.0 / placement.placements);
+  }
+}
+
 /*
  *----------------------------------------------------------------------
  * Shutdown-
@@ -110,6 +132,7 @@ void wShutdown(WMShutdownMode mode)
     // Stop events processing inside Window Decorator
     CFRunLoopStop(wm_runloop);
     WCHANGE_STATE(WSTATE_EXITING);
+    _logStatistics();
 
     wScreenSaveState(scr);
     wNETWMCleanup(scr);		/* Delete _NET_* Atoms */
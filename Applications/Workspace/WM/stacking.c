@@ -29,6 +29,8 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
+#include <CoreFoundation/CFNotificationQueue.h>
+
 #include <core/util.h>
 #include <core/log_utils.h>
 
@@ -39,7 +41,24 @@
 #include "properties.h"
 #include "stacking.h"
 #include "desktop.h"
+#include "winmap.h"
+
+#include <Workspace+WM.h>
+
+/* Restacking a group of windows changes stacking many times while one
+   event is handled. Observers only need the final stacking - coalesce
+   notifications and deliver them once per run loop pass. */
+static Bool __postStackingNotification(CFStringRef name, void *object, CFDictionaryRef info)
+{
+  CFNotificationCenterRef center = CFNotificationCenterGetLocalCenter();
 
+  if (wm_runloop && CFRunLoopGetCurrent() == wm_runloop) {
+    CFNotificationCenterEnqueueNotification(center, name, object, info);
+    return True;
+  }
+  CFNotificationCenterPostNotification(center, name, object, info, TRUE);
+  return False;
+}
 
 static void __notifyStackChange(WCoreWindow *frame, char *detail)
 {
@@ -53,9 +72,11 @@ static void __notifyStackChange(WCoreWindow *frame, char *detail)
   dString = CFStringCreateWithCString(kCFAllocatorDefault, detail, kCFStringEncodingUTF8);
   CFDictionaryAddValue(info, CFSTR("detail"), dString);
   
-  CFNotificationCenterPostNotification(CFNotificationCenterGetLocalCenter(),
-                                       WMDidChangeWindowStackingNotification,
-                                       wwin, info, TRUE);
+  /* Coalesced per-window changes arrive after the whole restack and in no
+     particular order - observers can't reposition windows one by one from
+     them. Queue one reset for the screen so the stacking is re-read. */
+  if (__postStackingNotification(WMDidChangeWindowStackingNotification, wwin, info))
+    __postStackingNotification(WMDidResetWindowStackingNotification, frame->screen_ptr, NULL);
   CFRelease(dString);
   CFRelease(info);
 }
@@ -92,10 +113,7 @@ void RemakeStackList(WScreen * scr)
     /* verify list integrity */
     c = 0;
     for (i = 0; i < nwindows; i++) {
-      if (XFindContext(dpy, windows[i], w_global.context.stack, (XPointer *) & frame)
-          == XCNOENT) {
-        continue;
-      }
+      frame = wWindowMapFind(w_global.context.stack, windows[i]);
       if (!frame)
         continue;
       c++;
@@ -144,9 +162,7 @@ void CommitStacking(WScreen * scr)
   }
   XRestackWindows(dpy, windows, i);
   wfree(windows);
-  CFNotificationCenterPostNotification(CFNotificationCenterGetLocalCenter(),
-                                       WMDidResetWindowStackingNotification,
-                                       scr, NULL, TRUE);
+  __postStackingNotification(WMDidResetWindowStackingNotification, scr, NULL);
 }
 
 /*
@@ -421,7 +437,7 @@ void AddToStackList(WCoreWindow * frame)
   WCoreWindow *trans = NULL;
 
   frame->screen_ptr->window_count++;
-  XSaveContext(dpy, frame->window, w_global.context.stack, (XPointer) frame);
+  wWindowMapSave(w_global.context.stack, frame->window, frame);
   curtop = WMGetFromBag(scr->stacking_list, index);
 
   /* first window in this level */
@@ -526,9 +542,7 @@ void MoveInStackListAbove(WCoreWindow * next, WCoreWindow * frame)
     moveFrameToUnder(frame->stacking->above, frame);
   }
 
-  CFNotificationCenterPostNotification(CFNotificationCenterGetLocalCenter(),
-                                       WMDidResetWindowStackingNotification,
-                                       scr, NULL, TRUE);
+  __postStackingNotification(WMDidResetWindowStackingNotification, scr, NULL);
 }
 
 /*
@@ -572,16 +586,14 @@ void MoveInStackListUnder(WCoreWindow * prev, WCoreWindow * frame)
   prev->stacking->under = frame;
   moveFrameToUnder(prev, frame);
 
-  CFNotificationCenterPostNotification(CFNotificationCenterGetLocalCenter(),
-                                       WMDidResetWindowStackingNotification,
-                                       scr, NULL, TRUE);
+  __postStackingNotification(WMDidResetWindowStackingNotification, scr, NULL);
 }
 
 void RemoveFromStackList(WCoreWindow * frame)
 {
   int index = frame->stacking->window_level;
 
-  if (XDeleteContext(dpy, frame->window, w_global.context.stack) == XCNOENT) {
+  if (!wWindowMapDelete(w_global.context.stack, frame->window)) {
     WMLogWarning("RemoveFromStackingList(): window not in list ");
     return;
   }
@@ -595,9 +607,7 @@ void RemoveFromStackList(WCoreWindow * frame)
 
   frame->screen_ptr->window_count--;
 
-  CFNotificationCenterPostNotification(CFNotificationCenterGetLocalCenter(),
-                                       WMDidResetWindowStackingNotification,
-                                       frame->screen_ptr, NULL, TRUE);
+  __postStackingNotification(WMDidResetWindowStackingNotification, frame->screen_ptr, NULL);
 }
 
 void ChangeStackingLevel(WCoreWindow * frame, int new_level)
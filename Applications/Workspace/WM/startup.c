@@ -80,6 +80,7 @@
 #include "xmodifier.h"
 #include "dock.h"
 #include "application.h"
+#include "winmap.h"
 
 /****** Global ******/
 Display *dpy;
@@ -643,9 +644,9 @@ void wStartUp(Bool defaultScreenOnly)
 
   memset(&wKeyBindings, 0, sizeof(wKeyBindings));
 
-  w_global.context.client_win = XUniqueContext();
-  w_global.context.app_win = XUniqueContext();
-  w_global.context.stack = XUniqueContext();
+  w_global.context.client_win = wWindowMapCreate();
+  w_global.context.app_win = wWindowMapCreate();
+  w_global.context.stack = wWindowMapCreate();
 
   /* _XA_VERSION = XInternAtom(dpy, "VERSION", False); */
 
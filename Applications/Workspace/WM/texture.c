@@ -38,6 +38,7 @@
 #include "WM.h"
 #include "texture.h"
 #include "window.h"
+#include "framewin.h"
 #include "misc.h"
 
 
@@ -129,6 +130,8 @@ void wTextureDestroy(WScreen * scr, WTexture * texture)
   int count = 0;
   unsigned long colors[8];
 
+  wFrameWindowForgetTexture(scr, texture);
+
   /*
    * some stupid servers don't like white or black being freed...
    */
@@ -33,6 +33,7 @@
 #include "WM.h"
 #include "wcore.h"
 #include "defaults.h"
+#include "winmap.h"
 
 /*----------------------------------------------------------------------
  * wCoreCreateTopLevel--
@@ -74,7 +75,7 @@ WCoreWindow *wCoreCreateTopLevel(WScreen *screen, int x, int y, int width, int h
   core->descriptor.self = core;
 
   XClearWindow(dpy, core->window);
-  XSaveContext(dpy, core->window, w_global.context.client_win, (XPointer) & core->descriptor);
+  wWindowMapSave(w_global.context.client_win, core->window, &core->descriptor);
 
   return core;
 }
@@ -118,7 +119,7 @@ WCoreWindow *wCoreCreate(WCoreWindow *parent, int x, int y, int width, int heigh
   core->screen_ptr = parent->screen_ptr;
   core->descriptor.self = core;
 
-  XSaveContext(dpy, core->window, w_global.context.client_win, (XPointer) & core->descriptor);
+  wWindowMapSave(w_global.context.client_win, core->window, &core->descriptor);
   return core;
 }
 
@@ -127,7 +128,7 @@ void wCoreDestroy(WCoreWindow * core)
   if (core->stacking)
     wfree(core->stacking);
 
-  XDeleteContext(dpy, core->window, w_global.context.client_win);
+  wWindowMapDelete(w_global.context.client_win, core->window);
   XDestroyWindow(dpy, core->window);
   wfree(core);
 }
@@ -37,6 +37,7 @@
 #include <math.h>
 
 #include <CoreFoundation/CFNumber.h>
+#include <CoreFoundation/CFNotificationQueue.h>
 
 #include <core/WMcore.h>
 #include <core/util.h>
@@ -72,6 +73,8 @@
 #include "iconyard.h"
 #include "application.h"
 #include "appmenu.h"
+#include "winmap.h"
+#include "moveres.h"
 
 #ifdef USE_MWM_HINTS
 # include "motif.h"
@@ -110,6 +113,8 @@ static void appearanceObserver(CFNotificationCenterRef center,
 {
   WWindow *wwin = (WWindow *)observedWindow;
   uintptr_t flags = (uintptr_t)settingsFlags;
+  uintptr_t parts = flags & WFramePartSettings;
+  int i;
 
   if (!wwin->frame || (!wwin->frame->titlebar && !wwin->frame->resizebar))
     return;
@@ -122,8 +127,22 @@ static void appearanceObserver(CFNotificationCenterRef center,
       wWindowSynthConfigureNotify(wwin);
     }
   }
-  if (flags & WTextureSettings)
-    wwin->frame->flags.need_texture_remake = 1;
+  if (flags & WTextureSettings) {
+    if (!parts) {
+      wwin->frame->flags.need_texture_remake = 1;
+    } else {
+      for (i = 0; i < 3; i++) {
+        if (parts & WTitleStateSettings(i))
+          wwin->frame->flags.stale_textures |= WFRAME_TITLE_TEXTURE(i);
+      }
+      if (parts & WResizebarSettings)
+        wwin->frame->flags.stale_textures |= WFRAME_RESIZEBAR_TEXTURE;
+    }
+  }
+
+  /* titlebar of other states is updated when the window switches to them */
+  if (parts && !(parts & (WTitleStateSettings(wwin->frame->flags.state) | WResizebarSettings)))
+    return;
 
   if (flags & (WTextureSettings | WColorSettings)) {
     if (wwin->frame->titlebar)
@@ -142,7 +161,8 @@ WWindow *wWindowFor(Window window)
   if (window == None)
     return NULL;
 
-  if (XFindContext(dpy, window, w_global.context.client_win, (XPointer *) & desc) == XCNOENT)
+  desc = wWindowMapFind(w_global.context.client_win, window);
+  if (!desc)
     return NULL;
 
   if (desc->parent_type == WCLASS_WINDOW)
@@ -186,6 +206,10 @@ void wWindowDestroy(WWindow *wwin)
 
   wwin->flags.destroyed = 1;
 
+  wEdgeIndexRemoveWindow(wwin);
+  /* stacking notifications are delivered later */
+  CFNotificationCenterDequeueNotifications(CFNotificationCenterGetLocalCenter(), NULL, wwin);
+
   for (i = 0; i < MAX_WINDOW_SHORTCUTS; i++) {
     if (!wwin->screen->shortcutWindows[i])
       continue;
@@ -231,7 +255,7 @@ void wWindowDestroy(WWindow *wwin)
   if (wwin->cmap_windows)
     XFree(wwin->cmap_windows);
 
-  XDeleteContext(dpy, wwin->client_win, w_global.context.client_win);
+  wWindowMapDelete(w_global.context.client_win, wwin->client_win);
 
   if (wwin->frame)
     wFrameWindowDestroy(wwin->frame);
@@ -658,7 +682,7 @@ WWindow *wManageWindow(WScreen *scr, Window window)
   else if (!wGetWindowName(dpy, window, &title))
     title = NULL;
 
-  XSaveContext(dpy, window, w_global.context.client_win, (XPointer) & wwin->client_descriptor);
+  wWindowMapSave(w_global.context.client_win, window, &wwin->client_descriptor);
 
 #ifdef USE_XSHAPE
   if (w_global.xext.shape.supported) {
@@ -1401,7 +1425,7 @@ WWindow *wManageInternalWindow(WScreen *scr, Window window, Window owner,
                                    scr->resizebar_texture, scr->window_title_color, &scr->title_font,
                                    scr->w_depth, scr->w_visual, scr->w_colormap);
 
-  XSaveContext(dpy, window, w_global.context.client_win, (XPointer) & wwin->client_descriptor);
+  wWindowMapSave(w_global.context.client_win, window, &wwin->client_descriptor);
 
   wwin->frame->flags.is_client_window_frame = 1;
   wwin->frame->flags.justification = wPreferences.title_justification;
@@ -2191,6 +2215,7 @@ void wWindowConfigure(WWindow *wwin, int req_x, int req_y, int req_width, int re
     wwin->client.x += wwin->screen->frame_border_width;
     wwin->client.y += wwin->screen->frame_border_width;
   }
+  wEdgeIndexUpdateWindow(wwin);
 #ifdef USE_XSHAPE
   if (w_global.xext.shape.supported && wwin->flags.shaped && resize)
     wWindowSetShape(wwin);
@@ -2233,6 +2258,7 @@ void wWindowMove(WWindow *wwin, int req_x, int req_y)
 
   wwin->frame_x = req_x;
   wwin->frame_y = req_y;
+  wEdgeIndexUpdateWindow(wwin);
 
 #ifdef CONFIGURE_WINDOW_WHILE_MOVING
   if (synth_notify)
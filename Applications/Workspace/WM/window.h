@@ -290,6 +290,7 @@ typedef struct WWindow {
   int icon_x, icon_y;                   /* position of the icon */
   int icon_w, icon_h;
   RImage *net_icon_image;               /* Window Image */
+  unsigned long net_icon_hash;          /* of _NET_WM_ICON image data */
   Atom type;
 } WWindow;
 
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
@@ -216,39 +217,13 @@ static const char *getString(CFStringRef key, CFTypeRef value)
   return CFStringGetCStringPtr(value, kCFStringEncodingUTF8);
 }
 
-/*
- *----------------------------------------------------------------------
- * wDefaultFillAttributes--
- * 	Retrieves attributes for the specified instance/class and
- * fills attr with it. Values that are actually defined are also
- * set in mask. If useGlobalDefault is True, the default for
- * all windows ("*") will be used for when no values are found
- * for that instance/class.
- *
- *----------------------------------------------------------------------
- */
-void wDefaultFillAttributes(const char *instance, const char *class,
-			    WWindowAttributes *attr, WWindowAttributes *mask,
-			    Bool useGlobalDefault)
+/* Fills attr (and mask) from instance.class, instance, class and "*" dictionaries */
+static void resolveAttributes(CFTypeRef dw, CFTypeRef dc, CFTypeRef dn, CFTypeRef da,
+                              WWindowAttributes *attr, WWindowAttributes *mask,
+                              Bool useGlobalDefault)
 {
-  CFTypeRef value, dw, dc, dn, da;
-  char *buffer;
-
-  dw = dc = dn = da = NULL;
-
-  if (class && instance) {
-    buffer = wstrconcatdot(instance, class);
-    dw = get_value_from_instanceclass(buffer);
-    wfree(buffer);
-  }
-
-  dn = get_value_from_instanceclass(instance);
-  dc = get_value_from_instanceclass(class);
-
-  if ((w_global.domain.window_attr->dictionary) && (useGlobalDefault))
-    da = CFDictionaryGetValue(w_global.domain.window_attr->dictionary, AnyWindow);
+  CFTypeRef value;
 
-  /* get the data */
   value = get_value(dw, dc, dn, da, ANoTitlebar, No, useGlobalDefault);
   APPLY_VAL(value, no_titlebar, ANoTitlebar);
 
@@ -381,12 +356,207 @@ static CFTypeRef get_generic_value(const char *instance, const char *class,
   return value;
 }
 
+/*
+ * Attributes cache. Resolving attributes of a window probes up to four
+ * dictionaries of WMWindowAttributes per option. Windows of the same
+ * instance and class (transient windows of browsers, IDEs) resolve to the
+ * same values, so they are resolved once per pair and kept until the
+ * domain changes. Values of the domain are retained by the cache. The cache
+ * is flushed by Workspace preferences on the GUI thread too, so it's
+ * guarded by attrCacheLock.
+ */
+#define ATTR_CACHE_BUCKETS 128
+#define ATTR_CACHE_MAX     1024
+
+typedef struct WAttributesCache {
+  struct WAttributesCache *next;
+  unsigned hash;
+  char *instance;
+  char *class;
+
+  /* indexed by useGlobalDefault */
+  WWindowAttributes values[2];
+  WWindowAttributes masks[2];	/* attributes defined in the domain */
+  /* indexed by default_icon */
+  CFTypeRef icon[2];
+  char *icon_path[2];		/* absolute path of the icon file */
+  CFTypeRef start_workspace;
+} WAttributesCache;
+
+static WAttributesCache *attrCache[ATTR_CACHE_BUCKETS];
+static int attrCacheCount;
+static CFDictionaryRef attrCacheDictionary;
+static pthread_mutex_t attrCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned hashAttributesKey(const char *instance, const char *class)
+{
+  unsigned hash = 2166136261u;	/* FNV-1a */
+  const char *p;
+
+  for (p = instance; p && *p; p++)
+    hash = (hash ^ (unsigned char)*p) * 16777619u;
+  hash = (hash ^ (instance ? 1 : 0)) * 16777619u;
+  for (p = class; p && *p; p++)
+    hash = (hash ^ (unsigned char)*p) * 16777619u;
+  hash = (hash ^ (class ? 2 : 0)) * 16777619u;
+
+  return hash;
+}
+
+static Bool sameString(const char *a, const char *b)
+{
+  if (!a || !b)
+    return a == b;
+  return strcmp(a, b) == 0;
+}
+
+static void flushAttributesCache(void)
+{
+  WAttributesCache *entry, *next;
+  int i;
+
+  for (i = 0; i < ATTR_CACHE_BUCKETS; i++) {
+    for (entry = attrCache[i]; entry; entry = next) {
+      next = entry->next;
+      if (entry->instance)
+        wfree(entry->instance);
+      if (entry->class)
+        wfree(entry->class);
+      if (entry->icon_path[0])
+        wfree(entry->icon_path[0]);
+      if (entry->icon_path[1])
+        wfree(entry->icon_path[1]);
+      if (entry->icon[0])
+        CFRelease(entry->icon[0]);
+      if (entry->icon[1])
+        CFRelease(entry->icon[1]);
+      if (entry->start_workspace)
+        CFRelease(entry->start_workspace);
+      wfree(entry);
+    }
+    attrCache[i] = NULL;
+  }
+  attrCacheCount = 0;
+  attrCacheDictionary = NULL;
+}
+
+void wDefaultFlushAttributesCache(void)
+{
+  pthread_mutex_lock(&attrCacheLock);
+  flushAttributesCache();
+  pthread_mutex_unlock(&attrCacheLock);
+}
+
+/* Must be called with attrCacheLock locked */
+static WAttributesCache *getAttributesCache(const char *instance, const char *class)
+{
+  CFDictionaryRef dict = w_global.domain.window_attr ? w_global.domain.window_attr->dictionary : NULL;
+  WAttributesCache *entry;
+  CFTypeRef dw, dc, dn, da;
+  unsigned hash;
+  char *buffer;
+  int i;
+
+  /* domain was reread */
+  if (dict != attrCacheDictionary || attrCacheCount >= ATTR_CACHE_MAX) {
+    flushAttributesCache();
+    attrCacheDictionary = dict;
+  }
+
+  hash = hashAttributesKey(instance, class);
+  for (entry = attrCache[hash % ATTR_CACHE_BUCKETS]; entry; entry = entry->next) {
+    if (entry->hash == hash && sameString(entry->instance, instance)
+        && sameString(entry->class, class))
+      return entry;
+  }
+
+  entry = wmalloc(sizeof(WAttributesCache));
+  entry->hash = hash;
+  entry->instance = instance ? wstrdup(instance) : NULL;
+  entry->class = class ? wstrdup(class) : NULL;
+
+  dw = dc = dn = da = NULL;
+  if (dict) {
+    if (class && instance) {
+      buffer = wstrconcatdot(instance, class);
+      dw = get_value_from_instanceclass(buffer);
+      wfree(buffer);
+    }
+    dn = get_value_from_instanceclass(instance);
+    dc = get_value_from_instanceclass(class);
+    da = CFDictionaryGetValue(dict, AnyWindow);
+
+    for (i = 0; i < 2; i++) {
+      entry->icon[i] = get_generic_value(instance, class, AIcon, i);
+      if (entry->icon[i])
+        CFRetain(entry->icon[i]);
+    }
+    entry->start_workspace = get_generic_value(instance, class, AStartWorkspace, True);
+    if (entry->start_workspace)
+      CFRetain(entry->start_workspace);
+  }
+  resolveAttributes(dw, dc, dn, NULL, &entry->values[0], &entry->masks[0], False);
+  resolveAttributes(dw, dc, dn, da, &entry->values[1], &entry->masks[1], True);
+
+  entry->next = attrCache[hash % ATTR_CACHE_BUCKETS];
+  attrCache[hash % ATTR_CACHE_BUCKETS] = entry;
+  attrCacheCount++;
+
+  return entry;
+}
+
+/*
+ *----------------------------------------------------------------------
+ * wDefaultFillAttributes--
+ * 	Retrieves attributes for the specified instance/class and
+ * fills attr with it. Values that are actually defined are also
+ * set in mask. If useGlobalDefault is True, the default for
+ * all windows ("*") will be used for when no values are found
+ * for that instance/class.
+ *
+ *----------------------------------------------------------------------
+ */
+void wDefaultFillAttributes(const char *instance, const char *class,
+			    WWindowAttributes *attr, WWindowAttributes *mask,
+			    Bool useGlobalDefault)
+{
+  WAttributesCache *entry;
+  const unsigned char *value, *defined;
+  unsigned char *a, *m;
+  unsigned i;
+
+  pthread_mutex_lock(&attrCacheLock);
+  entry = getAttributesCache(instance, class);
+
+  /* all attributes are 1 bit fields: copy defined bits only */
+  value = (const unsigned char *)&entry->values[useGlobalDefault ? 1 : 0];
+  defined = (const unsigned char *)&entry->masks[useGlobalDefault ? 1 : 0];
+  a = (unsigned char *)attr;
+  m = (unsigned char *)mask;
+  for (i = 0; i < sizeof(WWindowAttributes); i++) {
+    a[i] = (a[i] & ~defined[i]) | (value[i] & defined[i]);
+    if (m)
+      m[i] |= defined[i];
+  }
+  pthread_mutex_unlock(&attrCacheLock);
+}
+
 /* Get the file name of the image, using instance and class */
 char *get_icon_filename(const char *winstance, const char *wclass, const char *command,
 			Bool default_icon)
 {
   const char *file_name;
   char *file_path;
+  WAttributesCache *entry;
+
+  pthread_mutex_lock(&attrCacheLock);
+  entry = getAttributesCache(winstance, wclass);
+  if (entry->icon_path[default_icon ? 1 : 0]) {
+    file_path = wstrdup(entry->icon_path[default_icon ? 1 : 0]);
+    pthread_mutex_unlock(&attrCacheLock);
+    return file_path;
+  }
+  pthread_mutex_unlock(&attrCacheLock);
 
   /* Get the file name of the image, using instance and class */
   file_name = wDefaultGetIconFile(winstance, wclass, default_icon);
@@ -424,6 +594,15 @@ char *get_icon_filename(const char *winstance, const char *wclass, const char *c
   if (!file_path && default_icon)
     file_path = get_default_image_path();
 
+  /* extracting icon of .app may have changed the domain */
+  if (file_path) {
+    pthread_mutex_lock(&attrCacheLock);
+    entry = getAttributesCache(winstance, wclass);
+    if (!entry->icon_path[default_icon ? 1 : 0])
+      entry->icon_path[default_icon ? 1 : 0] = wstrdup(file_path);
+    pthread_mutex_unlock(&attrCacheLock);
+  }
+
   return file_path;
 }
 
@@ -500,24 +679,22 @@ RImage *get_icon_image(WScreen *scr, const char *winstance, const char *wclass,
 int wDefaultGetStartWorkspace(WScreen *scr, const char *instance, const char *class)
 {
   CFTypeRef value;
-  int w;
+  int w = -1;
   const char *tmp;
 
   if (!w_global.domain.window_attr->dictionary)
     return -1;
 
-  value = get_generic_value(instance, class, AStartWorkspace, True);
+  pthread_mutex_lock(&attrCacheLock);
+  value = getAttributesCache(instance, class)->start_workspace;
 
-  if (!value)
-    return -1;
-
-  tmp = getString(AStartWorkspace, value);
-
-  if (!tmp || strlen(tmp) == 0)
-    return -1;
-
-  /* Get the workspace number for the workspace name */
-  w = wGetDesktopNumber(scr, tmp);
+  if (value) {
+    tmp = getString(AStartWorkspace, value);
+    /* Get the workspace number for the workspace name */
+    if (tmp && strlen(tmp) > 0)
+      w = wGetDesktopNumber(scr, tmp);
+  }
+  pthread_mutex_unlock(&attrCacheLock);
 
   return w;
 }
@@ -531,12 +708,10 @@ const char *wDefaultGetIconFile(const char *instance, const char *class, Bool de
   if (!w_global.domain.window_attr || !w_global.domain.window_attr->dictionary)
     return NULL;
 
-  value = get_generic_value(instance, class, AIcon, default_icon);
-
-  if (!value)
-    return NULL;
-
-  tmp = getString(AIcon, value);
+  pthread_mutex_lock(&attrCacheLock);
+  value = getAttributesCache(instance, class)->icon[default_icon ? 1 : 0];
+  tmp = value ? getString(AIcon, value) : NULL;
+  pthread_mutex_unlock(&attrCacheLock);
 
   return tmp;
 }
@@ -618,6 +793,8 @@ void wDefaultChangeIcon(const char *instance, const char *class, const char *fil
     CFDictionarySetValue(dict, key, icon_entry);
   }
 
+  wDefaultFlushAttributesCache();
+
   if (!wPreferences.flags.noupdates) {
     WMUserDefaultsWrite(db->dictionary, db->name);
   }
@@ -641,6 +818,7 @@ void wDefaultPurgeInfo(const char *instance, const char *class)
 
   if (dict) {
     CFDictionaryRemoveValue(w_global.domain.window_attr->dictionary, key);
+    wDefaultFlushAttributesCache();
     WMUserDefaultsWrite(w_global.domain.window_attr->dictionary,
                         w_global.domain.window_attr->name);
   }
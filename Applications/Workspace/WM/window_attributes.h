@@ -42,5 +42,7 @@ int wDefaultGetStartWorkspace(WScreen *scr, const char *instance, const char *cl
 const char *wDefaultGetIconFile(const char *instance, const char *class, Bool default_icon);
 void wDefaultChangeIcon(const char *instance, const char* class, const char *file);
 void wDefaultPurgeInfo(const char *instance, const char *class);
+/* Call after changing WMWindowAttributes dictionary in place */
+void wDefaultFlushAttributesCache(void);
 
 #endif /* __WORKSPACE_WM_WDEFAULTS__ */
@@ -0,0 +1,203 @@
+/* winmap.c - Window to object map
+ *
+ *  Workspace window manager
+ *  Copyright (c) 2015-2021 Sergii Stoian
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <X11/Xlib.h>
+
+#include <core/util.h>
+
+#include "winmap.h"
+
+/* Initial number of slots, must be power of 2 */
+#define MAP_INITIAL_SIZE 64
+
+/* Slots with window == None are empty. Deleted entries are not marked -
+   following entries of the cluster are shifted back instead, so lookups
+   stop at the first empty slot. */
+typedef struct {
+  Window window;
+  void *data;
+} WMapSlot;
+
+/* Maps are changed by the WM thread and read by Workspace GUI thread too
+   (wWindowFor()), so each map is guarded by its lock. */
+struct WWindowMap {
+  pthread_mutex_t lock;
+  WMapSlot *slots;
+  unsigned mask;    /* slot count - 1 */
+  unsigned count;
+};
+
+static WWindowMapStats mapStats;
+
+static inline unsigned hashWindow(Window window, unsigned mask)
+{
+  /* XIDs of one client differ in low bits only - mix them (Fibonacci
+     hashing) so neighbouring windows don't form long clusters */
+  return (unsigned)(((unsigned long long)window * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+static void insertSlot(WWindowMap *map, Window window, void *data)
+{
+  unsigned i = hashWindow(window, map->mask);
+
+  while (map->slots[i].window != None && map->slots[i].window != window)
+    i = (i + 1) & map->mask;
+
+  if (map->slots[i].window == None)
+    map->count++;
+  map->slots[i].window = window;
+  map->slots[i].data = data;
+}
+
+static void resizeMap(WWindowMap *map, unsigned size)
+{
+  WMapSlot *old = map->slots;
+  unsigned i, old_size = map->mask + 1;
+
+  map->slots = wmalloc(size * sizeof(WMapSlot));
+  map->mask = size - 1;
+  map->count = 0;
+
+  for (i = 0; i < old_size; i++) {
+    if (old[i].window != None)
+      insertSlot(map, old[i].window, old[i].data);
+  }
+  wfree(old);
+}
+
+WWindowMap *wWindowMapCreate(void)
+{
+  WWindowMap *map = wmalloc(sizeof(WWindowMap));
+
+  pthread_mutex_init(&map->lock, NULL);
+  map->slots = wmalloc(MAP_INITIAL_SIZE * sizeof(WMapSlot));
+  map->mask = MAP_INITIAL_SIZE - 1;
+
+  return map;
+}
+
+void wWindowMapDestroy(WWindowMap *map)
+{
+  if (!map)
+    return;
+  pthread_mutex_destroy(&map->lock);
+  wfree(map->slots);
+  wfree(map);
+}
+
+void wWindowMapSave(WWindowMap *map, Window window, void *data)
+{
+  if (window == None)
+    return;
+
+  pthread_mutex_lock(&map->lock);
+  /* keep load factor under 1/2 */
+  if ((map->count + 1) * 2 > map->mask + 1)
+    resizeMap(map, (map->mask + 1) * 2);
+
+  insertSlot(map, window, data);
+  pthread_mutex_unlock(&map->lock);
+}
+
+void *wWindowMapFind(WWindowMap *map, Window window)
+{
+  unsigned i, probes = 0;
+  void *data = NULL;
+
+  pthread_mutex_lock(&map->lock);
+  i = hashWindow(window, map->mask);
+  while (1) {
+    probes++;
+    if (map->slots[i].window == window && window != None) {
+      data = map->slots[i].data;
+      break;
+    }
+    if (map->slots[i].window == None)
+      break;
+    i = (i + 1) & map->mask;
+  }
+  pthread_mutex_unlock(&map->lock);
+
+  /* counters are shared by all maps */
+  __atomic_add_fetch(&mapStats.lookups, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&mapStats.probes, probes, __ATOMIC_RELAXED);
+  if (!data)
+    __atomic_add_fetch(&mapStats.misses, 1, __ATOMIC_RELAXED);
+
+  return data;
+}
+
+static Bool deleteSlot(WWindowMap *map, Window window)
+{
+  unsigned i, j, home;
+
+  i = hashWindow(window, map->mask);
+  while (map->slots[i].window != window) {
+    if (map->slots[i].window == None)
+      return False;
+    i = (i + 1) & map->mask;
+  }
+
+  /* backward shift: move up entries which can't be found past the hole */
+  j = i;
+  while (1) {
+    map->slots[i].window = None;
+    map->slots[i].data = NULL;
+    do {
+      j = (j + 1) & map->mask;
+      if (map->slots[j].window == None) {
+        map->count--;
+        return True;
+      }
+      home = hashWindow(map->slots[j].window, map->mask);
+      /* entry at j stays if its home slot lies cyclically in (i, j] */
+    } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+    map->slots[i] = map->slots[j];
+    i = j;
+  }
+}
+
+Bool wWindowMapDelete(WWindowMap *map, Window window)
+{
+  Bool deleted;
+
+  if (window == None)
+    return False;
+
+  pthread_mutex_lock(&map->lock);
+  deleted = deleteSlot(map, window);
+  pthread_mutex_unlock(&map->lock);
+
+  return deleted;
+}
+
+void wWindowMapCountEvent(void)
+{
+  __atomic_add_fetch(&mapStats.events, 1, __ATOMIC_RELAXED);
+}
+
+void wWindowMapGetStats(WWindowMapStats *stats)
+{
+  *stats = mapStats;
+}
@@ -0,0 +1,58 @@
+/* winmap.h
+ *
+ *  Workspace window manager
+ *  Copyright (c) 2015-2021 Sergii Stoian
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WORKSPACE_WM_WINMAP__
+#define __WORKSPACE_WM_WINMAP__
+
+#include <X11/Xlib.h>
+
+/*
+ * Window to object map. Replaces Xlib contexts (XSaveContext/XFindContext)
+ * on the event paths: one open addressing table per kind of object,
+ * lookups don't lock the display and touch one or two cache lines.
+ *
+ * Maps are changed on the WM thread. Lookups are made on the WM thread and
+ * on Workspace GUI thread (wWindowFor()). Every call takes the map's mutex,
+ * so any thread may call them; data found is owned by the WM thread.
+ */
+typedef struct WWindowMap WWindowMap;
+
+typedef struct WWindowMapStats {
+  unsigned long events;   /* events dispatched */
+  unsigned long lookups;  /* wWindowMapFind() calls */
+  unsigned long misses;   /* lookups of unknown windows */
+  unsigned long probes;   /* slots examined by lookups */
+} WWindowMapStats;
+
+WWindowMap *wWindowMapCreate(void);
+void wWindowMapDestroy(WWindowMap *map);
+
+/* Associate `data` with `window`, replacing previous association. */
+void wWindowMapSave(WWindowMap *map, Window window, void *data);
+/* Returns NULL if `window` is unknown. */
+void *wWindowMapFind(WWindowMap *map, Window window);
+/* Returns False if `window` was not in the map. */
+Bool wWindowMapDelete(WWindowMap *map, Window window);
+
+/* Counters of all maps since startup. */
+void wWindowMapCountEvent(void);
+void wWindowMapGetStats(WWindowMapStats *stats);
+
+#endif /* __WORKSPACE_WM_WINMAP__ */
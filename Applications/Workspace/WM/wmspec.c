@@ -34,6 +34,9 @@
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <core/WMcore.h>
 #include <core/util.h>
@@ -54,6 +57,9 @@
 #include "xrandr.h"
 #include "properties.h"
 #include "misc.h"
+#include "winmap.h"
+
+#include <Workspace+WM.h>
 
 
 /* Root Window Properties */
@@ -264,18 +270,38 @@ static void desktopObserver(CFNotificationCenterRef center, void *observer,
                               CFNotificationName name, const void *screen,
                               CFDictionaryRef userInfo);
 
+static void stackingObserver(CFNotificationCenterRef center, void *observer,
+                             CFNotificationName name, const void *screen,
+                             CFDictionaryRef userInfo);
+
 static void updateClientList(WScreen *scr);
-static void updateClientListStacking(WScreen *scr, WWindow *);
+static void updateClientListStacking(WScreen *scr);
 
 static void updateDesktopNames(WScreen *scr);
 static void updateCurrentDesktop(WScreen *scr);
 static void updateDesktopCount(WScreen *scr);
 static void wNETWMShowingDesktop(WScreen *scr, Bool show);
 
+/* Client window list kept in sync with managed windows and copied into
+   root window property when it differs from what was written last. */
+typedef struct NetClientList {
+  Window *windows;
+  int count;
+  int size;
+  Window *written;          /* property contents */
+  int written_count;
+  Bool dirty;
+} NetClientList;
+
 typedef struct NetData {
   WScreen *scr;
   WReservedArea *strut;
   WWindow **show_desktop;
+
+  NetClientList client_list;     /* _NET_CLIENT_LIST, mapping order */
+  NetClientList stacking_list;   /* _NET_CLIENT_LIST_STACKING, bottom to top */
+  Bool rebuild_stacking;         /* stacking_list order is unknown */
+  CFRunLoopObserverRef flush_observer;
 } NetData;
 
 static void setSupportedHints(WScreen *scr)
@@ -406,6 +432,55 @@ int wNETWMGetCurrentDesktopFromHint(WScreen *scr)
   return -1;
 }
 
+/*
+ * _NET_WM_ICON holds any number of images, each one is width, height and
+ * width * height ARGB pixels. Applications often put all of their icon
+ * sizes there, up to hundreds of KB. Only the headers are read to pick an
+ * image, then only the picked image is transferred.
+ */
+#define NET_ICON_MAX_IMAGES 32
+
+typedef struct {
+  unsigned long width;
+  unsigned long height;
+  long offset;			/* of the header, in 32 bit items */
+} WNetIconHeader;
+
+static int readIconHeaders(Window window, WNetIconHeader *headers)
+{
+  Atom type;
+  int format, count = 0;
+  unsigned long items, rest, size;
+  unsigned long *property;
+  long offset = 0;
+
+  while (count < NET_ICON_MAX_IMAGES) {
+    if (XGetWindowProperty(dpy, window, net_wm_icon, offset, 2L,
+                           False, XA_CARDINAL, &type, &format, &items, &rest,
+                           (unsigned char **)&property) != Success || !property)
+      break;
+
+    if (type != XA_CARDINAL || format != 32 || items < 2) {
+      XFree(property);
+      break;
+    }
+    size = property[0] * property[1];
+    headers[count].width = property[0];
+    headers[count].height = property[1];
+    headers[count].offset = offset;
+    XFree(property);
+
+    /* `rest` is in bytes, pixels of the image must follow */
+    if (size == 0 || size > rest / 4)
+      break;
+    count++;
+
+    offset += size + 2;
+  }
+
+  return count;
+}
+
 /*
  * Find the best icon to be used by Window Maker for appicon/miniwindows.
  * Currently the algorithm is to take the image with the size closest
@@ -417,104 +492,159 @@ int wNETWMGetCurrentDesktopFromHint(WScreen *scr)
  *
  * The logic can also be changed to accept bigger images and scale them down.
  */
-static unsigned long *findBestIcon(unsigned long *data, unsigned long items)
+static WNetIconHeader *findBestIcon(WNetIconHeader *headers, int count)
 {
-  int size, wanted, d;
-  unsigned long i, distance;
-  unsigned long *icon;
+  int size, wanted, d, i;
+  unsigned long distance;
+  WNetIconHeader *icon;
 
   /* Use only 75% of icon_size. For 64x64 this means 48x48.
    * This leaves room around the icon for the miniwindow title and
    * results in better overall aesthetics -Dan */
   wanted = (wPreferences.icon_size*0.75) * (wPreferences.icon_size*0.75);
 
-  for (icon = NULL, distance = wanted, i = 0L; i < items - 1;) {
-    size = data[i] * data[i + 1];
-    if (size == 0)
-      break;
+  for (icon = NULL, distance = wanted, i = 0; i < count; i++) {
+    size = headers[i].width * headers[i].height;
     d = wanted - size;
-    if (d >= 0 && d <= distance && (i + size + 2) <= items) {
+    if (d >= 0 && d <= distance) {
       distance = d;
-      icon = &data[i];
+      icon = &headers[i];
     }
-    i += size + 2;
   }
 
   return icon;
 }
 
-static RImage *makeRImageFromARGBData(unsigned long *data)
+/* ARGB pixels, one in each long of property data, to RGBA */
+static void convertARGBData(const unsigned long *argb, unsigned char *rgba, unsigned long count)
 {
-  int size, width, height, i;
-  RImage *image;
-  unsigned char *imgdata;
+  unsigned long i = 0;
   unsigned long pixel;
 
-  width = data[0];
-  height = data[1];
-  size = width * height;
-
-  if (size == 0)
-    return NULL;
+#if defined(__SSE2__) && __SIZEOF_LONG__ == 8 && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  /* 4 pixels at a time: low 32 bits of each long, R and B swapped */
+  const __m128i ag = _mm_set1_epi32(0xff00ff00);
+  const __m128i low = _mm_set1_epi32(0xff);
+  __m128i a, b, p;
+
+  for (; i + 4 <= count; i += 4) {
+    a = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&argb[i]), _MM_SHUFFLE(3, 1, 2, 0));
+    b = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&argb[i + 2]), _MM_SHUFFLE(3, 1, 2, 0));
+    p = _mm_unpacklo_epi64(a, b);
+    p = _mm_or_si128(_mm_and_si128(p, ag),
+                     _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), low),
+                                  _mm_slli_epi32(_mm_and_si128(p, low), 16)));
+    _mm_storeu_si128((__m128i *)&rgba[i * 4], p);
+  }
+#endif
+  for (; i < count; i++) {
+    pixel = argb[i];
+    rgba[i * 4 + 0] = (pixel >> 16) & 0xff;	/* R */
+    rgba[i * 4 + 1] = (pixel >> 8) & 0xff;	/* G */
+    rgba[i * 4 + 2] = (pixel >> 0) & 0xff;	/* B */
+    rgba[i * 4 + 3] = (pixel >> 24) & 0xff;	/* A */
+  }
+}
 
-  image = RCreateImage(width, height, True);
+static unsigned long hashIconData(const unsigned long *data, unsigned long count)
+{
+  unsigned long hash = 2166136261u;	/* FNV-1a over 32 bit items */
+  unsigned long i;
 
-  for (imgdata = image->data, i = 2; i < size + 2; i++, imgdata += 4) {
-    pixel = data[i];
-    imgdata[3] = (pixel >> 24) & 0xff;	/* A */
-    imgdata[0] = (pixel >> 16) & 0xff;	/* R */
-    imgdata[1] = (pixel >> 8) & 0xff;	/* G */
-    imgdata[2] = (pixel >> 0) & 0xff;	/* B */
-  }
+  for (i = 0; i < count; i++)
+    hash = (hash ^ (data[i] & 0xffffffff)) * 16777619u;
 
-  return image;
+  /* 0 means no icon */
+  return hash ? hash : 1;
 }
 
-RImage *get_window_image_from_x11(Window window)
+/*
+ * Reads the best image of _NET_WM_ICON. If `hash` is not NULL, it is set to
+ * the hash of the image data; if it was equal to the new hash already, the
+ * image is the same as before: `*unchanged` is set and NULL returned.
+ */
+static RImage *readNetIcon(Window window, unsigned long *hash, Bool *unchanged)
 {
+  WNetIconHeader headers[NET_ICON_MAX_IMAGES], *best;
   RImage *image;
   Atom type;
-  int format;
-  unsigned long items, rest;
-  unsigned long *property, *data;
+  int format, count;
+  unsigned long items, rest, size, new_hash;
+  unsigned long *property;
+
+  if (unchanged)
+    *unchanged = False;
+
+  count = readIconHeaders(window, headers);
+  best = findBestIcon(headers, count);
+  if (!best)
+    goto no_icon;
 
-  /* Get the icon from X11 Window */
-  if (XGetWindowProperty(dpy, window, net_wm_icon, 0L, LONG_MAX,
+  /* header again, the property may have changed in the meantime */
+  size = best->width * best->height;
+  if (XGetWindowProperty(dpy, window, net_wm_icon, best->offset, size + 2,
                          False, XA_CARDINAL, &type, &format, &items, &rest,
                          (unsigned char **)&property) != Success || !property)
-    return NULL;
+    goto no_icon;
 
-  if (type != XA_CARDINAL || format != 32 || items < 2) {
+  if (type != XA_CARDINAL || format != 32 || items != size + 2
+      || property[0] != best->width || property[1] != best->height) {
     XFree(property);
-    return NULL;
+    goto no_icon;
   }
 
-  /* Find the best icon */
-  data = findBestIcon(property, items);
-  if (!data) {
-    XFree(property);
-    return NULL;
+  if (hash) {
+    new_hash = hashIconData(property, items);
+    if (new_hash == *hash) {
+      XFree(property);
+      *unchanged = True;
+      return NULL;
+    }
+    *hash = new_hash;
   }
 
-  /* Save the best icon in the X11 icon */
-  image = makeRImageFromARGBData(data);
-
+  image = RCreateImage(best->width, best->height, True);
+  if (image)
+    convertARGBData(property + 2, image->data, size);
   XFree(property);
 
   /* Resize the image to the correct value */
-  image = wIconValidateIconSize(image, wPreferences.icon_size);
+  return wIconValidateIconSize(image, wPreferences.icon_size);
 
-  return image;
+ no_icon:
+  if (hash) {
+    if (*hash == 0 && unchanged)
+      *unchanged = True;
+    *hash = 0;
+  }
+  return NULL;
+}
+
+RImage *get_window_image_from_x11(Window window)
+{
+  return readNetIcon(window, NULL, NULL);
 }
 
 static void updateIconImage(WWindow *wwin)
 {
+  RImage *image;
+  Bool unchanged;
+
+  /* Animated icons and repeated property changes: don't decode and
+   * repaint icons for the image already shown */
+  if (!wwin->net_icon_image)
+    wwin->net_icon_hash = 0;
+  image = readNetIcon(wwin->client_win, &wwin->net_icon_hash, &unchanged);
+  /* image shared from another window has no hash: only a new one is known */
+  if (unchanged && (wwin->net_icon_hash || !wwin->net_icon_image))
+    return;
+
   /* Remove the icon image from X11 */
   if (wwin->net_icon_image)
     RReleaseImage(wwin->net_icon_image);
 
   /* Save the icon in the X11 icon */
-  wwin->net_icon_image = get_window_image_from_x11(wwin->client_win);
+  wwin->net_icon_image = image;
 
   /* Refresh the Window Icon */
   if (wwin->icon)
@@ -524,8 +654,9 @@ static void updateIconImage(WWindow *wwin)
   WApplication *app = wApplicationOf(wwin->main_window);
   if (app && app->app_icon) {
     WWindow *app_owner = app->app_icon->icon->owner;
-    if (app_owner && !app_owner->net_icon_image) {
-      app_owner->net_icon_image = get_window_image_from_x11(wwin->client_win);
+    if (app_owner && !app_owner->net_icon_image && image) {
+      app_owner->net_icon_image = RRetainImage(image);
+      app_owner->net_icon_hash = wwin->net_icon_hash;
       wIconUpdate(app->app_icon->icon);
       wAppIconPaint(app->app_icon);
     }
@@ -667,6 +798,10 @@ void wNETWMInitStuff(WScreen *scr)
                                   WMDidChangeWindowNameNotification, NULL,
                                   CFNotificationSuspensionBehaviorDeliverImmediately);
 
+  CFNotificationCenterAddObserver(scr->notificationCenter, data, stackingObserver,
+                                  WMDidResetWindowStackingNotification, NULL,
+                                  CFNotificationSuspensionBehaviorDeliverImmediately);
+
   CFNotificationCenterAddObserver(scr->notificationCenter, data, desktopObserver,
                                   WMDidCreateDesktopNotification, NULL,
                                   CFNotificationSuspensionBehaviorDeliverImmediately);
@@ -681,7 +816,7 @@ void wNETWMInitStuff(WScreen *scr)
                                   CFNotificationSuspensionBehaviorDeliverImmediately);
 
   updateClientList(scr);
-  updateClientListStacking(scr, NULL);
+  updateClientListStacking(scr);
   updateDesktopCount(scr);
   updateDesktopNames(scr);
   updateShowDesktop(scr, False);
@@ -691,8 +826,16 @@ void wNETWMInitStuff(WScreen *scr)
 
 void wNETWMCleanup(WScreen *scr)
 {
+  NetData *ndata = scr->netdata;
   int i;
 
+  /* don't let pending client list update recreate properties */
+  if (ndata && ndata->flush_observer) {
+    CFRunLoopObserverInvalidate(ndata->flush_observer);
+    CFRelease(ndata->flush_observer);
+    ndata->flush_observer = NULL;
+  }
+
   for (i = 0; i < wlengthof(atomNames); i++)
     XDeleteProperty(dpy, scr->root_win, *atomNames[i].atom);
 }
@@ -845,64 +988,232 @@ Bool wNETWMGetUsableArea(WScreen *scr, int head, WArea *area)
   return True;
 }
 
-static void updateClientList(WScreen *scr)
+static int clientListIndex(NetClientList *list, Window window)
 {
-  WWindow *wwin;
-  Window *windows;
-  int count;
-
-  windows = (Window *) wmalloc(sizeof(Window) * (scr->window_count + 1));
+  int i;
 
-  count = 0;
-  wwin = scr->focused_window;
-  while (wwin) {
-    windows[count++] = wwin->client_win;
-    wwin = wwin->prev;
+  for (i = list->count - 1; i >= 0; i--) {
+    if (list->windows[i] == window)
+      return i;
   }
-  XChangeProperty(dpy, scr->root_win, net_client_list, XA_WINDOW, 32,
-                  PropModeReplace, (unsigned char *)windows, count);
+  return -1;
+}
 
-  wfree(windows);
-  XFlush(dpy);
+static void clientListInsert(NetClientList *list, int index, Window window)
+{
+  if (list->count == list->size) {
+    list->size = list->size ? list->size * 2 : 64;
+    list->windows = wrealloc(list->windows, list->size * sizeof(Window));
+  }
+  if (index < 0 || index > list->count)
+    index = list->count;
+  memmove(&list->windows[index + 1], &list->windows[index],
+          (list->count - index) * sizeof(Window));
+  list->windows[index] = window;
+  list->count++;
+  list->dirty = True;
 }
 
-static void updateClientListStacking(WScreen *scr, WWindow *wwin_excl)
+static Bool clientListRemove(NetClientList *list, Window window)
 {
-  WWindow *wwin;
-  Window *client_list, *client_list_reverse;
-  int client_count, i;
-  WCoreWindow *tmp;
-  WMBagIterator iter;
+  int index = clientListIndex(list, window);
 
-  /* update client list */
-  i = scr->window_count + 1;
-  client_list = (Window *) wmalloc(sizeof(Window) * i);
-  client_list_reverse = (Window *) wmalloc(sizeof(Window) * i);
+  if (index < 0)
+    return False;
 
-  client_count = 0;
-  WM_ETARETI_BAG(scr->stacking_list, tmp, iter) {
-    while (tmp) {
+  list->count--;
+  memmove(&list->windows[index], &list->windows[index + 1],
+          (list->count - index) * sizeof(Window));
+  list->dirty = True;
+
+  return True;
+}
+
+/* Writes property if list contents differ from the last written. */
+static Bool clientListWrite(NetClientList *list, Window root, Atom property)
+{
+  if (!list->dirty)
+    return False;
+  list->dirty = False;
+
+  if (list->count == list->written_count &&
+      (list->count == 0 ||
+       memcmp(list->windows, list->written, list->count * sizeof(Window)) == 0))
+    return False;
+
+  XChangeProperty(dpy, root, property, XA_WINDOW, 32, PropModeReplace,
+                  (unsigned char *)list->windows, list->count);
+
+  list->written = wrealloc(list->written, list->size * sizeof(Window));
+  if (list->count > 0)
+    memcpy(list->written, list->windows, list->count * sizeof(Window));
+  list->written_count = list->count;
+
+  return True;
+}
+
+static void rebuildClientListStacking(NetData *ndata)
+{
+  NetClientList *list = &ndata->stacking_list;
+  WScreen *scr = ndata->scr;
+  WCoreWindow *tmp, *top;
+  WMBagIterator iter;
+  WWindow *wwin;
+
+  list->count = 0;
+  /* levels go from bottom to top by WMBagNext(), frames of level
+     by stacking->above */
+  WM_ITERATE_BAG(scr->stacking_list, top, iter) {
+    for (tmp = top; tmp && tmp->stacking->under; tmp = tmp->stacking->under)
+      ;
+    for (; tmp; tmp = tmp->stacking->above) {
       wwin = wWindowFor(tmp->window);
-      /* wwin_excl is a window to exclude from the list
-         (e.g. it's now unmanaged) */
-      if (wwin && (wwin != wwin_excl))
-        client_list[client_count++] = wwin->client_win;
-      tmp = tmp->stacking->under;
+      if (wwin && clientListIndex(&ndata->client_list, wwin->client_win) >= 0)
+        clientListInsert(list, -1, wwin->client_win);
+    }
+  }
+  list->dirty = True;
+  ndata->rebuild_stacking = False;
+}
+
+static void flushClientLists(NetData *ndata)
+{
+  Window root = ndata->scr->root_win;
+  Bool changed;
+
+  if (ndata->rebuild_stacking)
+    rebuildClientListStacking(ndata);
+
+  changed = clientListWrite(&ndata->client_list, root, net_client_list);
+  changed |= clientListWrite(&ndata->stacking_list, root, net_client_list_stacking);
+  if (changed)
+    XFlush(dpy);
+}
+
+static void flushObserverCallback(CFRunLoopObserverRef observer,
+                                  CFRunLoopActivity activity, void *ndata)
+{
+  flushClientLists((NetData *)ndata);
+}
+
+/* Properties are written once per run loop iteration - after all pending
+   X events were handled. Observers with lower order run first: notifications
+   queued with CFNotificationCenterEnqueueNotification() are delivered by an
+   order 0 observer and may change the stacking list, so lists are written
+   after them. */
+#define CLIENT_LISTS_FLUSH_ORDER 1000
+
+static void scheduleClientListsFlush(NetData *ndata)
+{
+  CFRunLoopObserverContext ctx = {0, ndata, NULL, NULL, NULL};
+
+  if (!wm_runloop) {
+    flushClientLists(ndata);
+    return;
+  }
+  if (!ndata->flush_observer) {
+    ndata->flush_observer = CFRunLoopObserverCreate(kCFAllocatorDefault,
+                                                    kCFRunLoopBeforeWaiting, true,
+                                                    CLIENT_LISTS_FLUSH_ORDER,
+                                                    flushObserverCallback, &ctx);
+    CFRunLoopAddObserver(wm_runloop, ndata->flush_observer, kCFRunLoopDefaultMode);
+  }
+}
+
+/* Returns index in stacking list where client window of `wwin` belongs:
+   right above the nearest listed window under its frame. -1 if frame is
+   not in stacking list. */
+static int stackingListPosition(NetData *ndata, WWindow *wwin)
+{
+  WCoreWindow *frame = wwin->frame ? wwin->frame->core : NULL;
+  WCoreWindow *tmp;
+  WMBagIterator iter;
+  WWindow *below;
+  int index;
+
+  if (!frame || !frame->stacking ||
+      wWindowMapFind(w_global.context.stack, frame->window) != frame)
+    return -1;
+
+  WMBagIteratorAtIndex(ndata->scr->stacking_list, frame->stacking->window_level, &iter);
+  tmp = frame->stacking->under;
+  while (1) {
+    for (; tmp; tmp = tmp->stacking->under) {
+      below = wWindowFor(tmp->window);
+      if (below && (index = clientListIndex(&ndata->stacking_list, below->client_win)) >= 0)
+        return index + 1;
     }
+    if (iter == NULL)
+      break;
+    /* top frame of the next lower level */
+    tmp = WMBagPrevious(ndata->scr->stacking_list, &iter);
   }
 
-  for (i = 0; i < client_count; i++) {
-    Window w = client_list[client_count - i - 1];
-    client_list_reverse[i] = w;
+  return 0;
+}
+
+static void addToClientLists(NetData *ndata, WWindow *wwin)
+{
+  int index;
+
+  if (clientListIndex(&ndata->client_list, wwin->client_win) < 0)
+    clientListInsert(&ndata->client_list, -1, wwin->client_win);
+
+  if (!ndata->rebuild_stacking) {
+    clientListRemove(&ndata->stacking_list, wwin->client_win);
+    index = stackingListPosition(ndata, wwin);
+    if (index < 0)
+      ndata->rebuild_stacking = True;
+    else
+      clientListInsert(&ndata->stacking_list, index, wwin->client_win);
   }
+  scheduleClientListsFlush(ndata);
+}
 
-  XChangeProperty(dpy, scr->root_win, net_client_list_stacking, XA_WINDOW, 32,
-                  PropModeReplace, (unsigned char *)client_list_reverse, client_count);
+static void removeFromClientLists(NetData *ndata, WWindow *wwin)
+{
+  clientListRemove(&ndata->client_list, wwin->client_win);
+  clientListRemove(&ndata->stacking_list, wwin->client_win);
+  scheduleClientListsFlush(ndata);
+}
 
-  wfree(client_list);
-  wfree(client_list_reverse);
+static void restackInClientLists(NetData *ndata, WWindow *wwin)
+{
+  int index;
 
-  XFlush(dpy);
+  if (ndata->rebuild_stacking ||
+      !clientListRemove(&ndata->stacking_list, wwin->client_win))
+    return;
+
+  index = stackingListPosition(ndata, wwin);
+  if (index < 0)
+    ndata->rebuild_stacking = True;
+  else
+    clientListInsert(&ndata->stacking_list, index, wwin->client_win);
+  scheduleClientListsFlush(ndata);
+}
+
+/* Recreates client list from the focus list of the screen. */
+static void updateClientList(WScreen *scr)
+{
+  NetData *ndata = scr->netdata;
+  WWindow *wwin;
+
+  /* least recently focused first */
+  ndata->client_list.count = 0;
+  for (wwin = scr->focused_window; wwin && wwin->prev; wwin = wwin->prev)
+    ;
+  for (; wwin; wwin = wwin->next)
+    clientListInsert(&ndata->client_list, -1, wwin->client_win);
+  ndata->client_list.dirty = True;
+
+  scheduleClientListsFlush(ndata);
+}
+
+static void updateClientListStacking(WScreen *scr)
+{
+  scr->netdata->rebuild_stacking = True;
+  scheduleClientListsFlush(scr->netdata);
 }
 
 static void updateDesktopCount(WScreen *scr)
@@ -1938,8 +2249,7 @@ static void windowObserver(CFNotificationCenterRef center, void *netData,
     return;
 
   if (CFStringCompare(name, WMDidManageWindowNotification, 0) == 0) {
-    updateClientList(wwin->screen);
-    updateClientListStacking(wwin->screen, NULL);
+    addToClientLists(ndata, wwin);
     updateStateHint(wwin, True, False);
     
     updateStrut(wwin->screen, wwin->client_win, False);
@@ -1947,8 +2257,7 @@ static void windowObserver(CFNotificationCenterRef center, void *netData,
     wScreenUpdateUsableArea(wwin->screen);
   }
   else if (CFStringCompare(name, WMDidUnmanageWindowNotification, 0) == 0) {
-    updateClientList(wwin->screen);
-    updateClientListStacking(wwin->screen, wwin);
+    removeFromClientLists(ndata, wwin);
     updateDesktopHint(wwin, False, True);
     updateStateHint(wwin, False, True);
     wNETWMUpdateActions(wwin, True);
@@ -1956,12 +2265,8 @@ static void windowObserver(CFNotificationCenterRef center, void *netData,
     updateStrut(wwin->screen, wwin->client_win, False);
     wScreenUpdateUsableArea(wwin->screen);
   }
-  else if (CFStringCompare(name, WMDidResetWindowStackingNotification, 0) == 0) {
-    updateClientListStacking(wwin->screen, NULL);
-    updateStateHint(wwin, False, False);
-  }
   else if (CFStringCompare(name, WMDidChangeWindowStackingNotification, 0) == 0) {
-    updateClientListStacking(wwin->screen, NULL);
+    restackInClientLists(ndata, wwin);
     updateStateHint(wwin, False, False);
   }
   else if (CFStringCompare(name, WMDidChangeWindowFocusNotification, 0) == 0) {
@@ -1977,6 +2282,19 @@ static void windowObserver(CFNotificationCenterRef center, void *netData,
   }
 }
 
+/* Stacking lists were changed without per window notification. */
+static void stackingObserver(CFNotificationCenterRef center, void *netData,
+                             CFNotificationName name, const void *screen,
+                             CFDictionaryRef userInfo)
+{
+  NetData *ndata = (NetData *)netData;
+
+  if ((WScreen *)screen != ndata->scr)
+    return;
+
+  updateClientListStacking(ndata->scr);
+}
+
 static void desktopObserver(CFNotificationCenterRef center, void *netData,
                               CFNotificationName name, const void *screen,
                               CFDictionaryRef userInfo)
@@ -24,6 +24,7 @@
 
 #import <Foundation/NSString.h>
 #import <Foundation/NSFileManager.h>
+#import <Foundation/NSDate.h>
  
 @class NSString, NSObject;
 
@@ -43,6 +44,31 @@ typedef enum {
 extern NSString *NXTSortFilesBy;
 extern NSString *NXTShowHiddenFiles;
 
+// Attributes of a directory entry, as returned by
+// -directoryEntriesAtPath:forPath:sortedBy:showHidden:. Symbolic links are
+// not followed, except for `isDirectory`.
+@interface NXTDirectoryEntry : NSObject
+{
+@public
+  NSString           *name;
+  NSString           *fileType;
+  BOOL               isDirectory;
+  unsigned long long size;
+  NSTimeInterval     modificationTime; // since 1970
+  NSString           *ownerName;
+  NSUInteger         permissions;
+}
+
+- (NSString *)name;
+- (NSString *)fileType;
+- (BOOL)isDirectory;
+- (unsigned long long)fileSize;
+- (NSDate *)modificationDate;
+- (NSString *)ownerName;
+- (NSUInteger)posixPermissions;
+
+@end
+
 @interface NXTFileManager : NSFileManager
 {
 }
@@ -62,6 +88,12 @@ extern NSString *NXTShowHiddenFiles;
                              forPath:(NSString *)targetPath
                             sortedBy:(NXTSortType)sortType
                           showHidden:(BOOL)showHidden;
+// Reads the directory and the attributes of its entries once. Returns
+// sorted NXTDirectoryEntry objects.
+- (NSArray *)directoryEntriesAtPath:(NSString *)path
+                            forPath:(NSString *)targetPath
+                           sortedBy:(NXTSortType)sortType
+                         showHidden:(BOOL)showHidden;
 
 - (NSArray *)executablesForSubstring:(NSString *)substring;
 - (NSArray *)completionForPath:(NSString *)path
@@ -74,5 +106,9 @@ extern NSString *NXTShowHiddenFiles;
 - (NSString *)mimeTypeForFile:(NSString *)fullPath;
 - (NSString *)mimeEncodingForFile:(NSString *)fullPath;
 - (NSString *)descriptionForFile:(NSString *)fullPath;
+// Results of many files at once: file path = result. Files which can't be
+// classified are omitted. Results are cached until the file changes.
+- (NSDictionary *)mimeTypesForFiles:(NSArray *)paths;
+- (NSDictionary *)descriptionsForFiles:(NSArray *)paths;
 
 @end
@@ -23,12 +23,24 @@
 //
 
 #include <magic.h> // libmagic
+#include <pthread.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <string.h>
+#include <dispatch/dispatch.h>
 
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSUserDefaults.h>
 #import <Foundation/NSFileManager.h>
 #import <Foundation/NSArray.h>
 #import <Foundation/NSDebug.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSSet.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSValue.h>
 
 #import "NXTDefaults.h"
 #import "NXTFileManager.h"
@@ -37,7 +49,141 @@ NSString *NXTSortFilesBy = @"SortFilesBy";
 NSString *NXTShowHiddenFiles = @"ShowHiddenFiles";
 
 static NXTFileManager *sharedManager;
-static NSString      *dirPath;
+
+// --- libmagic handles and results
+// magic_load() parses the whole magic database, so loaded handles are kept
+// for the life of the thread: one per flag set, because a handle must not
+// be used by several threads at once. Results are remembered by file
+// identity and modification time.
+
+enum {
+  NXTMagicMimeType = 0,
+  NXTMagicMimeEncoding,
+  NXTMagicDescription,
+  NXTMagicCount
+};
+
+static const int magicFlags[NXTMagicCount] = {
+  MAGIC_MIME_TYPE, MAGIC_MIME_ENCODING, MAGIC_NONE
+};
+
+#define MAGIC_CACHE_LIMIT 8192
+
+static pthread_once_t      magicOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t       magicKey;
+static NSMutableDictionary *magicCache;
+static NSLock              *magicCacheLock;
+
+static void _magicHandlesFree(void *data)
+{
+  magic_t *handles = data;
+
+  for (int i = 0; i < NXTMagicCount; i++)
+    {
+      if (handles[i] != NULL)
+        {
+          magic_close(handles[i]);
+        }
+    }
+  free(handles);
+}
+
+static void _magicInitialize(void)
+{
+  pthread_key_create(&magicKey, _magicHandlesFree);
+  magicCache = [[NSMutableDictionary alloc] init];
+  magicCacheLock = [[NSLock alloc] init];
+}
+
+static magic_t _magicHandle(int kind)
+{
+  magic_t *handles = pthread_getspecific(magicKey);
+
+  if (handles == NULL)
+    {
+      handles = calloc(NXTMagicCount, sizeof(magic_t));
+      pthread_setspecific(magicKey, handles);
+    }
+  if (handles[kind] == NULL)
+    {
+      handles[kind] = magic_open(magicFlags[kind]);
+      if (handles[kind] != NULL && magic_load(handles[kind], NULL) != 0)
+        {
+          NSDebugLLog(@"NXTFileManager", @"libmagic: %s", magic_error(handles[kind]));
+          magic_close(handles[kind]);
+          handles[kind] = NULL;
+        }
+    }
+
+  return handles[kind];
+}
+
+static NSString *_magicQuery(int kind, NSString *fullPath)
+{
+  const char  *path = [fullPath fileSystemRepresentation];
+  struct stat st;
+  NSString    *key = nil;
+  NSString    *result;
+  magic_t     cookie;
+  const char  *answer;
+
+  pthread_once(&magicOnce, _magicInitialize);
+
+  // libmagic doesn't follow symbolic links: neither does the key
+  if (lstat(path, &st) == 0)
+    {
+      key = [NSString stringWithFormat:@"%d:%llu:%llu:%lld.%ld:%lld", kind,
+                      (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+                      (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec,
+                      (long long)st.st_size];
+      [magicCacheLock lock];
+      result = [[magicCache objectForKey:key] retain];
+      [magicCacheLock unlock];
+      if (result != nil)
+        {
+          return [result autorelease];
+        }
+    }
+
+  cookie = _magicHandle(kind);
+  if (cookie == NULL || (answer = magic_file(cookie, path)) == NULL)
+    {
+      return nil;
+    }
+  result = [NSString stringWithCString:answer];
+
+  if (key != nil)
+    {
+      [magicCacheLock lock];
+      if ([magicCache count] >= MAGIC_CACHE_LIMIT)
+        {
+          [magicCache removeAllObjects];
+        }
+      [magicCache setObject:result forKey:key];
+      [magicCacheLock unlock];
+    }
+
+  return result;
+}
+
+static NSDictionary *_magicQueryFiles(int kind, NSArray *paths)
+{
+  NSMutableDictionary *results;
+  NSString            *result;
+
+  results = [NSMutableDictionary dictionaryWithCapacity:[paths count]];
+  for (NSString *path in paths)
+    {
+      NSAutoreleasePool *pool = [NSAutoreleasePool new];
+      if ((result = _magicQuery(kind, path)) != nil)
+        {
+          [results setObject:result forKey:path];
+        }
+      [pool release];
+    }
+
+  return results;
+}
 
 NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 {
@@ -68,70 +214,189 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
   return subPath;
 }
 
-@implementation NSString (Sorting)
+@implementation NXTDirectoryEntry
 
-- (NSComparisonResult)byTypeCompare:(NSString *)string
+- (id)initWithName:(NSString *)aName
+              stat:(struct stat *)st
+       isDirectory:(BOOL)isDir
+             owner:(NSString *)owner
 {
-  NSString *ext1 = [self pathExtension];
-  NSString *ext2 = [string pathExtension];
-  
-  return [ext1 localizedCompare:ext2];
+  self = [super init];
+
+  name = [aName copy];
+  switch (st->st_mode & S_IFMT)
+    {
+    case S_IFDIR:  fileType = NSFileTypeDirectory; break;
+    case S_IFREG:  fileType = NSFileTypeRegular; break;
+    case S_IFLNK:  fileType = NSFileTypeSymbolicLink; break;
+    case S_IFCHR:  fileType = NSFileTypeCharacterSpecial; break;
+    case S_IFBLK:  fileType = NSFileTypeBlockSpecial; break;
+    case S_IFSOCK: fileType = NSFileTypeSocket; break;
+    default:       fileType = NSFileTypeUnknown; break;
+    }
+  isDirectory = isDir;
+  size = st->st_size;
+  modificationTime = st->st_mtim.tv_sec + st->st_mtim.tv_nsec / 1000000000.0;
+  ownerName = [owner retain];
+  permissions = st->st_mode & 07777;
+
+  return self;
 }
 
-- (NSComparisonResult)byDateCompare:(NSString *)string
+- (void)dealloc
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString      *path1 = [dirPath stringByAppendingPathComponent:self];
-  NSDate        *date1 = [[fm fileAttributesAtPath:path1 traverseLink:NO]
-                           fileCreationDate];
-  
-  NSString      *path2 = [dirPath stringByAppendingPathComponent:string];
-  NSDate        *date2 = [[fm fileAttributesAtPath:path2 traverseLink:NO]
-                           fileCreationDate];
-  
-  return [date1 compare:date2];
+  [name release];
+  [ownerName release];
+  [super dealloc];
 }
 
-- (NSComparisonResult)bySizeCompare:(NSString *)string
+- (NSString *)name
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString           *path1 = [dirPath stringByAppendingPathComponent:self];
-  unsigned long long size1;
-  NSString           *path2 = [dirPath stringByAppendingPathComponent:string];
-  unsigned long long size2;
+  return name;
+}
+- (NSString *)fileType
+{
+  return fileType;
+}
+- (BOOL)isDirectory
+{
+  return isDirectory;
+}
+- (unsigned long long)fileSize
+{
+  return size;
+}
+- (NSDate *)modificationDate
+{
+  return [NSDate dateWithTimeIntervalSince1970:modificationTime];
+}
+- (NSString *)ownerName
+{
+  return ownerName;
+}
+- (NSUInteger)posixPermissions
+{
+  return permissions;
+}
 
-  size1 = [[fm fileAttributesAtPath:path1 traverseLink:NO] fileSize];
-  size2 = [[fm fileAttributesAtPath:path2 traverseLink:NO] fileSize];
+@end
+
+// --- Directory listing
+// Entries of a directory are read once and stat'ed once: with fstatat()
+// relative to the open directory, on several threads for large directories.
+// Sorting compares the gathered attributes only.
 
-  if (size1 == size2)
-    return NSOrderedSame;
+#define STAT_CHUNK_SIZE    512
+#define STAT_PARALLEL_MIN  2048
 
-  if (size1 > size2)
-    return NSOrderedDescending;
+typedef struct {
+  int         dirFD;
+  char        **names;
+  struct stat *stats;
+  BOOL        *isDirs; // symbolic links are followed
+  size_t      count;
+} NXTStatBatch;
 
-  if (size1 < size2)
-    return NSOrderedAscending;
+static void _statEntries(void *context, size_t chunk)
+{
+  NXTStatBatch *batch = context;
+  size_t       end = (chunk + 1) * STAT_CHUNK_SIZE;
+  struct stat  target;
+
+  if (end > batch->count)
+    {
+      end = batch->count;
+    }
+  for (size_t i = chunk * STAT_CHUNK_SIZE; i < end; i++)
+    {
+      struct stat *st = &batch->stats[i];
 
-  return NSOrderedSame;
+      if (fstatat(batch->dirFD, batch->names[i], st, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+          // removed since readdir(): listed as unknown
+          memset(st, 0, sizeof(struct stat));
+          batch->isDirs[i] = NO;
+        }
+      else if (S_ISLNK(st->st_mode))
+        {
+          batch->isDirs[i] = (fstatat(batch->dirFD, batch->names[i], &target, 0) == 0 &&
+                              S_ISDIR(target.st_mode));
+        }
+      else
+        {
+          batch->isDirs[i] = S_ISDIR(st->st_mode);
+        }
+    }
 }
 
-- (NSComparisonResult)byOwnerCompare:(NSString *)string
+static NSString *_ownerName(uid_t uid, NSMutableDictionary *cache)
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString *path1 = [dirPath stringByAppendingPathComponent:self];
-  NSString *owner1 = [[fm fileAttributesAtPath:path1 traverseLink:NO]
-                       fileOwnerAccountName];
-  NSString *path2 = [dirPath stringByAppendingPathComponent:string];
-  NSString *owner2 = [[fm fileAttributesAtPath:path2 traverseLink:NO]
-                       fileOwnerAccountName];
-  
-  return [owner1 localizedCompare:owner2];
+  NSNumber      *key = [NSNumber numberWithUnsignedInt:uid];
+  NSString      *owner = [cache objectForKey:key];
+  struct passwd pwd, *result = NULL;
+  char          buffer[1024];
+
+  if (owner == nil)
+    {
+      if (getpwuid_r(uid, &pwd, buffer, sizeof(buffer), &result) == 0 && result != NULL)
+        {
+          owner = [NSString stringWithCString:pwd.pw_name];
+        }
+      else
+        {
+          owner = [NSString stringWithFormat:@"%u", uid];
+        }
+      [cache setObject:owner forKey:key];
+    }
+
+  return owner;
 }
 
-@end
+static NSInteger _compareEntries(id entry1, id entry2, void *context)
+{
+  NXTDirectoryEntry  *e1 = entry1;
+  NXTDirectoryEntry  *e2 = entry2;
+  NXTSortType        sortType = (NXTSortType)(intptr_t)context;
+  NSComparisonResult result = NSOrderedSame;
+
+  if ((sortType == NXTSortByKind || sortType == NXTSortByType) &&
+      e1->isDirectory != e2->isDirectory)
+    {
+      return e1->isDirectory ? NSOrderedAscending : NSOrderedDescending;
+    }
+
+  switch (sortType)
+    {
+    case NXTSortByType:
+      result = [[e1->name pathExtension] localizedCompare:[e2->name pathExtension]];
+      break;
+    case NXTSortByDate:
+      if (e1->modificationTime != e2->modificationTime)
+        {
+          result = (e1->modificationTime < e2->modificationTime) ? NSOrderedAscending
+                                                                 : NSOrderedDescending;
+        }
+      break;
+    case NXTSortBySize:
+      if (e1->size != e2->size)
+        {
+          result = (e1->size < e2->size) ? NSOrderedAscending : NSOrderedDescending;
+        }
+      break;
+    case NXTSortByOwner:
+      result = [e1->ownerName localizedCompare:e2->ownerName];
+      break;
+    default:
+      break;
+    }
+
+  if (result == NSOrderedSame)
+    {
+      result = [e1->name localizedCompare:e2->name];
+    }
+
+  return result;
+}
 
 @implementation NXTFileManager
 
@@ -245,86 +510,130 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
                             sortedBy:(NXTSortType)sortType
                           showHidden:(BOOL)showHidden
 {
-  
-  NSFileManager  *fm = [NSFileManager defaultManager];
+  NSArray        *entries;
   NSMutableArray *dirContents;
-  SEL            compareSelector = 0;
-  BOOL           foldersFirst = NO;
 
-  dirPath = path;
-  
-  switch (sortType)
+  entries = [self directoryEntriesAtPath:path
+                                 forPath:targetPath
+                                sortedBy:sortType
+                              showHidden:showHidden];
+  if (entries == nil)
+    return nil;
+
+  dirContents = [NSMutableArray arrayWithCapacity:[entries count]];
+  for (NXTDirectoryEntry *entry in entries)
     {
-    case NXTSortByName:  // = 0
-      compareSelector = @selector(localizedCompare:);
-      break;
-    case NXTSortByKind:  // = 1
-      compareSelector = @selector(localizedCompare:);
-      foldersFirst = YES;
-      break;
-    case NXTSortByType:  // = 2
-      compareSelector = @selector(byTypeCompare:);
-      foldersFirst = YES;
-      break;
-    case NXTSortByDate:  // = 3
-      compareSelector = @selector(byDateCompare:);
-      break;
-    case NXTSortBySize:  // = 4
-      compareSelector = @selector(bySizeCompare:);
-      break;
-    case NXTSortByOwner: // = 5
-      compareSelector = @selector(byOwnerCompare:);
-      break;
+      [dirContents addObject:entry->name];
     }
 
-  dirContents = [[self directoryContentsAtPath:path
-                                       forPath:targetPath
-                                    showHidden:showHidden] mutableCopy];
-  if (!dirContents)
+  return dirContents;
+}
+
+- (NSArray *)directoryEntriesAtPath:(NSString *)path
+                            forPath:(NSString *)targetPath
+                           sortedBy:(NXTSortType)sortType
+                         showHidden:(BOOL)showHidden
+{
+  NSMutableSet        *hiddenFiles = nil;
+  NSMutableArray      *names;
+  NSMutableArray      *entries;
+  NSMutableDictionary *owners;
+  NXTStatBatch        batch = {0};
+  size_t              capacity = 256;
+  size_t              chunks;
+  DIR                 *dir;
+  struct dirent       *de;
+
+  if ((dir = opendir([path fileSystemRepresentation])) == NULL)
     return nil;
-  
-  if (foldersFirst) {
-    NSEnumerator   *e = [dirContents objectEnumerator];
-    NSMutableArray *dirs = [[NSMutableArray alloc] init];
-    NSMutableArray *files = [[NSMutableArray alloc] init];
-    NSString       *entry = nil;
-    NSDictionary   *fattrs;
-    BOOL           isDir;
-    NSString       *fp;
-
-    while ((entry = [e nextObject]) != nil) {
-      fp = [path stringByAppendingPathComponent:entry];
-      fattrs = [fm fileAttributesAtPath:fp traverseLink:YES];
-
-      if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory]) {
-        [dirs addObject:entry];
-      }
-      else {
-        [files addObject:entry];
-      }
+
+  if (showHidden == NO)
+    {
+      NSString *hiddenFilename = [path stringByAppendingPathComponent:@".hidden"];
+      NSString *h = [NSString stringWithContentsOfFile:hiddenFilename];
+
+      if (h != nil)
+        {
+          hiddenFiles = [NSMutableSet set];
+          for (NSString *filename in [h componentsSeparatedByString:@"\n"])
+            {
+              if (![targetPath
+                     hasPrefix:[path stringByAppendingPathComponent:filename]])
+                {
+                  [hiddenFiles addObject:filename];
+                }
+            }
+        }
     }
 
-    // Empty dirContents
-    [dirContents removeAllObjects];
+  names = [NSMutableArray arrayWithCapacity:capacity];
+  batch.dirFD = dirfd(dir);
+  batch.names = malloc(capacity * sizeof(char *));
+  while ((de = readdir(dir)) != NULL)
+    {
+      NSString *filename;
+
+      if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+        continue;
+      if (showHidden == NO && de->d_name[0] == '.')
+        continue;
+
+      filename = [self stringWithFileSystemRepresentation:de->d_name
+                                                   length:strlen(de->d_name)];
+      if (hiddenFiles != nil && [hiddenFiles containsObject:filename])
+        continue;
+
+      if (batch.count == capacity)
+        {
+          capacity *= 2;
+          batch.names = realloc(batch.names, capacity * sizeof(char *));
+        }
+      batch.names[batch.count++] = strdup(de->d_name);
+      [names addObject:filename];
+    }
 
-    // Add sorted directories
-    [dirs sortUsingSelector:compareSelector];
-    [dirContents addObjectsFromArray:dirs];
-    [dirs release];
+  batch.stats = malloc(batch.count * sizeof(struct stat));
+  batch.isDirs = malloc(batch.count * sizeof(BOOL));
+  chunks = (batch.count + STAT_CHUNK_SIZE - 1) / STAT_CHUNK_SIZE;
+  if (batch.count >= STAT_PARALLEL_MIN)
+    {
+      dispatch_apply_f(chunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+                       &batch, _statEntries);
+    }
+  else
+    {
+      for (size_t i = 0; i < chunks; i++)
+        {
+          _statEntries(&batch, i);
+        }
+    }
+  closedir(dir);
 
-    // Add sorted files
-    [files sortUsingSelector:compareSelector];
-    [dirContents addObjectsFromArray:files];
-    [files release];
-  }
-  else {
-    [dirContents sortUsingSelector:compareSelector];
-  }
+  entries = [NSMutableArray arrayWithCapacity:batch.count];
+  owners = [NSMutableDictionary dictionary];
+  for (size_t i = 0; i < batch.count; i++)
+    {
+      NXTDirectoryEntry *entry;
+
+      entry = [[NXTDirectoryEntry alloc] initWithName:[names objectAtIndex:i]
+                                                 stat:&batch.stats[i]
+                                          isDirectory:batch.isDirs[i]
+                                                owner:_ownerName(batch.stats[i].st_uid, owners)];
+      [entries addObject:entry];
+      [entry release];
+      free(batch.names[i]);
+    }
+  free(batch.names);
+  free(batch.stats);
+  free(batch.isDirs);
+
+  [entries sortUsingFunction:_compareEntries context:(void *)(intptr_t)sortType];
 
-  return AUTORELEASE(dirContents);
+  return entries;
 }
 
 // --- Search path
+
 - (NSArray *)executablesForSubstring:(NSString *)substring
 {
   NSString       *envPath;
@@ -448,56 +757,27 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 // --- Files (libmagic)
 - (NSString *)mimeTypeForFile:(NSString *)fullPath
 {
-  magic_t    cookie;
-  const char *mime_type;
-  NSString   *mimeType;
-  
-  cookie = magic_open(MAGIC_MIME_TYPE);
-  magic_load(cookie, NULL);
-
-  mime_type = magic_file(cookie, [fullPath cString]);
-  
-  mimeType = [NSString stringWithCString:mime_type];
-
-  magic_close(cookie);
-
-  return mimeType;
+  return _magicQuery(NXTMagicMimeType, fullPath);
 }
 
 - (NSString *)mimeEncodingForFile:(NSString *)fullPath
 {
-  magic_t    cookie;
-  const char *mime_enc;
-  NSString   *mimeEncoding;
-  
-  cookie = magic_open(MAGIC_MIME_ENCODING);
-  magic_load(cookie, NULL);
-
-  mime_enc = magic_file(cookie, [fullPath cString]);
-  
-  mimeEncoding = [NSString stringWithCString:mime_enc];
-
-  magic_close(cookie);
-
-  return mimeEncoding;
+  return _magicQuery(NXTMagicMimeEncoding, fullPath);
 }
 
 - (NSString *)descriptionForFile:(NSString *)fullPath
 {
-  magic_t    cookie;
-  const char *description;
-  NSString   *fileDescription;
-  
-  cookie = magic_open(MAGIC_NONE);
-  magic_load(cookie, NULL);
+  return _magicQuery(NXTMagicDescription, fullPath);
+}
 
-  description = magic_file(cookie, [fullPath cString]);
-  
-  fileDescription = [NSString stringWithCString:description];
-  
-  magic_close(cookie);
+- (NSDictionary *)mimeTypesForFiles:(NSArray *)paths
+{
+  return _magicQueryFiles(NXTMagicMimeType, paths);
+}
 
-  return fileDescription;
+- (NSDictionary *)descriptionsForFiles:(NSArray *)paths
+{
+  return _magicQueryFiles(NXTMagicDescription, paths);
 }
 
 @end
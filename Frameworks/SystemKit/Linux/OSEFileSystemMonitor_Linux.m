@@ -33,12 +33,22 @@
 
 #include <sys/inotify.h>
 #include <unistd.h>
-#include <poll.h>
-#include <sys/ioctl.h>
+#include <limits.h>
+#include <stdint.h>
+
+// Room for 64 events with longest names
+#define EVENT_BUFFER_SIZE (64 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+// Events of directory are collected during this interval and sent at once
+#define EVENT_COALESCE_INTERVAL 0.1
 
 int in_fd = -1;
 
 NSMutableDictionary *_pathFDList = nil;
+NSMutableDictionary *_descriptorPathList = nil; // watch descriptor = path
+NSMutableDictionary *_pendingEvents = nil;      // path = event info
+NSMutableArray      *_readyEvents = nil;        // closed event infos
+NSTimer             *_flushTimer = nil;
+BOOL                _isWatchingDescriptor = NO;
 NSLock              *monitorLock = nil;
 
 @implementation OSEFileSystemMonitorThread (Linux)
@@ -53,12 +63,16 @@ NSLock              *monitorLock = nil;
 
   // Initialize OS-specific part
   _pathFDList = [[NSMutableDictionary alloc] init];
+  _descriptorPathList = [[NSMutableDictionary alloc] init];
+  _pendingEvents = [[NSMutableDictionary alloc] init];
+  _readyEvents = [[NSMutableArray alloc] init];
 
   // inotify
   if (in_fd < 0)
     {
-      // Creates a new kernel event queue and returns a descriptor.
-      if ((in_fd = inotify_init()) < 0)
+      // Creates a new kernel event queue and returns a descriptor. Events
+      // are read until queue is empty, so it must not block.
+      if ((in_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
 	{
 	  NSLog(@"OSEFileSystemMonitorThread(Linux): Could not open inotify(7)"
                 " descriptor. Error: %s.\n", strerror(errno));
@@ -70,8 +84,6 @@ NSLock              *monitorLock = nil;
   threadDict = [[NSThread currentThread] threadDictionary];
   [threadDict setValue:[NSNumber numberWithBool:NO] 
 		forKey:@"ThreadShouldExitNow"];
-  [threadDict setValue:[NSNumber numberWithBool:NO] 
-		forKey:@"ThreadShouldCheckForEvents"];
 
   monitorLock = [[NSLock alloc] init];
 
@@ -94,19 +106,10 @@ NSLock              *monitorLock = nil;
 //     LinkCount = 2;
 //   }
 // }
+// _descriptorPathList is reverse of it: { 28 = "/Users/me/Temporary"; }
 - (NSString *)_pathForDescriptor:(int)wd
 {
-  NSNumber *aDescriptor = [NSNumber numberWithInt:wd];
-  NSArray  *pathList = [_pathFDList allKeys];
-
-  for (NSString *path in pathList)
-    {
-      NSDictionary *element = [_pathFDList objectForKey:path];
-      if ([[element objectForKey:@"Descriptor"] isEqualToValue:aDescriptor])
-        return path;
-    }
-
-  return nil;
+  return [_descriptorPathList objectForKey:[NSNumber numberWithInt:wd]];
 }
 
 - (void)_addPath:(NSString *)absolutePath
@@ -157,6 +160,11 @@ NSLock              *monitorLock = nil;
                     [NSNumber numberWithInt:link_count], @"LinkCount", nil];
 
   [_pathFDList setObject:pathDict forKey:pathString];
+  if (path_fd >= 0)
+    {
+      [_descriptorPathList setObject:pathString
+                              forKey:[NSNumber numberWithInt:path_fd]];
+    }
 
   NSDebugLLog(@"OSEFileSystemMonitor",
               @"OSEFileSystemMonitorThread(Linux): addEventMonitorPath: %@ -- %@", 
@@ -198,6 +206,10 @@ NSLock              *monitorLock = nil;
       inotify_rm_watch(in_fd, path_fd);
       [self checkForEvents];
       [_pathFDList removeObjectForKey:absolutePath];
+      if ([[self _pathForDescriptor:path_fd] isEqualToString:absolutePath])
+        {
+          [_descriptorPathList removeObjectForKey:[NSNumber numberWithInt:path_fd]];
+        }
     }
   else
     {
@@ -224,9 +236,17 @@ NSLock              *monitorLock = nil;
       return;
     }
   
-  // Start checking for events
-  [threadDict setValue:[NSNumber numberWithBool:YES] 
-		forKey:@"ThreadShouldCheckForEvents"];
+  // Start checking for events: wake up when inotify descriptor is readable
+  if (_isWatchingDescriptor == NO && in_fd >= 0)
+    {
+      [[NSRunLoop currentRunLoop] addEvent:(void *)(intptr_t)in_fd
+                                      type:ET_RDESC
+                                   watcher:self
+                                   forMode:NSDefaultRunLoopMode];
+      _isWatchingDescriptor = YES;
+      // Events queued while monitor was stopped
+      [self checkForEvents];
+    }
 }
 
 - (oneway void)_stopThread
@@ -235,9 +255,15 @@ NSLock              *monitorLock = nil;
               @"OSEFileSystemMonitorThread(Linux): stopEventMonitorThread: "
               "inotify descriptor %i", in_fd);
 
-  // Stop checking for events
-  [threadDict setValue:[NSNumber numberWithBool:NO] 
-		forKey:@"ThreadShouldCheckForEvents"];
+  // Stop checking for events. Kernel keeps queueing them.
+  if (_isWatchingDescriptor == YES)
+    {
+      [[NSRunLoop currentRunLoop] removeEvent:(void *)(intptr_t)in_fd
+                                         type:ET_RDESC
+                                      forMode:NSDefaultRunLoopMode
+                                          all:YES];
+      _isWatchingDescriptor = NO;
+    }
 }
 
 - (oneway void)_terminateThread
@@ -258,173 +284,205 @@ NSLock              *monitorLock = nil;
   close(in_fd);
   in_fd = -1;
 
+  [_flushTimer invalidate];
+  _flushTimer = nil;
+
   [_pathFDList release];
+  _pathFDList = nil;
+  [_descriptorPathList release];
+  _descriptorPathList = nil;
+  [_pendingEvents release];
+  _pendingEvents = nil;
+  [_readyEvents release];
+  _readyEvents = nil;
  
   // Instruct thread to exit
   [threadDict setValue:[NSNumber numberWithBool:YES]
 		forKey:@"ThreadShouldExitNow"];
 }
 
-// #define EVENT_SIZE  ( sizeof (struct inotify_event) )
-// #define BUF_LEN     ( 1024 * ( EVENT_SIZE + 16 ) )
+// Run loop watcher callback: inotify descriptor has events to read
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+  if (type == ET_RDESC)
+    [self checkForEvents];
+}
 
-- (void)checkForEvents
+// Adds `operations` to pending event info of directory at `path`.
+- (void)_addOperations:(NSArray *)operations
+                  file:(NSString *)file
+                atPath:(NSString *)path
 {
-  int           ret, i;
-  struct pollfd pfd = { in_fd, POLLIN, 0 };
+  NSMutableDictionary *eventInfo = [_pendingEvents objectForKey:path];
+  NSArray             *exOps = [eventInfo objectForKey:@"Operations"];
 
-  // NSLog(@"OSEFileSystemMonitorThread [checkForFSEvents]: checking for events...");
+  if (eventInfo == nil)
+    {
+      eventInfo = [NSMutableDictionary dictionaryWithObject:path
+                                                     forKey:@"ChangedPath"];
+      [_pendingEvents setObject:eventInfo forKey:path];
+      exOps = [NSArray array];
+    }
+
+  [eventInfo setObject:file forKey:@"ChangedFile"];
+  for (NSString *op in operations)
+    {
+      if ([exOps indexOfObject:op] == NSNotFound)
+        exOps = [exOps arrayByAddingObject:op];
+    }
+  [eventInfo setObject:exOps forKey:@"Operations"];
+}
+
+// Event info of directory:
+//   {
+//     Operations = (Write, MovedFrom, Rename);
+//     ChangedPath = "/Users/me";
+//     ChangedFile = "111.txt";
+//     ChangedFileTo = "222.txt"; // only for rename
+//   };
+// Events of directory are merged into one event info. Rename is made of
+// MovedFrom and MovedTo events, so it's kept separate from other operations:
+// it closes pending event info of directory and is closed by next event.
+- (void)_queueEvent:(struct inotify_event *)event
+{
+  NSString            *path = [self _pathForDescriptor:event->wd];
+  NSString            *file;
+  NSMutableDictionary *eventInfo;
+  NSArray             *exOps;
+  NSArray             *operations = nil;
 
-  // Sanity check
-  if (!_pathFDList || [[_pathFDList allKeys] count] <= 0)
+  if (path == nil || event->len == 0)
     return;
 
-  // Determine if inotify(7) file descriptor has events to read
-  ret = poll(&pfd, 1, 10); // timeout of 50ms
-  if (ret < 0)
+  file = [NSString stringWithCString:event->name];
+  eventInfo = [_pendingEvents objectForKey:path];
+  exOps = [eventInfo objectForKey:@"Operations"];
+
+  if ((event->mask & IN_MOVED_TO) &&
+      [[exOps lastObject] isEqualToString:@"MovedFrom"])
     {
-      fprintf(stderr, "poll failed: %s\n", strerror(errno));
+      // ChangedPath & ChangedFile was added in IN_MOVED_FROM part
+      [eventInfo setObject:file forKey:@"ChangedFileTo"];
+      [eventInfo setObject:[exOps arrayByAddingObject:@"Rename"]
+                    forKey:@"Operations"];
+      // fprintf(stderr, ">>> The %s was renamed to %s.\n",
+      //         [[eventInfo objectForKey:@"ChangedFile"] cString], event->name);
+      return;
     }
-  else if (ret > 0)
+
+  if (eventInfo && ((event->mask & IN_MOVED_FROM) ||
+                    [exOps indexOfObject:@"MovedFrom"] != NSNotFound))
     {
-      int          event_count, i;
-      unsigned int data_size;
-      // Find size of available data
-      ioctl(in_fd, FIONREAD, &data_size);
-      // Define buffer based on found size of available data
-      char buffer[data_size];
-
-      event_count = read(in_fd, buffer, data_size);
-      
-      if (event_count < 0)
-        {
-          // An error occurred.
-          fprintf(stderr, "An error occurred (event count %d).  " \
-                  "The error was %i: %s.\n", 
-                  event_count, errno, strerror(errno));
-          return;
-        }
+      [_readyEvents addObject:eventInfo];
+      [_pendingEvents removeObjectForKey:path];
+    }
+
+  if (event->mask & (IN_CREATE | IN_MOVED_TO))
+    {
+      operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
+    }
+  else if ((event->mask & IN_DELETE) || (event->mask & IN_DELETE_SELF))
+    {
+      operations = [NSArray arrayWithObjects:@"Write", @"Delete", nil];
+    }
+  else if (event->mask & IN_MODIFY)
+    {
+      // During file downloading generates event every 10-20ms.
+      // Currently it's switched off in _addPath:.
+      operations = [NSArray arrayWithObjects:@"Write", nil];
+    }
+  else if (event->mask & IN_ATTRIB)
+    {
+      operations = [NSArray arrayWithObjects:@"Attributes", nil];
+    }
+  else if (event->mask & IN_MOVED_FROM)
+    {
+      operations = [NSArray arrayWithObjects:@"Write", @"MovedFrom", nil];
+    }
+
+  if (operations)
+    {
+      [self _addOperations:operations file:file atPath:path];
+    }
+}
+
+// Kernel event queue overflowed - events were lost. Contents of every
+// monitored directory must be reread.
+- (void)_queueRescan
+{
+  NSArray *operations = [NSArray arrayWithObjects:@"Write", @"Rescan", nil];
+
+  NSLog(@"OSEFileSystemMonitorThread(Linux): inotify(7) event queue "
+        "overflow, requesting rescan of monitored paths.");
+
+  for (NSString *path in [_pathFDList allKeys])
+    {
+      [self _addOperations:operations file:@"" atPath:path];
+    }
+}
+
+- (void)_flushEvents:(NSTimer *)timer
+{
+  NSArray *events;
+
+  _flushTimer = nil;
 
-      // eventList
-      // 3 =
-      // {
-      //   Operations = (Rename);
-      //   ChangedPath = "/Users/me";
-      //   ChangedFile = "111.txt";
-      //   ChangedPathTo = "222.txt"; // only for rename
-      // };
-      NSMutableDictionary *eventList = [[NSMutableDictionary alloc] init];
-      NSMutableDictionary *eventInfo = nil;
-      i = 0;
-      while (i < event_count)
+  [_readyEvents addObjectsFromArray:[_pendingEvents allValues]];
+  [_pendingEvents removeAllObjects];
+  if ([_readyEvents count] == 0)
+    return;
+
+  events = [NSArray arrayWithArray:_readyEvents];
+  [_readyEvents removeAllObjects];
+
+  NSDebugLLog(@"OSEFileSystemMonitor",
+              @"[NXFSM_Linux] send events: %@", events);
+  [monitorOwner handleEvents:events];
+}
+
+- (void)checkForEvents
+{
+  char                 buffer[EVENT_BUFFER_SIZE]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  struct inotify_event *event;
+  ssize_t              length;
+  char                 *ptr;
+
+  if (in_fd < 0)
+    return;
+
+  // Descriptor is non-blocking: read until kernel queue is empty
+  while ((length = read(in_fd, buffer, sizeof(buffer))) > 0)
+    {
+      for (ptr = buffer; ptr < buffer + length;
+           ptr += sizeof(struct inotify_event) + event->len)
         {
-          struct inotify_event *event = (struct inotify_event *)&buffer[i];
-          NSString *path = [self _pathForDescriptor:event->wd];
-          NSString *file = [NSString stringWithCString:event->name];
-          NSString *watchDescriptor = [NSString stringWithFormat:@"%i", event->wd];
-          NSArray  *operations = nil, *exOps = nil;
-
-          if ((eventInfo = [eventList objectForKey:watchDescriptor]) != nil)
-            {
-              exOps = [eventInfo objectForKey:@"Operations"];
-            }
+          event = (struct inotify_event *)ptr;
+          if (event->mask & IN_Q_OVERFLOW)
+            [self _queueRescan];
           else
-            {
-              eventInfo = [NSMutableDictionary new];
-            }
-          
-          if (event->len)
-            {
-              if (event->mask & IN_CREATE)
-                {
-                  operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                  // fprintf(stderr, ">>> The %s was created.\n", event->name);
-                }
-              else if ((event->mask & IN_DELETE) || (event->mask & IN_DELETE_SELF))
-                {
-                  operations = [NSArray arrayWithObjects:@"Write", @"Delete", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                  // fprintf(stderr, ">>> The %s was deleted.\n", event->name);
-                }
-              else if (event->mask & IN_MODIFY)
-                {
-                  // During file downloading generates event every 10-20ms.
-                  // Currently it's switched off in _addPath:.
-                  operations = [NSArray arrayWithObjects:@"Write", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                  // fprintf(stderr, ">>> The %s was modified.\n", event->name);
-                }
-              else if (event->mask & IN_ATTRIB)
-                {
-                  operations = [NSArray arrayWithObjects:@"Attributes", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                  // fprintf(stderr, ">>> The %s attributes was modified.\n", event->name);
-                }
-              else if (event->mask & IN_MOVED_FROM)
-                {
-                  operations = [NSArray arrayWithObjects:@"Write", @"MovedFrom", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-                  
-                  // fprintf(stderr, ">>> The %s was moved from.\n", event->name);
-                }
-              else if (event->mask & IN_MOVED_TO)
-                {
-                  NSString *fileTo = nil;
-
-                  if (exOps &&
-                      ([exOps indexOfObject:@"MovedFrom"] != NSNotFound))
-                    {
-                      fileTo = [NSString stringWithCString:event->name];
-                      
-                      operations = [NSArray arrayWithObjects:@"Rename", nil];
-                      // ChangedPath & ChangedFile was added in IN_MOVED_FROM part
-                      [eventInfo setObject:fileTo forKey:@"ChangedFileTo"];
-                      
-                      // fprintf(stderr, ">>> The %s was renamed to %s.\n",
-                      //         [file cString], event->name);
-                    }
-                  else
-                    {
-                      operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
-                      [eventInfo setObject:path forKey:@"ChangedPath"];
-                      [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                      // fprintf(stderr, ">>> The %s was moved to.\n", event->name);
-                    }
-                }
-              
-              if (exOps)
-                {
-                  operations = [exOps arrayByAddingObjectsFromArray:operations];
-                }
-              [eventInfo setObject:operations forKey:@"Operations"];
-              [eventList setObject:eventInfo forKey:watchDescriptor];
-            }
-
-          i += sizeof(struct inotify_event) + event->len;
+            [self _queueEvent:event];
         }
+    }
+  if (length < 0 && errno != EAGAIN && errno != EINTR)
+    {
+      NSLog(@"OSEFileSystemMonitorThread(Linux): reading of inotify(7) "
+            "events failed. Error: %s.", strerror(errno));
+    }
 
-      // Now we have an eventList dictionary which contains information about
-      // all read file system events
-      if (eventList && [[eventList allKeys] count] > 0)
-        {
-          NSDebugLLog(@"OSEFileSystemMonitor",
-                      @"[NXFSM_Linux] send eventList: %@", eventList);
-          for (NSString *wd in [eventList allKeys])
-            {
-              [monitorOwner handleEvent:[eventList objectForKey:wd]];
-            }
-        }
+  // Deliver collected events a bit later: events of directory which
+  // arrive meanwhile (e.g. during large copy) will be sent with them.
+  if (_flushTimer == nil && ([_pendingEvents count] || [_readyEvents count]))
+    {
+      _flushTimer = [NSTimer
+                      scheduledTimerWithTimeInterval:EVENT_COALESCE_INTERVAL
+                                              target:self
+                                            selector:@selector(_flushEvents:)
+                                            userInfo:nil
+                                             repeats:NO];
     }
 }
 
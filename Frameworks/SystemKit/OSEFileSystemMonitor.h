@@ -38,6 +38,12 @@
 //
 // (EventMonitorOwner) category methods is primary way to manipulate
 // process of monitoring file system events (front class for applications).
+//
+// Monitor thread sleeps in its run loop until kernel reports events.
+// Events of one directory are collected during short interval and posted
+// as one OSEFileSystemChangedAtPath notification. If kernel event queue
+// overflows, events are lost and every monitored directory is reported with
+// "Rescan" operation (along with "Write") - its contents must be reread.
 
 #import <Foundation/Foundation.h>
 
@@ -76,6 +82,7 @@ extern NSString *OSEFileSystemChangedAtPath;
 - (void)pause;
 - (void)resume;
 - (void)terminate;
+- (oneway void)handleEvents:(bycopy NSArray *)events;
 - (void)handleEvent:(NSDictionary *)event;
 
 @end
@@ -240,6 +240,17 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
   [monitorThread release];
 }
 
+// Events collected by monitor thread during short interval: one event per
+// changed directory. It's oneway - monitor thread doesn't wait for
+// notification observers.
+- (oneway void)handleEvents:(bycopy NSArray *)events
+{
+  for (NSDictionary *event in events)
+    {
+      [self handleEvent:event];
+    }
+}
+
 // It's called from NFileSystemMonitor thread and should be fast.
 // Otherwise NSRunLoop blocked until all events will be handled.
 - (void)handleEvent:(NSDictionary *)event
@@ -284,19 +295,15 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
   NSDebugLLog(@"OSEFileSystemMonitor", @"%@: waiting for messages", self);
 
   // ---- Main loop ----
+  // Kernel events are run loop input: OS-specific part adds it on
+  // `_startThread` and removes on `_stopThread`. Thread sleeps until events
+  // or messages from owner arrive.
   runLoop = [NSRunLoop currentRunLoop];
   threadDict = [[NSThread currentThread] threadDictionary];
   while (!exitNow)
     {
-      // Process AppKit and Foundation events
-      [runLoop runMode:NSDefaultRunLoopMode 
-            beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
-
-      // Process kernel events
-      if ([[threadDict valueForKey:@"ThreadShouldCheckForEvents"] boolValue])
-	{
-          [threadObject checkForEvents];
-	}
+      // Process owner messages, timers and kernel events
+      [runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
 
       // Check to see if an input source handler changed the exitNow value.
       exitNow = [[threadDict valueForKey:@"ThreadShouldExitNow"] boolValue];
@@ -368,7 +375,8 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
               "No OS-specific code found!");
 }
 
-// Overriden method must call handleEvents:atPath: if events available
+// Overriden method must read available events without blocking and
+// deliver them to owner with handleEvents:
 - (void)checkForEvents
 {
   // OS specific part
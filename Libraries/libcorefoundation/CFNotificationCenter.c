@@ -27,6 +27,7 @@
 #include <CoreFoundation/CFLocking.h>
 
 #include "CFNotificationCenter.h"
+#include "CFNotificationQueue.h"
 #include "CFRuntime.h"
 #include "CFRuntime_Internal.h"
 #include "CFRuntime.h"
@@ -36,6 +37,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_LINUX
 #include <unistd.h>
 #endif
@@ -45,6 +47,7 @@
 #define CF_DARWIN_CENTER	2
 
 #define CF_OBS_SIZE	32
+#define CF_NAME_SIZE	64 // initial number of index buckets, power of 2
 
 typedef struct __CFObserver {
   //CFStringRef name; // can be NULL
@@ -53,8 +56,33 @@ typedef struct __CFObserver {
   const void *observer; // may be NULL
   CFNotificationCallback callback;
   CFNotificationSuspensionBehavior sb;
+  CFIndex order; // registration sequence number, observers are called in this order
 } __CFObserver;
 
+// observer records in registration order, without empty slots
+typedef struct __CFObserverList {
+  CFIndex count;
+  CFIndex capacity;
+  __CFObserver **obs;
+} __CFObserverList;
+
+// entry of the index: all observers of one name hash and object (NULL - any object)
+typedef struct __CFNameEntry {
+  CFHashCode hash;
+  const void *object;
+  __CFObserverList list;
+  struct __CFNameEntry *next;
+} __CFNameEntry;
+
+// notification queued with CFNotificationCenterEnqueueNotification(). name is NULL
+// once it was delivered or dequeued.
+typedef struct __CFPendingNotification {
+  CFHashCode hash;
+  CFStringRef name;
+  const void *object;
+  CFDictionaryRef userInfo;
+} __CFPendingNotification;
+
 typedef OSSpinLock CFSpinLock_t;
 
 struct __CFNotificationCenter {
@@ -63,7 +91,19 @@ struct __CFNotificationCenter {
   CFIndex suspended; // <- move into base bits?
   CFIndex observers;
   CFIndex capacity;
-  __CFObserver *obs;
+  __CFObserver **obs; // every observer, compacted on removal
+  CFIndex order; // sequence number of the next observer
+  CFIndex names; // entries in the index
+  CFIndex buckets;
+  __CFNameEntry **index; // observers with a name, by name hash and object
+  __CFObserverList wildcard; // observers with NULL name
+  CFIndex dispatching; // __CFInvokeCallBacks nesting level
+  __CFObserverList removed; // removed while dispatching, freed afterwards
+  CFIndex pendingCount;
+  CFIndex pendingCapacity;
+  __CFPendingNotification *pending;
+  CFRunLoopRef pendingRunLoop; // where queued notifications are delivered
+  CFRunLoopObserverRef pendingObserver;
   CFSpinLock_t lock;
 };
 
@@ -663,6 +703,146 @@ void __CFDarwinRemoveNotification(CFHashCode hash, CFHashCode ignored) {
 }
 
 
+/*
+ *	Observers are found by notification name and object: each pair of name hash and
+ *	object (NULL for observers of any object) has its own list in the center's index.
+ *	Observers of any name (NULL name) are kept in the wildcard list. Posting a
+ *	notification looks at the lists of its name with its object and with any object,
+ *	and at the wildcard list, never at observers of other names or objects. Lists are
+ *	kept in registration order, so observers are called in the same order as before.
+ */
+Boolean __CFListAppend(__CFObserverList *list, __CFObserver *obs);
+void __CFListRemove(__CFObserverList *list, __CFObserver *obs);
+CFIndex __CFIndexBucket(CFHashCode hash, const void *object, CFIndex buckets);
+__CFNameEntry *__CFIndexFind(CFNotificationCenterRef center, CFHashCode hash, const void *object);
+__CFNameEntry *__CFIndexAdd(CFNotificationCenterRef center, CFHashCode hash, const void *object);
+void __CFIndexRemove(CFNotificationCenterRef center, __CFNameEntry *entry);
+void __CFUnlinkObserver(CFNotificationCenterRef center, __CFObserver *obs);
+
+Boolean __CFListAppend(__CFObserverList *list, __CFObserver *obs) {
+  if (list->count == list->capacity) {
+    CFIndex capacity = (list->capacity == 0) ? 4 : list->capacity * 2;
+    __CFObserver **new = (__CFObserver**)realloc(list->obs, capacity * sizeof(__CFObserver*));
+    if (new == NULL) {
+      return FALSE;
+    }
+    list->obs = new;
+    list->capacity = capacity;
+  }
+  list->obs[list->count++] = obs;
+  return TRUE;
+}
+
+void __CFListRemove(__CFObserverList *list, __CFObserver *obs) {
+  for (CFIndex i = 0; i < list->count; i++) {
+    if (list->obs[i] == obs) {
+      list->count--;
+      memmove(list->obs + i, list->obs + i + 1, (list->count - i) * sizeof(__CFObserver*));
+      return;
+    }
+  }
+}
+
+CFIndex __CFIndexBucket(CFHashCode hash, const void *object, CFIndex buckets) {
+  uintptr_t key = (uintptr_t)object;
+
+  // objects are mostly aligned pointers: mix in their high bits
+  key ^= key >> 17;
+  key *= 0x9E3779B1u;
+  return (CFIndex)((hash ^ key) & (buckets - 1));
+}
+
+__CFNameEntry *__CFIndexFind(CFNotificationCenterRef center, CFHashCode hash, const void *object) {
+  __CFNameEntry *entry = center->index[__CFIndexBucket(hash, object, center->buckets)];
+
+  while ((entry != NULL) && ((entry->hash != hash) || (entry->object != object))) {
+    entry = entry->next;
+  }
+  return entry;
+}
+
+__CFNameEntry *__CFIndexAdd(CFNotificationCenterRef center, CFHashCode hash, const void *object) {
+  __CFNameEntry *entry = __CFIndexFind(center, hash, object);
+
+  if (entry != NULL) {
+    return entry;
+  }
+
+  // keep chains short: double the buckets when there are more entries than buckets
+  if (center->names == center->buckets) {
+    CFIndex buckets = center->buckets * 2;
+    __CFNameEntry **index = (__CFNameEntry**)calloc(buckets, sizeof(__CFNameEntry*));
+    if (index != NULL) {
+      for (CFIndex i = 0; i < center->buckets; i++) {
+        while ((entry = center->index[i]) != NULL) {
+          CFIndex bucket = __CFIndexBucket(entry->hash, entry->object, buckets);
+          center->index[i] = entry->next;
+          entry->next = index[bucket];
+          index[bucket] = entry;
+        }
+      }
+      free(center->index);
+      center->index = index;
+      center->buckets = buckets;
+    }
+  }
+
+  entry = (__CFNameEntry*)calloc(1, sizeof(__CFNameEntry));
+  if (entry == NULL) {
+    return NULL;
+  }
+  entry->hash = hash;
+  entry->object = object;
+  entry->next = center->index[__CFIndexBucket(hash, object, center->buckets)];
+  center->index[__CFIndexBucket(hash, object, center->buckets)] = entry;
+  center->names++;
+
+  return entry;
+}
+
+void __CFIndexRemove(CFNotificationCenterRef center, __CFNameEntry *entry) {
+  __CFNameEntry **link = &center->index[__CFIndexBucket(entry->hash, entry->object, center->buckets)];
+
+  while (*link != entry) {
+    link = &(*link)->next;
+  }
+  *link = entry->next;
+  center->names--;
+
+  free(entry->list.obs);
+  free(entry);
+}
+
+/*
+ *	Remove the observer from its name list and release it. The caller takes it out of
+ *	the center's table. Callbacks being invoked may still hold the record, so while
+ *	dispatching it is only marked as removed (NULL callback) and freed later.
+ */
+void __CFUnlinkObserver(CFNotificationCenterRef center, __CFObserver *obs) {
+  if (obs->hash == 0) {
+    __CFListRemove(&center->wildcard, obs);
+  }
+  else {
+    __CFNameEntry *entry = __CFIndexFind(center, obs->hash, obs->object);
+    if (entry != NULL) {
+      __CFListRemove(&entry->list, obs);
+      if (entry->list.count == 0) {
+        __CFIndexRemove(center, entry);
+      }
+    }
+  }
+
+  obs->callback = NULL;
+  if (center->dispatching == 0) {
+    free(obs);
+  }
+  else {
+    // if this fails the record is leaked rather than freed while in use
+    __CFListAppend(&center->removed, obs);
+  }
+  center->observers--;
+}
+
 /*
  *	Add the observer info into the table of observers for the notification center, growing the
  *	table if need be. Duplicate observers with identical signatures are allowed.
@@ -674,21 +854,20 @@ void __CFAddObserver(CFNotificationCenterRef center, const void *observer, CFNot
 	
   if (center->observers == center->capacity) {
     //fprintf(stderr, "increasing size of observer records for center type %d\n", center->type);
-    center->capacity += CF_OBS_SIZE;
-    center->obs = (__CFObserver*)realloc(center->obs, (center->capacity * sizeof(__CFObserver)));
-    if (center->obs == NULL) {
+    __CFObserver **table = (__CFObserver**)realloc(center->obs, ((center->capacity + CF_OBS_SIZE) * sizeof(__CFObserver*)));
+    if (table == NULL) {
       fprintf(stderr, "Couldn't realloc observer records for notification center type %ld\n", center->type);
       __CFUnlock(&center->lock);
       return; 
     }
-    obs = center->obs + center->observers;
-    // because I'm unsure if realloc zeroes the new memory...
-    for( int i = 0; i < CF_OBS_SIZE; i++ ) (obs++)->callback = NULL;
-    obs = center->obs + center->observers;
+    center->obs = table;
+    center->capacity += CF_OBS_SIZE;
   }
-  else {
-    obs = center->obs;
-    while (obs->callback != NULL) obs++;
+
+  obs = (__CFObserver*)malloc(sizeof(__CFObserver));
+  if (obs == NULL) {
+    __CFUnlock(&center->lock);
+    return;
   }
 	
   // hash and store the name
@@ -700,8 +879,21 @@ void __CFAddObserver(CFNotificationCenterRef center, const void *observer, CFNot
   obs->observer = observer;
   obs->callback = callBack;
   obs->sb = suspensionBehavior;
+  obs->order = center->order++;
+
+  __CFNameEntry *entry = (hash == 0) ? NULL : __CFIndexAdd(center, hash, object);
+  if (((hash != 0) && (entry == NULL))
+      || !__CFListAppend((hash == 0) ? &center->wildcard : &entry->list, obs)) {
+    fprintf(stderr, "Couldn't index observer for notification center type %ld\n", center->type);
+    if ((entry != NULL) && (entry->list.count == 0)) {
+      __CFIndexRemove(center, entry);
+    }
+    free(obs);
+    __CFUnlock(&center->lock);
+    return;
+  }
 	
-  center->observers++;
+  center->obs[center->observers++] = obs;
 	
   if( cb != NULL ) cb(name, hash, (CFHashCode)object);
 	
@@ -716,28 +908,23 @@ void __CFRemoveObserver(CFNotificationCenterRef center, const void *observer, CF
 	
   //CFHashCode hash = (name == NULL) ? 0 : CFHash(name);
   CFIndex count = center->observers;
-  __CFObserver *obs = center->obs;
+  CFIndex kept = 0;
 	
-  while (count--) {
-    while (obs->callback == NULL) {
-      obs++;
-    }
+  for (CFIndex i = 0; i < count; i++) {
+    __CFObserver *obs = center->obs[i];
     if ((obs->observer == observer)
         && /* match name hash */ ((name == 0) || (name == obs->hash))
         && /* match object */((object == NULL) || (object == obs->object))) {
-      //obs->name = NULL;
-      obs->hash = 0;
-      obs->object = NULL;
-      obs->observer = NULL;
-      obs->callback = NULL;
-      obs->sb = 0;
-      center->observers--;
+      __CFUnlinkObserver(center, obs);
 			
       if( cb != NULL ) {
         cb(name, (CFHashCode)object);
       }
     }
-    obs++;
+    else {
+      // compact the table, keeping the order
+      center->obs[kept++] = obs;
+    }
   }
 
   __CFUnlock(&center->lock);
@@ -750,27 +937,19 @@ void __CFRemoveEveryObserver(CFNotificationCenterRef center, const void *observe
   __CFLock(&center->lock);
 	
   CFIndex count = center->observers;	
-  __CFObserver *obs = center->obs;
+  CFIndex kept = 0;
 	
-  while (count--) {
-    while( obs->callback == NULL ) {
-      obs++;
-    }
-		
+  for (CFIndex i = 0; i < count; i++) {
+    __CFObserver *obs = center->obs[i];
     if (obs->observer == observer) {
       if (cb != NULL) {
         cb(obs->hash, (CFHashCode)obs->object);
       }
-      //obs->name = NULL;
-      obs->hash = 0;
-      obs->object = NULL;
-      obs->observer = NULL;
-      obs->callback = NULL;
-      obs->sb = 0;
-      center->observers--;
+      __CFUnlinkObserver(center, obs);
+    }
+    else {
+      center->obs[kept++] = obs;
     }
-		
-    obs++;
   }
 
   __CFUnlock(&center->lock);	
@@ -793,63 +972,110 @@ void __CFRemoveEveryObserver(CFNotificationCenterRef center, const void *observe
  *		Local:		object == objectReturn
  *		Distributed:	object == hash, objectReturn == CFStringRef
  *		Darwin:		object == objectReturn == NULL
+ *
+ *	Matching observers are collected first: callbacks may add or remove observers, which
+ *	changes the lists. Observers removed meanwhile are skipped, added ones will get the
+ *	next notification.
  */
 void __CFInvokeCallBacks(CFNotificationCenterRef center, CFHashCode name, CFStringRef nameReturn, const void *object, const void *objectReturn, CFDictionaryRef userInfo, Boolean deliverNow) {
+  __CFObserver *buffer[CF_OBS_SIZE];
+  __CFObserver **matches = buffer;
+  __CFObserver *obs;
+  CFIndex count = 0;
+  __CFObserverList *lists[3];
+  CFIndex next[3] = { 0, 0, 0 };
+  CFIndex listCount = 0, total = 0;
+  __CFNameEntry *entry;
+
   __CFLock(&center->lock);
-		
-  CFIndex count = center->observers;
-  __CFObserver *obs = center->obs;
-	
-  //printf("A\n");
-  //__CFCenterDiag(center);
-	
-  // process each observer in the table
-  while (count--) {
-    //printf("B\n");
-		
-    // find a record with a non-NULL callback field
-    while (obs->callback == NULL) {
-      obs++;
+
+  // observers of the name with this object, of the name with any object, of any name
+  if (name != 0) {
+    if ((object != NULL) && ((entry = __CFIndexFind(center, name, object)) != NULL)) {
+      lists[listCount++] = &entry->list;
     }
-		
-    //printf("C\n");
-    //__CFObserverDiag (*obs);
-		
-    //printf("observer: 0x%X\n");
-		
-    // for an observer to qualify to recieve a notification, it need to match
-    // both name and object, taking into account the NULL-case "match any name
-    // or object"
-    if (((obs->hash == 0) || (obs->hash == name)) /* match name hash */
-        && ((obs->object == NULL) || (obs->object == object)) /* match object */) {
-      // found a match, now do we deliver the notification?
-      if (deliverNow /* non-dist short-circuit */ || !center->suspended) {
-        // CFMachPort source suggested unlocking before invoking callbacks
-        __CFUnlock(&center->lock);
-        obs->callback((CFNotificationCenterRef)center, (void*)obs->observer, nameReturn, objectReturn, userInfo);
-        __CFLock(&center->lock);
+    if ((entry = __CFIndexFind(center, name, NULL)) != NULL) {
+      lists[listCount++] = &entry->list;
+    }
+  }
+  lists[listCount++] = &center->wildcard;
+  for (CFIndex l = 0; l < listCount; l++) {
+    total += lists[l]->count;
+  }
+
+  if (total > CF_OBS_SIZE) {
+    matches = (__CFObserver**)malloc(total * sizeof(__CFObserver*));
+    if (matches == NULL) {
+      __CFUnlock(&center->lock);
+      return;
+    }
+  }
+
+  // merge the lists in registration order. for an observer to qualify to recieve
+  // a notification, it need to match both name and object, taking into account the
+  // NULL-case "match any name or object". observers in the index lists match already.
+  while (TRUE) {
+    CFIndex best = -1;
+    for (CFIndex l = 0; l < listCount; l++) {
+      if ((next[l] < lists[l]->count)
+          && ((best < 0) || (lists[l]->obs[next[l]]->order < lists[best]->obs[next[best]]->order))) {
+        best = l;
       }
-      else switch (obs->sb) {
-        case CFNotificationSuspensionBehaviorDrop: break;
-        case CFNotificationSuspensionBehaviorCoalesce:
-          __CFAddQueue(nameReturn, objectReturn, obs->observer, userInfo, obs->callback, TRUE);
-          break;
-        case CFNotificationSuspensionBehaviorHold:
-          __CFAddQueue(nameReturn, objectReturn, obs->observer, userInfo, obs->callback, FALSE);
-          break;
-        case CFNotificationSuspensionBehaviorDeliverImmediately:
-          if (__CFDistInfo.queueCount != 0) {
-            __CFDeliverQueue();
-          }
-          obs->callback((CFNotificationCenterRef)center, (void*)obs->observer, nameReturn, objectReturn, userInfo);
-          break;
+    }
+    if (best < 0) {
+      break;
+    }
+    obs = lists[best]->obs[next[best]++];
+    if ((obs->object == NULL) || (obs->object == object)) /* match object */ {
+      matches[count++] = obs;
+    }
+  }
+
+  center->dispatching++;
+	
+  for (CFIndex i = 0; i < count; i++) {
+    obs = matches[i];
+    CFNotificationCallback callback = obs->callback;
+    if (callback == NULL) { // removed by one of the callbacks
+      continue;
+    }
+			
+    // found a match, now do we deliver the notification?
+    if (deliverNow /* non-dist short-circuit */ || !center->suspended) {
+      // CFMachPort source suggested unlocking before invoking callbacks
+      __CFUnlock(&center->lock);
+      callback((CFNotificationCenterRef)center, (void*)obs->observer, nameReturn, objectReturn, userInfo);
+      __CFLock(&center->lock);
+    }
+    else switch (obs->sb) {
+      case CFNotificationSuspensionBehaviorDrop: break;
+      case CFNotificationSuspensionBehaviorCoalesce:
+        __CFAddQueue(nameReturn, objectReturn, obs->observer, userInfo, callback, TRUE);
+        break;
+      case CFNotificationSuspensionBehaviorHold:
+        __CFAddQueue(nameReturn, objectReturn, obs->observer, userInfo, callback, FALSE);
+        break;
+      case CFNotificationSuspensionBehaviorDeliverImmediately:
+        if (__CFDistInfo.queueCount != 0) {
+          __CFDeliverQueue();
         }
+        callback((CFNotificationCenterRef)center, (void*)obs->observer, nameReturn, objectReturn, userInfo);
+        break;
+      }
+  }
+
+  if (--center->dispatching == 0) {
+    for (CFIndex i = 0; i < center->removed.count; i++) {
+      free(center->removed.obs[i]);
     }
-		
-    obs++;
+    center->removed.count = 0;
   }
 	
   __CFUnlock(&center->lock);
+
+  if (matches != buffer) {
+    free(matches);
+  }
 }
 
 
@@ -909,10 +1135,23 @@ CFNotificationCenterRef __CFCreateCenter(CFIndex type) {
   // allocate storage and set counters
   memory->observers = 0;
   memory->capacity = CF_OBS_SIZE;
-  // IMPORTANT: after calloc, we assume memory is zeroed
-  memory->obs = (__CFObserver*)calloc(CF_OBS_SIZE, sizeof(__CFObserver));
+  memory->obs = (__CFObserver**)calloc(CF_OBS_SIZE, sizeof(__CFObserver*));
+  memory->order = 0;
+  memory->names = 0;
+  memory->buckets = CF_NAME_SIZE;
+  memory->index = (__CFNameEntry**)calloc(CF_NAME_SIZE, sizeof(__CFNameEntry*));
+  memory->wildcard = (__CFObserverList){ 0, 0, NULL };
+  memory->dispatching = 0;
+  memory->removed = (__CFObserverList){ 0, 0, NULL };
+  memory->pendingCount = 0;
+  memory->pendingCapacity = 0;
+  memory->pending = NULL;
+  memory->pendingRunLoop = NULL;
+  memory->pendingObserver = NULL;
 	
-  if (memory->obs == NULL) {
+  if ((memory->obs == NULL) || (memory->index == NULL)) {
+    free(memory->obs);
+    free(memory->index);
     CFAllocatorDeallocate(kCFAllocatorDefault, memory);
     memory = NULL;
   }
@@ -1310,3 +1549,159 @@ void CFNotificationCenterPostNotificationWithOptions(CFNotificationCenterRef cen
   }
 }
 
+
+/*
+ *	Deferred posting. Notifications are queued in the center and posted by a run loop
+ *	observer before the run loop waits for events, so a burst of identical notifications
+ *	posted while handling events (e.g. restacking many windows) reaches the observers once.
+ *
+ *	Entries are delivered in place: notifications queued by the observers meanwhile are
+ *	appended and delivered on the next pass, dequeued ones are marked with NULL name.
+ */
+void __CFDeliverPending(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info);
+
+void __CFDeliverPending(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info) {
+  CFNotificationCenterRef center = (CFNotificationCenterRef)info;
+  __CFPendingNotification notification;
+	
+  __CFLock(&center->lock);
+  CFIndex count = center->pendingCount;
+	
+  for (CFIndex i = 0; i < count; i++) {
+    notification = center->pending[i];
+    if (notification.name == NULL) {
+      continue;
+    }
+    center->pending[i].name = NULL;
+    center->pending[i].hash = 0;
+    center->pending[i].userInfo = NULL;
+    __CFUnlock(&center->lock);
+		
+    if (center->observers != 0) {
+      __CFInvokeCallBacks(center, notification.hash, notification.name, notification.object, notification.object, notification.userInfo, TRUE);
+    }
+    CFRelease(notification.name);
+    if (notification.userInfo != NULL) {
+      CFRelease(notification.userInfo);
+    }
+		
+    __CFLock(&center->lock);
+  }
+	
+  // keep what was queued during delivery
+  CFIndex kept = 0;
+  for (CFIndex i = 0; i < center->pendingCount; i++) {
+    if (center->pending[i].name != NULL) {
+      center->pending[kept++] = center->pending[i];
+    }
+  }
+  center->pendingCount = kept;
+  __CFUnlock(&center->lock);
+	
+  // the run loop would sleep with these still queued
+  if (kept != 0) {
+    CFRunLoopWakeUp(center->pendingRunLoop);
+  }
+}
+
+void CFNotificationCenterEnqueueNotification(CFNotificationCenterRef center, CFStringRef name, const void *object, CFDictionaryRef userInfo) {
+  if ((center == NULL) || (CFGetTypeID(center) != __kCFNotificationCenterTypeID) || (name == NULL)) {
+    return;
+  }
+	
+  // only local notifications are delivered by this task
+  if (center->type != CF_LOCAL_CENTER) {
+    CFNotificationCenterPostNotification(center, name, object, userInfo, TRUE);
+    return;
+  }
+	
+  CFHashCode hash = CFHash(name);
+	
+  __CFLock(&center->lock);
+	
+  if (center->pendingObserver == NULL) {
+    CFRunLoopObserverContext context = { 0, (void *)center, NULL, NULL, NULL };
+    center->pendingObserver = CFRunLoopObserverCreate(kCFAllocatorDefault, kCFRunLoopBeforeWaiting | kCFRunLoopExit,
+                                                      TRUE, 0, __CFDeliverPending, &context);
+    if (center->pendingObserver == NULL) {
+      __CFUnlock(&center->lock);
+      CFNotificationCenterPostNotification(center, name, object, userInfo, TRUE);
+      return;
+    }
+    center->pendingRunLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+    CFRunLoopAddObserver(center->pendingRunLoop, center->pendingObserver, kCFRunLoopCommonModes);
+  }
+	
+  if (userInfo != NULL) {
+    CFRetain(userInfo);
+  }
+	
+  // coalesce with the queued notification of the same name and object
+  __CFPendingNotification *pending = center->pending;
+  for (CFIndex i = 0; i < center->pendingCount; i++, pending++) {
+    if ((pending->name != NULL) && (pending->hash == hash) && (pending->object == object)) {
+      if (pending->userInfo != NULL) {
+        CFRelease(pending->userInfo);
+      }
+      pending->userInfo = userInfo;
+      __CFUnlock(&center->lock);
+      return;
+    }
+  }
+	
+  if (center->pendingCount == center->pendingCapacity) {
+    CFIndex capacity = center->pendingCapacity + CF_QUEUE_SIZE;
+    pending = (__CFPendingNotification*)realloc(center->pending, capacity * sizeof(__CFPendingNotification));
+    if (pending == NULL) {
+      __CFUnlock(&center->lock);
+      if (userInfo != NULL) {
+        CFRelease(userInfo);
+      }
+      CFNotificationCenterPostNotification(center, name, object, userInfo, TRUE);
+      return;
+    }
+    center->pending = pending;
+    center->pendingCapacity = capacity;
+  }
+	
+  pending = center->pending + center->pendingCount++;
+  pending->hash = hash;
+  pending->name = (CFStringRef)CFRetain(name);
+  pending->object = object;
+  pending->userInfo = userInfo;
+	
+  Boolean wakeUp = (center->pendingCount == 1) && (CFRunLoopGetCurrent() != center->pendingRunLoop);
+  __CFUnlock(&center->lock);
+	
+  // queued from another thread: the run loop may be waiting
+  if (wakeUp) {
+    CFRunLoopWakeUp(center->pendingRunLoop);
+  }
+}
+
+void CFNotificationCenterDequeueNotifications(CFNotificationCenterRef center, CFStringRef name, const void *object) {
+  if ((center == NULL) || (CFGetTypeID(center) != __kCFNotificationCenterTypeID)) {
+    return;
+  }
+	
+  CFHashCode hash = (name == NULL) ? 0 : CFHash(name);
+	
+  __CFLock(&center->lock);
+	
+  __CFPendingNotification *pending = center->pending;
+  for (CFIndex i = 0; i < center->pendingCount; i++, pending++) {
+    if ((pending->name != NULL)
+        && ((hash == 0) || (pending->hash == hash))
+        && ((object == NULL) || (pending->object == object))) {
+      CFRelease(pending->name);
+      if (pending->userInfo != NULL) {
+        CFRelease(pending->userInfo);
+      }
+      pending->name = NULL;
+      pending->hash = 0;
+      pending->userInfo = NULL;
+    }
+  }
+	
+  __CFUnlock(&center->lock);
+}
@@ -0,0 +1,26 @@
+/*      CFNotificationQueue.h
+        Deferred, coalescing delivery of local notifications.
+*/
+
+#if !defined(__COREFOUNDATION_CFNOTIFICATIONQUEUE__)
+#define __COREFOUNDATION_CFNOTIFICATIONQUEUE__ 1
+
+#include <CoreFoundation/CFNotificationCenter.h>
+
+CF_EXTERN_C_BEGIN
+
+/* Queues the notification instead of posting it. Queued notifications are
+   posted once the run loop of the first enqueueing thread finishes its
+   current pass (before it waits for events). A notification with the same
+   name and object as a queued one is coalesced with it: it is delivered
+   once, with the latest userInfo. Non-local centers post immediately. */
+CF_EXPORT void CFNotificationCenterEnqueueNotification(CFNotificationCenterRef center, CFNotificationName name, const void *object, CFDictionaryRef userInfo);
+
+/* Drops queued notifications matching name and object. NULL matches any
+   name or object. Use it before the object of queued notifications is
+   destroyed. */
+CF_EXPORT void CFNotificationCenterDequeueNotifications(CFNotificationCenterRef center, CFNotificationName name, const void *object);
+
+CF_EXTERN_C_END
+
+#endif /* ! __COREFOUNDATION_CFNOTIFICATIONQUEUE__ */
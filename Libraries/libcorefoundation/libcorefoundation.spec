@@ -13,6 +13,7 @@ Source0:	libcorefoundation-%{version}.tar.gz
 Source1:	CFFileDescriptor.h
 Source2:	CFFileDescriptor.c
 Source3:	CFNotificationCenter.c
+Source4:	CFNotificationQueue.h
 Patch0:		CF_shared_on_linux.patch
 %if 0%{?el7}
 Patch1:		CF_centos7.patch
@@ -68,6 +69,7 @@ Development header files for CoreFoundation framework.
 %patch4 -p1
 %endif
 cp %{_sourcedir}/CFNotificationCenter.c CoreFoundation/AppServices.subproj/
+cp %{_sourcedir}/CFNotificationQueue.h CoreFoundation/AppServices.subproj/
 cp %{_sourcedir}/CFFileDescriptor.h CoreFoundation/RunLoop.subproj/
 cp %{_sourcedir}/CFFileDescriptor.c CoreFoundation/RunLoop.subproj/
 cp CoreFoundation/Base.subproj/SwiftRuntime/TargetConditionals.h CoreFoundation/Base.subproj/
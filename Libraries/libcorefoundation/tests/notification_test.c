@@ -1,6 +1,9 @@
 #include <CoreFoundation/CoreFoundation.h>
 #include <CoreFoundation/CFLogUtilities.h>
 #include <CoreFoundation/CFNotificationCenter.h>
+#include <CoreFoundation/CFNotificationQueue.h>
+
+#include <stdio.h>
 
 void notificationCallback(CFNotificationCenterRef center,
                           void *observer,
@@ -22,8 +25,151 @@ void notificationCallback(CFNotificationCenterRef center,
   }
 }
 
+// Queued notifications received by queueCallback()
+#define MAX_RECEIVED 16
+static struct {
+  CFStringRef name;
+  const void *object;
+  CFDictionaryRef userInfo;
+} received[MAX_RECEIVED];
+static int receivedCount;
+
+static void queueCallback(CFNotificationCenterRef center,
+                          void *observer,
+                          CFStringRef name,
+                          const void *object,
+                          CFDictionaryRef userInfo)
+{
+  if (receivedCount < MAX_RECEIVED) {
+    received[receivedCount].name = name;
+    received[receivedCount].object = object;
+    received[receivedCount].userInfo = userInfo;
+  }
+  receivedCount++;
+}
+
+static void timerCallback(CFRunLoopTimerRef timer, void *info)
+{
+}
+
+// One pass of the run loop. The timer keeps the mode from being empty,
+// otherwise the run loop returns without calling its observers.
+static void runLoopPass(void)
+{
+  CFRunLoopTimerRef timer;
+
+  timer = CFRunLoopTimerCreate(kCFAllocatorDefault,
+                               CFAbsoluteTimeGetCurrent() + 60, 0, 0, 0,
+                               timerCallback, NULL);
+  CFRunLoopAddTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopDefaultMode);
+  CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0, true);
+  CFRunLoopRemoveTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopDefaultMode);
+  CFRelease(timer);
+}
+
+static int checkReceived(int index, CFStringRef name, const void *object,
+                         CFDictionaryRef userInfo)
+{
+  if (index >= receivedCount || index >= MAX_RECEIVED
+      || CFStringCompare(received[index].name, name, 0) != kCFCompareEqualTo
+      || received[index].object != object
+      || received[index].userInfo != userInfo) {
+    fprintf(stderr, "FAIL: queued notification %i is wrong or missing\n", index);
+    return 1;
+  }
+  return 0;
+}
+
+// Duplicate (name, object) pairs are delivered once, in the order of the
+// first enqueue, with the latest userInfo. Dequeued entries are dropped.
+static int testQueue(CFNotificationCenterRef nc)
+{
+  CFStringRef first = CFSTR("QueueTestFirst");
+  CFStringRef second = CFSTR("QueueTestSecond");
+  int objA, objB;
+  CFDictionaryRef info1, info2;
+  int failures = 0;
+
+  info1 = CFDictionaryCreate(kCFAllocatorDefault, NULL, NULL, 0,
+                             &kCFTypeDictionaryKeyCallBacks,
+                             &kCFTypeDictionaryValueCallBacks);
+  info2 = CFDictionaryCreate(kCFAllocatorDefault, NULL, NULL, 0,
+                             &kCFTypeDictionaryKeyCallBacks,
+                             &kCFTypeDictionaryValueCallBacks);
+
+  CFNotificationCenterAddObserver(nc, &receivedCount, queueCallback, first, NULL,
+                                  CFNotificationSuspensionBehaviorDeliverImmediately);
+  CFNotificationCenterAddObserver(nc, &receivedCount, queueCallback, second, NULL,
+                                  CFNotificationSuspensionBehaviorDeliverImmediately);
+
+  // coalescing and order
+  receivedCount = 0;
+  CFNotificationCenterEnqueueNotification(nc, first, &objA, NULL);
+  CFNotificationCenterEnqueueNotification(nc, second, &objA, NULL);
+  CFNotificationCenterEnqueueNotification(nc, first, &objB, NULL);
+  CFNotificationCenterEnqueueNotification(nc, first, &objA, info1);
+  CFNotificationCenterEnqueueNotification(nc, second, &objA, info2);
+  CFNotificationCenterEnqueueNotification(nc, first, &objB, NULL);
+  if (receivedCount != 0) {
+    fprintf(stderr, "FAIL: queued notification delivered before run loop pass\n");
+    failures++;
+  }
+  runLoopPass();
+  if (receivedCount != 3) {
+    fprintf(stderr, "FAIL: %i queued notifications delivered, expected 3\n",
+            receivedCount);
+    failures++;
+  }
+  failures += checkReceived(0, first, &objA, info1);
+  failures += checkReceived(1, second, &objA, info2);
+  failures += checkReceived(2, first, &objB, NULL);
+
+  // nothing is left for the next pass
+  receivedCount = 0;
+  runLoopPass();
+  if (receivedCount != 0) {
+    fprintf(stderr, "FAIL: notifications delivered twice\n");
+    failures++;
+  }
+
+  // dequeue by name and object, by object only
+  receivedCount = 0;
+  CFNotificationCenterEnqueueNotification(nc, first, &objA, NULL);
+  CFNotificationCenterEnqueueNotification(nc, first, &objB, NULL);
+  CFNotificationCenterEnqueueNotification(nc, second, &objA, NULL);
+  CFNotificationCenterEnqueueNotification(nc, second, &objB, NULL);
+  CFNotificationCenterDequeueNotifications(nc, first, &objA);
+  CFNotificationCenterDequeueNotifications(nc, NULL, &objB);
+  runLoopPass();
+  if (receivedCount != 1) {
+    fprintf(stderr, "FAIL: %i notifications delivered after dequeue, expected 1\n",
+            receivedCount);
+    failures++;
+  }
+  failures += checkReceived(0, second, &objA, NULL);
+
+  // dequeue everything
+  receivedCount = 0;
+  CFNotificationCenterEnqueueNotification(nc, first, &objA, info1);
+  CFNotificationCenterEnqueueNotification(nc, second, &objB, NULL);
+  CFNotificationCenterDequeueNotifications(nc, NULL, NULL);
+  runLoopPass();
+  if (receivedCount != 0) {
+    fprintf(stderr, "FAIL: dequeued notifications were delivered\n");
+    failures++;
+  }
+
+  CFNotificationCenterRemoveEveryObserver(nc, &receivedCount);
+  CFRelease(info1);
+  CFRelease(info2);
+
+  return failures;
+}
+
 int main(int argc, char *argv[])
 {
+  int failures = 0;
+
   CFNotificationCenterRef nc = CFNotificationCenterGetLocalCenter();
 
   if (nc != NULL) {
@@ -56,7 +202,11 @@ int main(int argc, char *argv[])
     
     // remove oberver
     CFNotificationCenterRemoveObserver(nc, NULL, CFSTR("TestValue"), NULL);
+
+    failures += testQueue(nc);
+    if (failures == 0)
+      printf("Notification queue: OK\n");
   }
   
-  return (0);
+  return (failures != 0);
 }
@@ -32,6 +32,15 @@
 #include <string.h>
 #include <assert.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_X86_SIMD
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
 #include "config.h"
 #include "wraster.h"
 #include "convert.h"
@@ -292,6 +301,199 @@ convertTrueColor_generic(RXImage * ximg, RImage * image,
 	}
 }
 
+/*
+ * Fast paths for TrueColor visuals with 8 bits per channel stored in 32 bit
+ * pixels (RGB888 in any byte order: XRGB, BGRX, ...). With 8 bit channels
+ * dithering has no error to spread, so both render modes end here.
+ *
+ * Rows are written straight into the XImage data, every output byte being
+ * one of the source channels or 0: a byte shuffle, done with SSSE3/AVX2
+ * pshufb or NEON when the CPU has them. The implementation is chosen at
+ * the first conversion, WRASTER_CONVERT can force a slower one.
+ */
+
+typedef struct {
+	/* for each byte of the output pixel: source channel, 3 = zero */
+	unsigned char map[4];
+	/* pshufb masks for 4 pixels, for RGB and RGBA sources */
+	unsigned char shuffle[2][16];
+} RFastLayout;
+
+typedef void (*RConvertRowFunc)(unsigned char *dst, const unsigned char *src,
+				int width, int channels, const RFastLayout *layout);
+
+static void convert_row_scalar(unsigned char *dst, const unsigned char *src,
+			       int width, int channels, const RFastLayout *layout)
+{
+	unsigned char px[4];
+	int x;
+
+	px[3] = 0;
+	for (x = 0; x < width; x++, src += channels, dst += 4) {
+		px[0] = src[0];
+		px[1] = src[1];
+		px[2] = src[2];
+		dst[0] = px[layout->map[0]];
+		dst[1] = px[layout->map[1]];
+		dst[2] = px[layout->map[2]];
+		dst[3] = px[layout->map[3]];
+	}
+}
+
+#ifdef CONVERT_X86_SIMD
+/* RImage data has 4 spare bytes at the end, so reading 16 bytes for 4 RGB
+ * pixels (12 bytes) doesn't go past the buffer. */
+
+__attribute__((target("ssse3")))
+static void convert_row_ssse3(unsigned char *dst, const unsigned char *src,
+			      int width, int channels, const RFastLayout *layout)
+{
+	const __m128i mask = _mm_loadu_si128((const __m128i *)layout->shuffle[channels - 3]);
+	int x;
+
+	for (x = 0; x + 4 <= width; x += 4, src += 4 * channels, dst += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+		_mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(v, mask));
+	}
+	convert_row_scalar(dst, src, width - x, channels, layout);
+}
+
+__attribute__((target("avx2")))
+static void convert_row_avx2(unsigned char *dst, const unsigned char *src,
+			     int width, int channels, const RFastLayout *layout)
+{
+	const __m128i mask128 = _mm_loadu_si128((const __m128i *)layout->shuffle[channels - 3]);
+	const __m256i mask = _mm256_broadcastsi128_si256(mask128);
+	int x;
+
+	/* pshufb works within 128 bit lanes: 4 pixels per lane */
+	for (x = 0; x + 8 <= width; x += 8, src += 8 * channels, dst += 32) {
+		__m256i v;
+
+		v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)src));
+		v = _mm256_inserti128_si256(v, _mm_loadu_si128((const __m128i *)(src + 4 * channels)), 1);
+		_mm256_storeu_si256((__m256i *)dst, _mm256_shuffle_epi8(v, mask));
+	}
+	convert_row_ssse3(dst, src, width - x, channels, layout);
+}
+#endif				/* CONVERT_X86_SIMD */
+
+#ifdef CONVERT_NEON
+static void convert_row_neon(unsigned char *dst, const unsigned char *src,
+			     int width, int channels, const RFastLayout *layout)
+{
+	uint8x16_t ch[4];
+	uint8x16x4_t out;
+	int x;
+
+	ch[3] = vdupq_n_u8(0);
+	for (x = 0; x + 16 <= width; x += 16, src += 16 * channels, dst += 64) {
+		if (channels == 4) {
+			uint8x16x4_t v = vld4q_u8(src);
+
+			ch[0] = v.val[0];
+			ch[1] = v.val[1];
+			ch[2] = v.val[2];
+		} else {
+			uint8x16x3_t v = vld3q_u8(src);
+
+			ch[0] = v.val[0];
+			ch[1] = v.val[1];
+			ch[2] = v.val[2];
+		}
+		out.val[0] = ch[layout->map[0]];
+		out.val[1] = ch[layout->map[1]];
+		out.val[2] = ch[layout->map[2]];
+		out.val[3] = ch[layout->map[3]];
+		vst4q_u8(dst, out);
+	}
+	convert_row_scalar(dst, src, width - x, channels, layout);
+}
+#endif				/* CONVERT_NEON */
+
+static RConvertRowFunc convertRow;
+static Bool convertRowChosen = False;
+
+static RConvertRowFunc choose_row_converter(void)
+{
+	const char *force = getenv("WRASTER_CONVERT");
+	RConvertRowFunc func;
+
+	if (force && strcmp(force, "generic") == 0)
+		return NULL;
+
+	func = convert_row_scalar;
+	if (force && strcmp(force, "scalar") == 0)
+		return func;
+
+#ifdef CONVERT_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		func = convert_row_ssse3;
+	if (force && strcmp(force, "ssse3") == 0)
+		return func;
+	if (__builtin_cpu_supports("avx2"))
+		func = convert_row_avx2;
+#endif
+#ifdef CONVERT_NEON
+	func = convert_row_neon;
+#endif
+
+	return func;
+}
+
+static Bool convertTrueColor_fast(RContext * ctx, RXImage * ximg, RImage * image)
+{
+	XImage *xi = ximg->image;
+	int offs[3] = { ctx->red_offset, ctx->green_offset, ctx->blue_offset };
+	int channels = (HAS_ALPHA(image) ? 4 : 3);
+	RFastLayout layout;
+	int i, k, p, y, bit;
+
+	if (!convertRowChosen) {
+		convertRow = choose_row_converter();
+		convertRowChosen = True;
+	}
+	if (!convertRow)
+		return False;
+
+	if (xi->format != ZPixmap || xi->bits_per_pixel != 32
+	    || ctx->visual->red_mask >> offs[0] != 0xff
+	    || ctx->visual->green_mask >> offs[1] != 0xff
+	    || ctx->visual->blue_mask >> offs[2] != 0xff)
+		return False;
+
+	for (k = 0; k < 4; k++) {
+		bit = (xi->byte_order == LSBFirst) ? k * 8 : (3 - k) * 8;
+		layout.map[k] = 3;
+		for (i = 0; i < 3; i++) {
+			if (offs[i] == bit)
+				layout.map[k] = i;
+		}
+	}
+	for (i = 0; i < 3; i++) {
+		if (offs[i] % 8 != 0 || offs[i] > 24)
+			return False;
+	}
+
+	for (i = 0; i < 2; i++) {
+		for (p = 0; p < 4; p++) {
+			for (k = 0; k < 4; k++) {
+				layout.shuffle[i][p * 4 + k] = (layout.map[k] == 3) ? 0x80 : p * (3 + i) + layout.map[k];
+			}
+		}
+	}
+
+	for (y = 0; y < image->height; y++) {
+		convertRow((unsigned char *)xi->data + y * xi->bytes_per_line,
+			   image->data + y * image->width * channels,
+			   image->width, channels, &layout);
+	}
+
+	return True;
+}
+
 static RXImage *image2TrueColor(RContext * ctx, RImage * image)
 {
 	RXImage *ximg;
@@ -323,6 +525,9 @@ static RXImage *image2TrueColor(RContext * ctx, RImage * image)
 		return NULL;
 	}
 
+	if (convertTrueColor_fast(ctx, ximg, image))
+		return ximg;
+
 	if (ctx->attribs->render_mode == RBestMatchRendering) {
 		int ofs;
 		unsigned long r, g, b;
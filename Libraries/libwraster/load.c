@@ -31,6 +31,7 @@
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "wraster.h"
@@ -38,31 +39,62 @@
 #include "wr_i18n.h"
 
 
+/*
+ * Loaded images are kept in a cache, hashed by file name and image index.
+ * An entry is valid while the file keeps its device, inode and
+ * modification time. Cached images are shared with the callers of
+ * RLoadImage (reference counted), so a hit doesn't copy pixels.
+ * The least recently used images are dropped when the pixels of all
+ * cached images take more than the cache budget.
+ * The cache is used by several threads: it's guarded by cache_lock.
+ * Images are decoded without holding the lock.
+ */
 typedef struct RCachedImage {
+	struct RCachedImage *hash_next;
+	struct RCachedImage *lru_prev;	/* more recently used */
+	struct RCachedImage *lru_next;	/* less recently used */
+	unsigned hash;
+	int index;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	size_t bytes;
 	RImage *image;
-	char *file;
-	time_t last_modif;	/* last time file was modified */
-	time_t last_use;	/* last time image was used */
+	char file[];
 } RCachedImage;
 
 /*
- * Number of image to keep in the cache
+ * Cache budget in bytes, -1 until initialised, 0 = disabled
  */
-static int RImageCacheSize = -1;
+static long RImageCacheBudget = -1;
 
-#define IMAGE_CACHE_DEFAULT_NBENTRIES	  8
-#define IMAGE_CACHE_MAXIMUM_NBENTRIES	256
+#define IMAGE_CACHE_DEFAULT_BUDGET_KB	  8192
+#define IMAGE_CACHE_MAXIMUM_BUDGET_KB	262144
 
 /*
  * Max. size of image (in pixels) to store in the cache
  */
 static int RImageCacheMaxImage = -1;	/* 0 = any size */
 
-#define IMAGE_CACHE_DEFAULT_MAXPIXELS	(64 * 64)
-#define IMAGE_CACHE_MAXIMUM_MAXPIXELS	(256 * 256)
+#define IMAGE_CACHE_DEFAULT_MAXPIXELS	(128 * 128)
+#define IMAGE_CACHE_MAXIMUM_MAXPIXELS	(1024 * 1024)
+
+#define IMAGE_CACHE_MIN_BUCKETS		64
+
+static struct {
+	RCachedImage **buckets;
+	unsigned nbuckets;	/* power of 2 */
+	unsigned long count;
+	size_t bytes;
+	RCachedImage *lru_head;	/* most recently used */
+	RCachedImage *lru_tail;
 
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} RImageCache;
 
-static RCachedImage *RImageCache;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 static WRImgFormat identFile(const char *path);
@@ -106,14 +138,24 @@ char **RSupportedFileFormats(void)
 static void init_cache(void)
 {
 	char *tmp;
+	long budget;
+	int count;
 
+	/* RIMAGE_CACHE=0 disables the cache, any other number of images is ignored */
 	tmp = getenv("RIMAGE_CACHE");
-	if (!tmp || sscanf(tmp, "%i", &RImageCacheSize) != 1)
-		RImageCacheSize = IMAGE_CACHE_DEFAULT_NBENTRIES;
-	if (RImageCacheSize < 0)
-		RImageCacheSize = 0;
-	if (RImageCacheSize > IMAGE_CACHE_MAXIMUM_NBENTRIES)
-		RImageCacheSize = IMAGE_CACHE_MAXIMUM_NBENTRIES;
+	if (tmp && sscanf(tmp, "%i", &count) == 1 && count <= 0) {
+		RImageCacheBudget = 0;
+		return;
+	}
+
+	tmp = getenv("RIMAGE_CACHE_KB");
+	if (!tmp || sscanf(tmp, "%li", &budget) != 1)
+		budget = IMAGE_CACHE_DEFAULT_BUDGET_KB;
+	if (budget < 0)
+		budget = 0;
+	if (budget > IMAGE_CACHE_MAXIMUM_BUDGET_KB)
+		budget = IMAGE_CACHE_MAXIMUM_BUDGET_KB;
+	RImageCacheBudget = budget * 1024;
 
 	tmp = getenv("RIMAGE_CACHE_SIZE");
 	if (!tmp || sscanf(tmp, "%i", &RImageCacheMaxImage) != 1)
@@ -122,63 +164,201 @@ static void init_cache(void)
 		RImageCacheMaxImage = 0;
 	if (RImageCacheMaxImage > IMAGE_CACHE_MAXIMUM_MAXPIXELS)
 		RImageCacheMaxImage = IMAGE_CACHE_MAXIMUM_MAXPIXELS;
+}
 
-	if (RImageCacheSize > 0) {
-		RImageCache = malloc(sizeof(RCachedImage) * RImageCacheSize);
-		if (RImageCache == NULL) {
-			fprintf(stderr, _("wrlib: out of memory for image cache\n"));
-			return;
-		}
-		memset(RImageCache, 0, sizeof(RCachedImage) * RImageCacheSize);
+static unsigned hash_file(const char *file, int index)
+{
+	unsigned h = 2166136261u;	/* FNV-1a */
+
+	while (*file) {
+		h ^= (unsigned char)*file++;
+		h *= 16777619u;
 	}
+	h ^= (unsigned)index;
+	h *= 16777619u;
+
+	return h;
 }
 
-void RReleaseCache(void)
+static void cache_lru_unlink(RCachedImage *entry)
 {
-	int i;
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		RImageCache.lru_head = entry->lru_next;
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		RImageCache.lru_tail = entry->lru_prev;
+}
 
-	if (RImageCacheSize > 0) {
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (RImageCache[i].file) {
-				RReleaseImage(RImageCache[i].image);
-				free(RImageCache[i].file);
-			}
+static void cache_lru_push(RCachedImage *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = RImageCache.lru_head;
+	if (RImageCache.lru_head)
+		RImageCache.lru_head->lru_prev = entry;
+	else
+		RImageCache.lru_tail = entry;
+	RImageCache.lru_head = entry;
+}
+
+static void cache_remove(RCachedImage *entry)
+{
+	RCachedImage **ptr;
+
+	ptr = &RImageCache.buckets[entry->hash & (RImageCache.nbuckets - 1)];
+	while (*ptr != entry)
+		ptr = &(*ptr)->hash_next;
+	*ptr = entry->hash_next;
+
+	cache_lru_unlink(entry);
+	RImageCache.count--;
+	RImageCache.bytes -= entry->bytes;
+
+	RReleaseImage(entry->image);
+	free(entry);
+}
+
+static RCachedImage *cache_find(const char *file, int index, unsigned hash)
+{
+	RCachedImage *entry;
+
+	if (!RImageCache.buckets)
+		return NULL;
+
+	for (entry = RImageCache.buckets[hash & (RImageCache.nbuckets - 1)]; entry; entry = entry->hash_next) {
+		if (entry->hash == hash && entry->index == index && strcmp(entry->file, file) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void cache_grow(void)
+{
+	RCachedImage **buckets, *entry, *next;
+	unsigned nbuckets, i;
+
+	nbuckets = RImageCache.nbuckets ? RImageCache.nbuckets * 2 : IMAGE_CACHE_MIN_BUCKETS;
+	buckets = calloc(nbuckets, sizeof(RCachedImage *));
+	if (!buckets)
+		return;
+
+	for (i = 0; i < RImageCache.nbuckets; i++) {
+		for (entry = RImageCache.buckets[i]; entry; entry = next) {
+			next = entry->hash_next;
+			entry->hash_next = buckets[entry->hash & (nbuckets - 1)];
+			buckets[entry->hash & (nbuckets - 1)] = entry;
 		}
-		free(RImageCache);
-		RImageCache = NULL;
-		RImageCacheSize = -1;
+	}
+	free(RImageCache.buckets);
+	RImageCache.buckets = buckets;
+	RImageCache.nbuckets = nbuckets;
+}
+
+static void cache_store(const char *file, int index, unsigned hash, const struct stat *st, RImage *image)
+{
+	RCachedImage *entry;
+	size_t bytes;
+
+	bytes = (size_t)image->width * image->height * (image->format == RRGBAFormat ? 4 : 3);
+	if (bytes > RImageCacheBudget)
+		return;
+
+	if (RImageCache.count >= RImageCache.nbuckets)
+		cache_grow();
+	if (!RImageCache.buckets)
+		return;
+
+	entry = malloc(sizeof(RCachedImage) + strlen(file) + 1);
+	if (!entry)
+		return;
+	strcpy(entry->file, file);
+	entry->hash = hash;
+	entry->index = index;
+	entry->dev = st->st_dev;
+	entry->ino = st->st_ino;
+	entry->mtime = st->st_mtim;
+	entry->bytes = bytes;
+	entry->image = RRetainImage(image);
+
+	entry->hash_next = RImageCache.buckets[hash & (RImageCache.nbuckets - 1)];
+	RImageCache.buckets[hash & (RImageCache.nbuckets - 1)] = entry;
+	cache_lru_push(entry);
+	RImageCache.count++;
+	RImageCache.bytes += bytes;
+
+	while (RImageCache.bytes > RImageCacheBudget && RImageCache.lru_tail != entry) {
+		cache_remove(RImageCache.lru_tail);
+		RImageCache.evictions++;
 	}
 }
 
+void RReleaseCache(void)
+{
+	pthread_mutex_lock(&cache_lock);
+	while (RImageCache.lru_head)
+		cache_remove(RImageCache.lru_head);
+
+	free(RImageCache.buckets);
+	RImageCache.buckets = NULL;
+	RImageCache.nbuckets = 0;
+	RImageCacheBudget = -1;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void RGetImageCacheStats(RImageCacheStats *stats)
+{
+	pthread_mutex_lock(&cache_lock);
+	stats->hits = RImageCache.hits;
+	stats->misses = RImageCache.misses;
+	stats->evictions = RImageCache.evictions;
+	stats->count = RImageCache.count;
+	stats->bytes = RImageCache.bytes;
+	stats->max_bytes = (RImageCacheBudget > 0) ? RImageCacheBudget : 0;
+	pthread_mutex_unlock(&cache_lock);
+}
+
 RImage *RLoadImage(RContext *context, const char *file, int index)
 {
 	RImage *image = NULL;
-	int i;
+	RCachedImage *entry;
+	unsigned hash = 0;
 	struct stat st;
+	int have_stat = 0;
+	int use_cache;
 
 	assert(file != NULL);
 
-	if (RImageCacheSize < 0)
+	pthread_mutex_lock(&cache_lock);
+	if (RImageCacheBudget < 0)
 		init_cache();
 
-	if (RImageCacheSize > 0) {
-
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (RImageCache[i].file && strcmp(file, RImageCache[i].file) == 0) {
-
-				if (stat(file, &st) == 0 && st.st_mtime == RImageCache[i].last_modif) {
-					RImageCache[i].last_use = time(NULL);
-
-					return RCloneImage(RImageCache[i].image);
-
-				} else {
-					free(RImageCache[i].file);
-					RImageCache[i].file = NULL;
-					RReleaseImage(RImageCache[i].image);
-				}
+	use_cache = (RImageCacheBudget > 0);
+	if (use_cache) {
+		hash = hash_file(file, index);
+		have_stat = (stat(file, &st) == 0);
+
+		entry = cache_find(file, index, hash);
+		if (entry) {
+			if (have_stat && st.st_dev == entry->dev && st.st_ino == entry->ino
+			    && st.st_mtim.tv_sec == entry->mtime.tv_sec
+			    && st.st_mtim.tv_nsec == entry->mtime.tv_nsec) {
+				RImageCache.hits++;
+				cache_lru_unlink(entry);
+				cache_lru_push(entry);
+				image = RRetainImage(entry->image);
+				pthread_mutex_unlock(&cache_lock);
+
+				return image;
 			}
+			/* file has changed */
+			cache_remove(entry);
 		}
+		RImageCache.misses++;
 	}
+	pthread_mutex_unlock(&cache_lock);
 
 	switch (identFile(file)) {
 	case IM_ERROR:
@@ -239,45 +419,14 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 		return NULL;
 	}
 
-	/* store image in cache */
-	if (RImageCacheSize > 0 && image &&
+	/* store image in cache, if we know what file it came from */
+	if (use_cache && image && have_stat &&
 	    (RImageCacheMaxImage == 0 || RImageCacheMaxImage >= image->width * image->height)) {
-		time_t oldest = time(NULL);
-		int oldest_idx = 0;
-		int done = 0;
-
-		if (stat(file, &st) != 0) {
-			/* If we can't get the info, at least use a valid time to reduce risk of problems */
-			st.st_mtime = oldest;
-		}
-
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (!RImageCache[i].file) {
-				RImageCache[i].file = malloc(strlen(file) + 1);
-				strcpy(RImageCache[i].file, file);
-				RImageCache[i].image = RCloneImage(image);
-				RImageCache[i].last_modif = st.st_mtime;
-				RImageCache[i].last_use = time(NULL);
-				done = 1;
-				break;
-			} else {
-				if (oldest > RImageCache[i].last_use) {
-					oldest = RImageCache[i].last_use;
-					oldest_idx = i;
-				}
-			}
-		}
-
-		/* if no slot available, dump least recently used one */
-		if (!done) {
-			free(RImageCache[oldest_idx].file);
-			RReleaseImage(RImageCache[oldest_idx].image);
-			RImageCache[oldest_idx].file = malloc(strlen(file) + 1);
-			strcpy(RImageCache[oldest_idx].file, file);
-			RImageCache[oldest_idx].image = RCloneImage(image);
-			RImageCache[oldest_idx].last_modif = st.st_mtime;
-			RImageCache[oldest_idx].last_use = time(NULL);
-		}
+		pthread_mutex_lock(&cache_lock);
+		/* another thread may have loaded the same file meanwhile */
+		if (RImageCacheBudget > 0 && !cache_find(file, index, hash))
+			cache_store(file, index, hash, &st, image);
+		pthread_mutex_unlock(&cache_lock);
 	}
 
 	return image;
@@ -80,8 +80,9 @@ RImage *RCreateImage(unsigned width, unsigned height, int alpha)
 
 RImage *RRetainImage(RImage * image)
 {
+	/* images are shared between threads by the image cache */
 	if (image)
-		image->refCount++;
+		__atomic_add_fetch(&image->refCount, 1, __ATOMIC_RELAXED);
 
 	return image;
 }
@@ -90,9 +91,7 @@ void RReleaseImage(RImage * image)
 {
 	assert(image != NULL);
 
-	image->refCount--;
-
-	if (image->refCount < 1) {
+	if (__atomic_sub_fetch(&image->refCount, 1, __ATOMIC_ACQ_REL) < 1) {
 		free(image->data);
 		free(image);
 	}
@@ -26,6 +26,9 @@
 #include <X11/Xlib.h>
 #include <math.h>
 #include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "wraster.h"
@@ -279,219 +282,516 @@ void wraster_change_filter(RScalingFilter type)
 
 /*
  *	image rescaling routine
+ *
+ * The image is scaled in two separate passes, horizontal and vertical,
+ * through an intermediate image. Each pass uses a contribution table which
+ * holds, for every destination pixel, the first source pixel and a fixed
+ * number of weights (taps) in fixed point, padded with zeros. This keeps
+ * the inner loops branch free and lets the compiler vectorize them. Tables
+ * are cached, as the same sizes are scaled again and again (icons,
+ * miniwindows, switch panel).
+ *
+ * RGBA images are filtered with premultiplied alpha so the color of
+ * transparent pixels doesn't bleed into the result.
  */
 
-typedef struct {
-	int pixel;
-	double weight;
-} CONTRIB;
+#define WEIGHT_BITS	14
+#define WEIGHT_ONE	(1 << WEIGHT_BITS)
+
+/* images smaller than this (destination pixels * taps) are not worth threads */
+#define PARALLEL_MIN_WORK	(1024 * 1024)
+#define PARALLEL_MAX_THREADS	8
+#define PARALLEL_MIN_ROWS	16
+
+#define TABLE_CACHE_SIZE	8
 
 typedef struct {
-	int n;			/* number of contributors */
-	CONTRIB *p;		/* pointer to list of contributions */
-} CLIST;
+	int src_size;
+	int dst_size;
+	double (*filter)(double);
+	int taps;		/* weights per destination pixel */
+	int *start;		/* first source pixel of each destination pixel */
+	int16_t *weights;	/* dst_size * taps */
+	int refcount;
+	int cached;
+	unsigned long stamp;	/* last use, for eviction */
+} ContribTable;
+
+static ContribTable *table_cache[TABLE_CACHE_SIZE];
+static unsigned long table_stamp;
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* clamp the input to the specified range */
 #define CLAMP(v,l,h)    ((v)<(l) ? (l) : (v) > (h) ? (h) : v)
 
-/* return of calloc is not checked if NULL in the function below! */
-RImage *RSmoothScaleImage(RImage * src, unsigned new_width, unsigned new_height)
+/* v / 255 rounded, for v in [0, 255 * 255] */
+#define DIV255(v)	(((v) + 128 + (((v) + 128) >> 8)) >> 8)
+
+/* 255 / a in 16.16 fixed point, to undo premultiplication */
+static unsigned unpremul[256];
+static pthread_once_t unpremul_once = PTHREAD_ONCE_INIT;
+
+static void init_unpremul(void)
 {
-	CLIST *contrib;			/* array of contribution lists */
-	RImage *tmp;		/* intermediate image */
-	double xscale, yscale;	/* zoom scale factors */
-	int i, j, k;		/* loop variables */
-	int n;			/* pixel number */
-	double center, left, right;	/* filter calculation variables */
-	double width, fscale;	/* filter calculation variables */
-	double rweight, gweight, bweight;
-	RImage *dst;
-	unsigned char *p;
-	unsigned char *sp;
-	int sch = src->format == RRGBAFormat ? 4 : 3;
-
-	dst = RCreateImage(new_width, new_height, False);
-
-	/* create intermediate image to hold horizontal zoom */
-	tmp = RCreateImage(dst->width, src->height, False);
-	xscale = (double)new_width / (double)src->width;
-	yscale = (double)new_height / (double)src->height;
-
-	/* pre-calculate filter contributions for a row */
-	contrib = (CLIST *) calloc(new_width, sizeof(CLIST));
-	if (xscale < 1.0) {
-		width = fwidth / xscale;
-		fscale = 1.0 / xscale;
-		for (i = 0; i < new_width; ++i) {
-			contrib[i].n = 0;
-			contrib[i].p = (CONTRIB *) calloc((int) ceil(width * 2 + 1), sizeof(CONTRIB));
-			center = (double)i / xscale;
-			left = ceil(center - width);
-			right = floor(center + width);
-			for (j = left; j <= right; ++j) {
-				rweight = center - (double)j;
-				rweight = (*filterf) (rweight / fscale) / fscale;
-				if (j < 0) {
-					n = -j;
-				} else if (j >= src->width) {
-					n = (src->width - j) + src->width - 1;
-				} else {
-					n = j;
-				}
-				k = contrib[i].n++;
-				contrib[i].p[k].pixel = n * sch;
-				contrib[i].p[k].weight = rweight;
-			}
-		}
+	int a;
+
+	for (a = 1; a < 256; a++)
+		unpremul[a] = (255 << 16) / a;
+}
+
+static void free_table(ContribTable *t)
+{
+	free(t->start);
+	free(t->weights);
+	free(t);
+}
+
+static ContribTable *make_table(int src_size, int dst_size,
+				double (*filter)(double), double support)
+{
+	ContribTable *t;
+	double scale, width, fscale, center, sum;
+	double *w;
+	int *n;
+	int i, j, k, left, right, count, nmin, nmax, max_taps;
+
+	scale = (double)dst_size / (double)src_size;
+	if (scale < 1.0) {
+		width = support / scale;
+		fscale = 1.0 / scale;
 	} else {
+		width = support;
+		fscale = 1.0;
+	}
+	max_taps = (int)ceil(width * 2 + 1);
 
-		for (i = 0; i < new_width; ++i) {
-			contrib[i].n = 0;
-			contrib[i].p = (CONTRIB *) calloc((int) ceil(fwidth * 2 + 1), sizeof(CONTRIB));
-			center = (double)i / xscale;
-			left = ceil(center - fwidth);
-			right = floor(center + fwidth);
-			for (j = left; j <= right; ++j) {
-				rweight = center - (double)j;
-				rweight = (*filterf) (rweight);
-				if (j < 0) {
-					n = -j;
-				} else if (j >= src->width) {
-					n = (src->width - j) + src->width - 1;
-				} else {
-					n = j;
-				}
-				k = contrib[i].n++;
-				contrib[i].p[k].pixel = n * sch;
-				contrib[i].p[k].weight = rweight;
-			}
-		}
+	t = malloc(sizeof(ContribTable));
+	if (!t)
+		return NULL;
+	t->src_size = src_size;
+	t->dst_size = dst_size;
+	t->filter = filter;
+	t->taps = (max_taps < src_size) ? max_taps : src_size;
+	t->refcount = 1;
+	t->cached = 0;
+	t->stamp = 0;
+	t->start = malloc(dst_size * sizeof(int));
+	t->weights = calloc((size_t)dst_size * t->taps, sizeof(int16_t));
+	w = malloc(max_taps * sizeof(double));
+	n = malloc(max_taps * sizeof(int));
+	if (!t->start || !t->weights || !w || !n) {
+		free(w);
+		free(n);
+		free_table(t);
+		return NULL;
 	}
 
-	/* apply filter to zoom horizontally from src to tmp */
-	p = tmp->data;
+	for (i = 0; i < dst_size; i++) {
+		int16_t *tw = t->weights + (size_t)i * t->taps;
+		int isum, best;
+
+		/* sample at pixel centers */
+		center = ((double)i + 0.5) / scale - 0.5;
+		left = (int)ceil(center - width);
+		right = (int)floor(center + width);
+
+		count = 0;
+		sum = 0.0;
+		nmin = src_size;
+		nmax = -1;
+		for (j = left; j <= right && count < max_taps; j++) {
+			double weight = (*filter) ((center - (double)j) / fscale) / fscale;
+			int pixel;
+
+			/* mirror the image at the edges */
+			if (j < 0)
+				pixel = -j;
+			else if (j >= src_size)
+				pixel = (src_size - j) + src_size - 1;
+			else
+				pixel = j;
+			pixel = CLAMP(pixel, 0, src_size - 1);
+
+			w[count] = weight;
+			n[count] = pixel;
+			count++;
+			sum += weight;
+			if (pixel < nmin)
+				nmin = pixel;
+			if (pixel > nmax)
+				nmax = pixel;
+		}
+
+		if (nmin + t->taps > src_size)
+			nmin = src_size - t->taps;
+		t->start[i] = nmin;
+
+		if (count == 0 || fabs(sum) < 1.0E-9) {
+			/* filter gives nothing here, take the nearest pixel */
+			j = (int)floor(center + 0.5);
+			j = CLAMP(j, 0, src_size - 1);
+			if (j < nmin || j >= nmin + t->taps)
+				t->start[i] = nmin = (j + t->taps > src_size) ? src_size - t->taps : j;
+			tw[j - nmin] = WEIGHT_ONE;
+			continue;
+		}
 
-	for (k = 0; k < tmp->height; ++k) {
-		CONTRIB *pp;
+		/* normalize, so flat areas keep their value exactly */
+		isum = 0;
+		for (k = 0; k < count; k++) {
+			double v = w[k] / sum * WEIGHT_ONE;
 
-		sp = src->data + src->width * k * sch;
+			tw[n[k] - nmin] += (int16_t)floor(v + 0.5);
+		}
+		best = 0;
+		for (k = 0; k < t->taps; k++) {
+			isum += tw[k];
+			if (tw[k] > tw[best])
+				best = k;
+		}
+		tw[best] += WEIGHT_ONE - isum;
+	}
 
-		for (i = 0; i < tmp->width; ++i) {
-			rweight = gweight = bweight = 0.0;
+	free(w);
+	free(n);
 
-			pp = contrib[i].p;
+	return t;
+}
 
-			for (j = 0; j < contrib[i].n; ++j) {
-				rweight += sp[pp[j].pixel] * pp[j].weight;
-				gweight += sp[pp[j].pixel + 1] * pp[j].weight;
-				bweight += sp[pp[j].pixel + 2] * pp[j].weight;
+static ContribTable *get_table(int src_size, int dst_size)
+{
+	ContribTable *t = NULL;
+	int i, victim = -1;
+
+	pthread_mutex_lock(&table_lock);
+	for (i = 0; i < TABLE_CACHE_SIZE; i++) {
+		ContribTable *c = table_cache[i];
+
+		if (c && c->src_size == src_size && c->dst_size == dst_size
+		    && c->filter == filterf) {
+			t = c;
+			t->refcount++;
+			t->stamp = ++table_stamp;
+			break;
+		}
+	}
+	if (!t) {
+		t = make_table(src_size, dst_size, filterf, fwidth);
+		for (i = 0; t && i < TABLE_CACHE_SIZE; i++) {
+			ContribTable *c = table_cache[i];
+
+			if (!c) {
+				victim = i;
+				break;
 			}
-			*p++ = CLAMP(rweight, 0, 255);
-			*p++ = CLAMP(gweight, 0, 255);
-			*p++ = CLAMP(bweight, 0, 255);
+			if (c->refcount == 0
+			    && (victim < 0 || c->stamp < table_cache[victim]->stamp))
+				victim = i;
+		}
+		if (victim >= 0) {
+			if (table_cache[victim])
+				free_table(table_cache[victim]);
+			table_cache[victim] = t;
+			t->cached = 1;
+			t->stamp = ++table_stamp;
 		}
 	}
+	pthread_mutex_unlock(&table_lock);
+
+	return t;
+}
+
+static void release_table(ContribTable *t)
+{
+	pthread_mutex_lock(&table_lock);
+	t->refcount--;
+	if (t->refcount == 0 && !t->cached)
+		free_table(t);
+	pthread_mutex_unlock(&table_lock);
+}
+
+/*
+ * Work of one pass over rows [y0, y1) of its output image
+ */
+typedef struct ScalePass {
+	void (*run)(struct ScalePass *pass);
+	const ContribTable *table;
+	const unsigned char *src;
+	unsigned char *dst;
+	int src_width;
+	int dst_width;
+	int channels;		/* of both images */
+	int src_alpha;		/* source is RGBA, not premultiplied yet */
+	int y0, y1;
+} ScalePass;
+
+static void scale_rows_horizontally(ScalePass *pass)
+{
+	const ContribTable *t = pass->table;
+	const int taps = t->taps;
+	const int ch = pass->channels;
+	unsigned char *premul = NULL;
+	unsigned char *d;
+	int x, y, k;
 
-	/* free the memory allocated for horizontal filter weights */
-	for (i = 0; i < new_width; ++i) {
-		free(contrib[i].p);
+	if (pass->src_alpha) {
+		premul = malloc(pass->src_width * 4);
+		if (!premul)
+			return;
 	}
-	free(contrib);
-
-	/* pre-calculate filter contributions for a column */
-	contrib = (CLIST *) calloc(dst->height, sizeof(CLIST));
-	if (yscale < 1.0) {
-		width = fwidth / yscale;
-		fscale = 1.0 / yscale;
-		for (i = 0; i < dst->height; ++i) {
-			contrib[i].n = 0;
-			contrib[i].p = (CONTRIB *) calloc((int) ceil(width * 2 + 1), sizeof(CONTRIB));
-			center = (double)i / yscale;
-			left = ceil(center - width);
-			right = floor(center + width);
-			for (j = left; j <= right; ++j) {
-				rweight = center - (double)j;
-				rweight = (*filterf) (rweight / fscale) / fscale;
-				if (j < 0) {
-					n = -j;
-				} else if (j >= tmp->height) {
-					n = (tmp->height - j) + tmp->height - 1;
-				} else {
-					n = j;
-				}
-				k = contrib[i].n++;
-				contrib[i].p[k].pixel = n * 3;
-				contrib[i].p[k].weight = rweight;
+
+	for (y = pass->y0; y < pass->y1; y++) {
+		const unsigned char *s = pass->src + (size_t)y * pass->src_width * ch;
+
+		if (premul) {
+			for (x = 0; x < pass->src_width; x++) {
+				unsigned a = s[x * 4 + 3];
+
+				premul[x * 4] = DIV255(s[x * 4] * a);
+				premul[x * 4 + 1] = DIV255(s[x * 4 + 1] * a);
+				premul[x * 4 + 2] = DIV255(s[x * 4 + 2] * a);
+				premul[x * 4 + 3] = a;
 			}
+			s = premul;
 		}
-	} else {
-		for (i = 0; i < dst->height; ++i) {
-			contrib[i].n = 0;
-			contrib[i].p = (CONTRIB *) calloc((int) ceil(fwidth * 2 + 1), sizeof(CONTRIB));
-			center = (double)i / yscale;
-			left = ceil(center - fwidth);
-			right = floor(center + fwidth);
-			for (j = left; j <= right; ++j) {
-				rweight = center - (double)j;
-				rweight = (*filterf) (rweight);
-				if (j < 0) {
-					n = -j;
-				} else if (j >= tmp->height) {
-					n = (tmp->height - j) + tmp->height - 1;
-				} else {
-					n = j;
+
+		d = pass->dst + (size_t)y * pass->dst_width * ch;
+		for (x = 0; x < pass->dst_width; x++) {
+			const int16_t *w = t->weights + (size_t)x * taps;
+			const unsigned char *p = s + t->start[x] * ch;
+			int r = WEIGHT_ONE / 2, g = WEIGHT_ONE / 2;
+			int b = WEIGHT_ONE / 2, a = WEIGHT_ONE / 2;
+
+			if (ch == 4) {
+				for (k = 0; k < taps; k++, p += 4) {
+					r += w[k] * p[0];
+					g += w[k] * p[1];
+					b += w[k] * p[2];
+					a += w[k] * p[3];
 				}
-				k = contrib[i].n++;
-				contrib[i].p[k].pixel = n * 3;
-				contrib[i].p[k].weight = rweight;
+				a >>= WEIGHT_BITS;
+				a = CLAMP(a, 0, 255);
+				r >>= WEIGHT_BITS;
+				g >>= WEIGHT_BITS;
+				b >>= WEIGHT_BITS;
+				*d++ = CLAMP(r, 0, a);
+				*d++ = CLAMP(g, 0, a);
+				*d++ = CLAMP(b, 0, a);
+				*d++ = a;
+			} else {
+				for (k = 0; k < taps; k++, p += 3) {
+					r += w[k] * p[0];
+					g += w[k] * p[1];
+					b += w[k] * p[2];
+				}
+				r >>= WEIGHT_BITS;
+				g >>= WEIGHT_BITS;
+				b >>= WEIGHT_BITS;
+				*d++ = CLAMP(r, 0, 255);
+				*d++ = CLAMP(g, 0, 255);
+				*d++ = CLAMP(b, 0, 255);
 			}
 		}
 	}
 
-	/* apply filter to zoom vertically from tmp to dst */
-	sp = malloc(tmp->height * 3);
-
-	for (k = 0; k < new_width; ++k) {
-		CONTRIB *pp;
+	free(premul);
+}
 
-		p = dst->data + k * 3;
+static void scale_rows_vertically(ScalePass *pass)
+{
+	const ContribTable *t = pass->table;
+	const int ch = pass->channels;
+	const int row = pass->dst_width * ch;
+	int32_t *acc;
+	unsigned char *d;
+	int x, y, k;
+
+	acc = malloc(row * sizeof(int32_t));
+	if (!acc)
+		return;
+	pthread_once(&unpremul_once, init_unpremul);
+
+	for (y = pass->y0; y < pass->y1; y++) {
+		const int16_t *w = t->weights + (size_t)y * t->taps;
+		const unsigned char *s = pass->src + (size_t)t->start[y] * row;
+
+		/* whole rows at a time: the inner loop is a plain multiply-add */
+		for (x = 0; x < row; x++)
+			acc[x] = WEIGHT_ONE / 2;
+		for (k = 0; k < t->taps; k++, s += row) {
+			const int32_t wk = w[k];
+
+			if (wk == 0)
+				continue;
+			for (x = 0; x < row; x++)
+				acc[x] += wk * s[x];
+		}
 
-		/* copy a column into a row */
-		{
-			int i;
-			unsigned char *p, *d;
+		d = pass->dst + (size_t)y * row;
+		if (ch == 4) {
+			for (x = 0; x < row; x += 4) {
+				int r = acc[x] >> WEIGHT_BITS;
+				int g = acc[x + 1] >> WEIGHT_BITS;
+				int b = acc[x + 2] >> WEIGHT_BITS;
+				int a = acc[x + 3] >> WEIGHT_BITS;
+
+				a = CLAMP(a, 0, 255);
+				if (a == 0) {
+					d[x] = d[x + 1] = d[x + 2] = d[x + 3] = 0;
+					continue;
+				}
+				/* back from premultiplied alpha */
+				r = CLAMP(r, 0, a);
+				g = CLAMP(g, 0, a);
+				b = CLAMP(b, 0, a);
+				d[x] = (r * unpremul[a] + 0x8000) >> 16;
+				d[x + 1] = (g * unpremul[a] + 0x8000) >> 16;
+				d[x + 2] = (b * unpremul[a] + 0x8000) >> 16;
+				d[x + 3] = a;
+			}
+		} else {
+			for (x = 0; x < row; x++) {
+				int v = acc[x] >> WEIGHT_BITS;
 
-			d = sp;
-			for (i = tmp->height, p = tmp->data + k * 3; i-- > 0; p += tmp->width * 3) {
-				*d++ = *p;
-				*d++ = *(p + 1);
-				*d++ = *(p + 2);
+				d[x] = CLAMP(v, 0, 255);
 			}
 		}
-		for (i = 0; i < new_height; ++i) {
-			rweight = gweight = bweight = 0.0;
+	}
 
-			pp = contrib[i].p;
+	free(acc);
+}
 
-			for (j = 0; j < contrib[i].n; ++j) {
-				rweight += sp[pp[j].pixel] * pp[j].weight;
-				gweight += sp[pp[j].pixel + 1] * pp[j].weight;
-				bweight += sp[pp[j].pixel + 2] * pp[j].weight;
-			}
-			*p = CLAMP(rweight, 0, 255);
-			*(p + 1) = CLAMP(gweight, 0, 255);
-			*(p + 2) = CLAMP(bweight, 0, 255);
-			p += new_width * 3;
-		}
+static void *scale_pass_thread(void *arg)
+{
+	ScalePass *pass = arg;
+
+	pass->run(pass);
+	return NULL;
+}
+
+/*
+ * Runs the pass over `rows` output rows, split between threads if there is
+ * enough work (rows * per_row) to pay for them.
+ */
+static void run_scale_pass(ScalePass *pass, int rows, long per_row)
+{
+	ScalePass parts[PARALLEL_MAX_THREADS];
+	pthread_t threads[PARALLEL_MAX_THREADS];
+	int started[PARALLEL_MAX_THREADS];
+	long cpus;
+	int n, i;
+
+	n = 1;
+	if ((long)rows * per_row >= PARALLEL_MIN_WORK) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n = CLAMP(cpus, 1, PARALLEL_MAX_THREADS);
+		if (n > rows / PARALLEL_MIN_ROWS)
+			n = rows / PARALLEL_MIN_ROWS;
+		if (n < 1)
+			n = 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		parts[i] = *pass;
+		parts[i].y0 = (int)((long)rows * i / n);
+		parts[i].y1 = (int)((long)rows * (i + 1) / n);
+		started[i] = 0;
 	}
-	free(sp);
+	/* the last part is done by the calling thread */
+	for (i = 0; i < n - 1; i++)
+		started[i] = (pthread_create(&threads[i], NULL, scale_pass_thread,
+					     &parts[i]) == 0);
+	parts[n - 1].run(&parts[n - 1]);
+	for (i = 0; i < n - 1; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			parts[i].run(&parts[i]);
+	}
+}
+
+RImage *RSmoothScaleImage(RImage * src, unsigned new_width, unsigned new_height)
+{
+	ContribTable *xtable, *ytable;
+	RImage *tmp;		/* intermediate image */
+	RImage *dst;
+	ScalePass hpass, vpass;
+	int alpha = (src->format == RRGBAFormat);
+	int ch = alpha ? 4 : 3;
+	int vertical_first;
+
+	if (new_width == src->width && new_height == src->height)
+		return RCloneImage(src);
 
-	/* free the memory allocated for vertical filter weights */
-	for (i = 0; i < dst->height; ++i) {
-		free(contrib[i].p);
+	/*
+	 * The vertical pass works on whole rows and is much cheaper than the
+	 * horizontal one, so when the height shrinks it goes first and leaves
+	 * fewer rows for the horizontal pass. RGBA images are premultiplied by
+	 * the horizontal pass, which has to come first then.
+	 */
+	vertical_first = (!alpha && new_height < src->height);
+
+	dst = RCreateImage(new_width, new_height, alpha);
+	if (!dst)
+		return NULL;
+
+	if (vertical_first)
+		tmp = RCreateImage(src->width, new_height, alpha);
+	else
+		tmp = RCreateImage(new_width, src->height, alpha);
+	if (!tmp) {
+		RReleaseImage(dst);
+		return NULL;
+	}
+
+	xtable = get_table(src->width, new_width);
+	ytable = get_table(src->height, new_height);
+	if (!xtable || !ytable) {
+		if (xtable)
+			release_table(xtable);
+		if (ytable)
+			release_table(ytable);
+		RReleaseImage(tmp);
+		RReleaseImage(dst);
+		RErrorCode = RERR_NOMEMORY;
+		return NULL;
+	}
+
+	hpass.run = scale_rows_horizontally;
+	hpass.table = xtable;
+	hpass.src_width = src->width;
+	hpass.dst_width = new_width;
+	hpass.channels = ch;
+	hpass.src_alpha = alpha;
+
+	vpass.run = scale_rows_vertically;
+	vpass.table = ytable;
+	vpass.channels = ch;
+	vpass.src_alpha = 0;
+
+	if (vertical_first) {
+		vpass.src = src->data;
+		vpass.dst = tmp->data;
+		vpass.src_width = vpass.dst_width = src->width;
+		run_scale_pass(&vpass, new_height, (long)src->width * ytable->taps);
+
+		hpass.src = tmp->data;
+		hpass.dst = dst->data;
+		run_scale_pass(&hpass, new_height, (long)new_width * xtable->taps);
+	} else {
+		/* tmp holds premultiplied colors if RGBA */
+		hpass.src = src->data;
+		hpass.dst = tmp->data;
+		run_scale_pass(&hpass, src->height, (long)new_width * xtable->taps);
+
+		vpass.src = tmp->data;
+		vpass.dst = dst->data;
+		vpass.src_width = vpass.dst_width = new_width;
+		run_scale_pass(&vpass, new_height, (long)new_width * ytable->taps);
 	}
-	free(contrib);
 
+	release_table(xtable);
+	release_table(ytable);
 	RReleaseImage(tmp);
 
 	return dst;
@@ -0,0 +1,152 @@
+/*
+ * Micro-benchmark for RConvertImage.
+ *
+ * Converts titlebar, icon and background sized images to pixmaps in a loop
+ * and prints the time per conversion. Run with WRASTER_CONVERT=generic,
+ * scalar or ssse3 to compare with slower converters.
+ */
+
+#include <X11/Xlib.h>
+#include "wraster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+Display *dpy;
+RContext *ctx;
+char *ProgName;
+
+static struct {
+	const char *name;
+	int width, height;
+	int loops;
+} sizes[] = {
+	{ "titlebar", 800, 22, 2000 },
+	{ "icon", 64, 64, 5000 },
+	{ "miniwindow", 128, 128, 2000 },
+	{ "background", 1920, 1080, 20 }
+};
+
+void print_help()
+{
+	printf("usage: %s [-options]\n", ProgName);
+	puts("options:");
+	puts(" -m 		match  colors");
+	puts(" -d		dither colors (default)");
+	puts(" -a		convert RGBA images");
+	puts(" -v <vis-id>	visual id to use");
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+	RContextAttributes attr;
+	RColor from, to;
+	RImage *image, *tmp;
+	Pixmap pix;
+	int i, j, rmode = RDitheredRendering, alpha = 0;
+	int visualID = -1;
+	double start, elapsed;
+
+	ProgName = strrchr(argv[0], '/');
+	if (!ProgName)
+		ProgName = argv[0];
+	else
+		ProgName++;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-m") == 0) {
+			rmode = RBestMatchRendering;
+		} else if (strcmp(argv[i], "-d") == 0) {
+			rmode = RDitheredRendering;
+		} else if (strcmp(argv[i], "-a") == 0) {
+			alpha = 1;
+		} else if (strcmp(argv[i], "-v") == 0) {
+			i++;
+			if (i >= argc) {
+				fprintf(stderr, "too few arguments for %s\n", argv[i - 1]);
+				exit(0);
+			}
+			if (sscanf(argv[i], "%i", &visualID) != 1) {
+				fprintf(stderr, "bad value for visual ID: \"%s\"\n", argv[i]);
+				exit(0);
+			}
+		} else {
+			print_help();
+			exit(1);
+		}
+	}
+
+	dpy = XOpenDisplay("");
+	if (!dpy) {
+		puts("cant open display");
+		exit(1);
+	}
+	attr.flags = RC_RenderMode;
+	attr.render_mode = rmode;
+	if (visualID >= 0) {
+		attr.flags |= RC_VisualID;
+		attr.visualid = visualID;
+	}
+
+	ctx = RCreateContext(dpy, DefaultScreen(dpy), &attr);
+	if (!ctx) {
+		printf("could not initialize graphics library context: %s\n", RMessageForError(RErrorCode));
+		exit(1);
+	}
+
+	printf("depth %i, %s, %s images\n", ctx->depth,
+	       rmode == RDitheredRendering ? "dithered" : "matched", alpha ? "RGBA" : "RGB");
+
+	from.red = 0x20; from.green = 0x40; from.blue = 0x80; from.alpha = 255;
+	to.red = 0xe0; to.green = 0xc0; to.blue = 0x10; to.alpha = 255;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		image = RRenderGradient(sizes[i].width, sizes[i].height, &from, &to, RDiagonalGradient);
+		if (!image) {
+			printf("could not render image: %s\n", RMessageForError(RErrorCode));
+			exit(1);
+		}
+		if (alpha) {
+			tmp = RCreateImage(image->width, image->height, True);
+			for (j = 0; j < image->width * image->height; j++) {
+				memcpy(tmp->data + j * 4, image->data + j * 3, 3);
+				tmp->data[j * 4 + 3] = 255;
+			}
+			RReleaseImage(image);
+			image = tmp;
+		}
+
+		start = now();
+		for (j = 0; j < sizes[i].loops; j++) {
+			if (!RConvertImage(ctx, image, &pix)) {
+				printf("could not convert image: %s\n", RMessageForError(RErrorCode));
+				exit(1);
+			}
+			XFreePixmap(dpy, pix);
+		}
+		XSync(dpy, False);
+		elapsed = now() - start;
+
+		printf("%-12s %4ix%-4i %9.1f us/conversion %8.1f Mpixels/s\n",
+		       sizes[i].name, sizes[i].width, sizes[i].height,
+		       elapsed * 1000000.0 / sizes[i].loops,
+		       (double)sizes[i].width * sizes[i].height * sizes[i].loops / elapsed / 1000000.0);
+
+		RReleaseImage(image);
+	}
+
+	RDestroyContext(ctx);
+	RShutdown();
+	XCloseDisplay(dpy);
+
+	return 0;
+}
@@ -34,6 +34,21 @@
  * preceded by a hash to the variable name as in
  * WRASTER_GAMMA#1
  * for screen number 1
+ *
+ * RIMAGE_CACHE_KB <size>
+ * size of the cache of loaded images in kilobytes, RIMAGE_CACHE=0
+ * disables the cache.
+ *
+ * RIMAGE_CACHE_SIZE <pixels>
+ * largest image (width * height) to keep in the cache, 0 for any size.
+ *
+ * Default:
+ * RIMAGE_CACHE_KB 8192
+ * RIMAGE_CACHE_SIZE 16384
+ *
+ * WRASTER_CONVERT generic|scalar|ssse3
+ * use a slower converter to TrueColor pixmaps than the best one the CPU
+ * supports, for testing.
  */
 
 #ifndef __WRASTER_WRASTER_H__
@@ -254,6 +269,19 @@ typedef struct RImage {
 } RImage;
 
 
+/*
+ * statistics of the cache of loaded images, see RGetImageCacheStats
+ */
+typedef struct RImageCacheStats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;	   /* images dropped to fit the budget */
+    unsigned long count;	   /* images in the cache */
+    unsigned long bytes;	   /* pixel memory of cached images */
+    unsigned long max_bytes;
+} RImageCacheStats;
+
+
 /*
  * internal wrapper for XImage. Used for shm abstraction
  */
@@ -377,8 +405,15 @@ RImage *RCreateImageFromDrawable(RContext *context, Drawable drawable,
                                  Pixmap mask)
         __wrlib_useresult __wrlib_nonalias __wrlib_nonnull(1);
 
+/*
+ * Images returned by RLoadImage may be shared with the image cache, they
+ * must not be modified in place: use RCloneImage to get a private copy.
+ */
 RImage *RLoadImage(RContext *context, const char *file, int index)
-        __wrlib_useresult __wrlib_nonalias __wrlib_nonnull(1, 2);
+        __wrlib_useresult __wrlib_nonnull(1, 2);
+
+void RGetImageCacheStats(RImageCacheStats *stats)
+        __wrlib_nonnull(1);
 
 RImage* RRetainImage(RImage *image);
 
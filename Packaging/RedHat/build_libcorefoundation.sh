@@ -15,6 +15,7 @@ CF_VERSION=`rpm_version ${SPEC_FILE}`
 print_H1 " Building Core Foundation (libcorefoundation) package..."
 cp ${REPO_DIR}/Libraries/libcorefoundation/*.patch ${SOURCES_DIR}
 cp ${REPO_DIR}/Libraries/libcorefoundation/CFNotificationCenter.c ${SOURCES_DIR}
+cp ${REPO_DIR}/Libraries/libcorefoundation/CFNotificationQueue.h ${SOURCES_DIR}
 cp ${REPO_DIR}/Libraries/libcorefoundation/CFFileDescriptor.[ch] ${SOURCES_DIR}
 
 print_H2 "===== Install Core Foundation build dependencies..."